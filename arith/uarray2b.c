@@ -8,7 +8,11 @@
  *     Date:       10/24/2023
  *      
  *     The purpose of this file is to implement the UArray2b ADT. We did not 
- *     write this file, it is the solution code given to us.
+ *     write this file, it is the solution code given to us. The blocks used
+ *     to be UArrays in a UArray2; they now share one allocation, aligned to
+ *     a cache line, in the order UArray2b_map visits them. Cells and blocks
+ *     are visited in the same order as before, so 40image output is
+ *     unchanged.
  *
  *    
  *
@@ -16,27 +20,34 @@
 
 #line 59 "www/solutions/uarray2b.nw"
 #include <math.h>
+#include <stdint.h>
 #include "assert.h"
 #include "mem.h"
-#include "uarray.h"
-#include "uarray2.h"
 #include "uarray2b.h"
 
 #define T UArray2b_T
 
+/* Blocks start on a cache line boundary */
+#define CACHE_LINE 64
+
 struct T { /* represents a 2D array of cells each of size 'size' */
         int width, height;
         unsigned blocksize;
         unsigned size;
-        UArray2_T blocks;
+        int blocks_wide, blocks_high;
+        size_t block_bytes;
+        char *cells;
+        void *memory;
         /*
          * matrix of blocks, each blocksize * blocksize 
          *
          * matrix dimensions are width and height divided by blocksize,
          * rounded up
          *
-         * a block is a Uarray_T of length blocksize * blocksize 
-         * and size 'size'
+         * block (bx, by) is blocksize * blocksize cells of size 'size',
+         * starting (bx * blocks_high + by) * block_bytes bytes after cells;
+         * block_bytes is rounded up to whole cache lines, and memory is the
+         * allocation cells points into
          *
          * invariant relating cells in blocks to cells in the abstraction
          *  described in section on coordinate transformations below
@@ -54,43 +65,28 @@ T UArray2b_new(int width, int height, int size, int blocksize)
         array->height = height;
         array->size   = size;
         array->blocksize = blocksize;
-        array->blocks = UArray2_new((width  + blocksize - 1) / blocksize,
-                                    (height + blocksize - 1) / blocksize,
-                                    sizeof(UArray_T));
-        int xblocks = UArray2_width (array->blocks); 
-        int yblocks = UArray2_height(array->blocks);
-        for (int i = 0; i < xblocks; i++) {
-                for (int j = 0; j < yblocks; j++) {
-                        UArray_T *block = UArray2_at(array->blocks, i, j);
-                        *block = UArray_new(blocksize * blocksize, size);
-                        
-#line 169 "www/solutions/uarray2b.nw"
-if (0) {
-        fprintf(stderr, "Allocated %p; put %p at %p\n",
-                (void *)*block, (void *)*(UArray_T*)UArray2_at(array->blocks, i, j),
-                UArray2_at(array->blocks, i, j));
-}
-#line 115 "www/solutions/uarray2b.nw"
-                                  }
-        }
+        array->blocks_wide = (width  + blocksize - 1) / blocksize;
+        array->blocks_high = (height + blocksize - 1) / blocksize;
+
+        /* one zeroed allocation for every block, like UArray_new's */
+        size_t block_bytes = (size_t) blocksize * blocksize * size;
+        block_bytes = (block_bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+        size_t nblocks = (size_t) array->blocks_wide * array->blocks_high;
+        assert(nblocks == 0
+               || block_bytes <= (SIZE_MAX - CACHE_LINE) / nblocks);
+        char *memory = CALLOC(1, (long) (nblocks * block_bytes + CACHE_LINE));
+        uintptr_t misaligned = (uintptr_t) memory % CACHE_LINE;
+        array->block_bytes = block_bytes;
+        array->memory = memory;
+        array->cells = misaligned == 0 ? memory
+                                       : memory + CACHE_LINE - misaligned;
         return array;
 }
 #line 124 "www/solutions/uarray2b.nw"
 void UArray2b_free(T *array2b)
 {
-        int i;
         assert(array2b && *array2b);
-        T array = *array2b;
-        int xblocks = UArray2_width (array->blocks);
-        int yblocks = UArray2_height(array->blocks);
-        assert(UArray2_size(array->blocks) == sizeof(UArray_T));
-        for (i = 0; i < xblocks; i++) {
-                for (int j = 0; j < yblocks; j++) {
-                        UArray_T *p = UArray2_at(array->blocks, i, j);
-                        UArray_free(p);
-                }
-        }
-        UArray2_free(&(*array2b)->blocks);
+        FREE((*array2b)->memory);
         FREE(*array2b);
 }
 #line 148 "www/solutions/uarray2b.nw"
@@ -117,8 +113,9 @@ void *UArray2b_at(T array2b, int i, int j)
         int b  = array2b->blocksize;
         int bx = i / b;   /* block x coordinate */
         int by = j / b;   /* block y coordinate */
-        UArray_T *blockp = UArray2_at(array2b->blocks, bx, by);
-        return UArray_at(*blockp, (i % b) * b + j % b);
+        char *block = array2b->cells + ((size_t) bx * array2b->blocks_high
+                                        + by) * array2b->block_bytes;
+        return block + (size_t) ((i % b) * b + j % b) * array2b->size;
 }
 #line 222 "www/solutions/uarray2b.nw"
 void UArray2b_map(T array2b, 
@@ -130,15 +127,16 @@ void UArray2b_map(T array2b,
         int       h      = array2b->height;
         int       w      = array2b->width;
         int       b      = array2b->blocksize;
-        UArray2_T blocks = array2b->blocks;
-        int       bw     = UArray2_width(blocks);
-        int       bh     = UArray2_height(blocks);
+        int       bw     = array2b->blocks_wide;
+        int       bh     = array2b->blocks_high;
+        int       size   = array2b->size;
+        int       len    = b * b;
+        /* blocks are stored in the order they are visited */
+        char     *block  = array2b->cells;
 
         for (int bx = 0; bx < bw; bx++) {
                 for (int by = 0; by < bh; by++) {
-                        UArray_T *blockp = UArray2_at(blocks, bx, by);
-                        UArray_T  block  = *blockp;
-                        int       len    = UArray_length(block);
+                        char *elem = block;
                         /* (i0, j0) correspond to upper left */
                         /* corner of block (bx, by)          */
                         int i0 = b * bx; 
@@ -148,10 +146,11 @@ void UArray2b_map(T array2b,
                                 int j = j0 + cell % b;
                                 /* measured overhead 0.5% to 1.5% */
                                 if (i < w && j < h) {
-                                        apply(i, j, array2b, 
-                                              UArray_at(block, cell), cl);
+                                        apply(i, j, array2b, elem, cl);
                                 }
+                                elem += size;
                         }
+                        block += array2b->block_bytes;
                 }
         }
 }
@@ -0,0 +1,321 @@
+/******************************************************************************
+ *
+ *                               inplace.c
+ *
+ *     Assignment: locality
+ *     Authors:    Marten Tropp and Matt Carey
+ *     Date:       10/10/2023
+ *
+ *     The purpose of this file is to implement the in-place transform used
+ *     by ppmtrans -in-place. Flips and rotating by 180 degrees swap pairs
+ *     of pixels (or of rows). A square image is transposed by swapping
+ *     each tile above the diagonal with the matching tile below it. A
+ *     transpose that is not square moves every pixel to a new place, and
+ *     the moves form cycles: each cycle is followed once, carrying one
+ *     pixel at a time, with a bit per pixel to remember which ones have
+ *     been moved. Rotating by 90 or 270 degrees is a transpose followed by
+ *     a flip, so it takes two passes over the image.
+ *
+ *****************************************************************************/
+#include <string.h>
+
+#include "assert.h"
+#include "mem.h"
+#include "inplace.h"
+
+/* Tiles of TILE by TILE pixels are swapped across the diagonal */
+#define TILE 32
+
+/* The largest pixel that can be swapped, a 12 byte struct Pnm_rgb */
+#define MAX_PIXEL 16
+
+/* Rows are swapped ROW_CHUNK bytes at a time */
+#define ROW_CHUNK 4096
+
+static void transposeSquare(PlainImage image);
+static void transposeCycles(PlainImage image);
+static void reverseRows(PlainImage image);
+static void reversePixels(char *first, size_t count, size_t size);
+static void swapRows(PlainImage image);
+static void swapPixels(char *a, char *b, size_t size);
+static void swapBytes(char *a, char *b, size_t n);
+
+/*******************************transformInPlace*******************************
+ *
+ * Rotate, flip, or transpose an image without a second copy of it
+ * Inputs:
+ *         PlainImage *image: the image, which is changed into the result.
+ *                            Its width and height trade places if it is
+ *                            transposed
+ *         bool transposes: whether pixel (col, row) first moves to
+ *                          (row, col)
+ *         bool flipsCols: whether the columns are then reversed
+ *         bool flipsRows: whether the rows are then reversed
+ * Return: none
+ * Expects:
+ *         image to be non-null, with no gaps between its rows and pixels of
+ *         at most 16 bytes
+ * Notes:
+ *         CRE if image is NULL, has gaps between its rows, or has pixels
+ *         that are too big
+ *         A transpose that is not square allocates one bit per pixel
+ *
+ *****************************************************************************/
+void transformInPlace(PlainImage *image, bool transposes, bool flipsCols,
+                      bool flipsRows)
+{
+        assert(image != NULL);
+        assert(image->size <= MAX_PIXEL);
+        assert(image->stride == image->width * image->size);
+
+        if (transposes) {
+                if (image->width == image->height) {
+                        transposeSquare(*image);
+                } else {
+                        transposeCycles(*image);
+                }
+                int width = image->width;
+                image->width = image->height;
+                image->height = width;
+                image->stride = image->width * image->size;
+        }
+
+        if (flipsCols && flipsRows) {
+                /* reversing every pixel reverses both */
+                reversePixels(image->pixels,
+                              (size_t) image->width * image->height,
+                              image->size);
+        } else if (flipsCols) {
+                reverseRows(*image);
+        } else if (flipsRows) {
+                swapRows(*image);
+        }
+}
+
+/*******************************transposeSquare********************************
+ *
+ * Transpose a square image across its top left to bottom right diagonal
+ * Inputs:
+ *         PlainImage image: the image transposed
+ * Return: none
+ * Expects:
+ *         image to be as wide as it is high
+ * Notes:
+ *         The tile of rows y0 and columns x0 is swapped with the tile of
+ *         rows x0 and columns y0, so both tiles are in the cache together
+ *
+ *****************************************************************************/
+static void transposeSquare(PlainImage image)
+{
+        int n = image.width;
+        size_t size = image.size;
+
+        for (int y0 = 0; y0 < n; y0 += TILE) {
+                for (int x0 = y0; x0 < n; x0 += TILE) {
+                        int yEnd = y0 + TILE < n ? y0 + TILE : n;
+                        int xEnd = x0 + TILE < n ? x0 + TILE : n;
+
+                        for (int y = y0; y < yEnd; y++) {
+                                /* only pixels above the diagonal */
+                                int x = x0 > y + 1 ? x0 : y + 1;
+                                char *row = image.pixels + y * image.stride;
+                                char *col = image.pixels + y * size;
+                                for (; x < xEnd; x++) {
+                                        swapPixels(row + x * size,
+                                                   col + x * image.stride,
+                                                   size);
+                                }
+                        }
+                }
+        }
+}
+
+/*******************************transposeCycles********************************
+ *
+ * Transpose an image that is not square across its top left to bottom
+ * right diagonal
+ * Inputs:
+ *         PlainImage image: the image transposed, whose pixels are left as
+ *                           image.height pixels across and image.width down
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         Counting pixels in memory order, the pixel numbered k moves to
+ *         k * height mod (width * height - 1); the first and last pixels
+ *         stay where they are
+ *
+ *****************************************************************************/
+static void transposeCycles(PlainImage image)
+{
+        size_t count = (size_t) image.width * image.height;
+        if (count <= 2) {
+                return;
+        }
+        size_t last = count - 1;
+        size_t height = image.height;
+        size_t size = image.size;
+        size_t bytes = (count + 7) / 8;
+        unsigned char *moved = ALLOC((long) bytes);
+        memset(moved, 0, bytes);
+
+        for (size_t start = 1; start < last; start++) {
+                if (moved[start / 8] & (1u << (start % 8))) {
+                        continue;
+                }
+
+                /* carry each pixel of the cycle to the next one's place */
+                char carried[MAX_PIXEL];
+                memcpy(carried, image.pixels + start * size, size);
+                size_t k = start;
+                do {
+                        k = k * height % last;
+                        swapPixels(carried, image.pixels + k * size, size);
+                        moved[k / 8] |= 1u << (k % 8);
+                } while (k != start);
+        }
+
+        FREE(moved);
+}
+
+/*********************************reverseRows**********************************
+ *
+ * Flip an image horizontally
+ * Inputs:
+ *         PlainImage image: the image flipped
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         none
+ *
+ *****************************************************************************/
+static void reverseRows(PlainImage image)
+{
+        for (int y = 0; y < image.height; y++) {
+                reversePixels(image.pixels + y * image.stride, image.width,
+                              image.size);
+        }
+}
+
+/********************************reversePixels*********************************
+ *
+ * Reverse the order of consecutive pixels
+ * Inputs:
+ *         char *first: the first pixel
+ *         size_t count: the number of pixels
+ *         size_t size: the number of bytes in a pixel
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         The first and last pixels are swapped, then the second and the
+ *         second to last, and so on
+ *
+ *****************************************************************************/
+static void reversePixels(char *first, size_t count, size_t size)
+{
+        if (count < 2) {
+                return;
+        }
+        char *lo = first;
+        char *hi = first + (count - 1) * size;
+        while (lo < hi) {
+                swapPixels(lo, hi, size);
+                lo += size;
+                hi -= size;
+        }
+}
+
+/**********************************swapRows************************************
+ *
+ * Flip an image vertically
+ * Inputs:
+ *         PlainImage image: the image flipped
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         Row y is swapped with row height - y - 1
+ *
+ *****************************************************************************/
+static void swapRows(PlainImage image)
+{
+        for (int y = 0; y < image.height / 2; y++) {
+                swapBytes(image.pixels + y * image.stride,
+                          image.pixels + (image.height - y - 1) * image.stride,
+                          image.stride);
+        }
+}
+
+/*********************************swapPixels***********************************
+ *
+ * Swap two pixels
+ * Inputs:
+ *         char *a: the first pixel
+ *         char *b: the second pixel
+ *         size_t size: the number of bytes in a pixel
+ * Return: none
+ * Expects:
+ *         a and b not to overlap, size to be at most MAX_PIXEL
+ * Notes:
+ *         The usual pixel sizes each get a copy of known size, which the
+ *         compiler turns into a few loads and stores instead of calls to
+ *         memcpy
+ *
+ *****************************************************************************/
+static inline void swapPixels(char *a, char *b, size_t size)
+{
+        char tmp[MAX_PIXEL];
+        switch (size) {
+        case 4:
+                memcpy(tmp, a, 4);
+                memcpy(a, b, 4);
+                memcpy(b, tmp, 4);
+                break;
+        case 8:
+                memcpy(tmp, a, 8);
+                memcpy(a, b, 8);
+                memcpy(b, tmp, 8);
+                break;
+        case 12:
+                memcpy(tmp, a, 12);
+                memcpy(a, b, 12);
+                memcpy(b, tmp, 12);
+                break;
+        default:
+                memcpy(tmp, a, size);
+                memcpy(a, b, size);
+                memcpy(b, tmp, size);
+                break;
+        }
+}
+
+/**********************************swapBytes***********************************
+ *
+ * Swap two runs of bytes that do not overlap
+ * Inputs:
+ *         char *a: the first run
+ *         char *b: the second run
+ *         size_t n: the number of bytes in each run
+ * Return: none
+ * Expects:
+ *         a and b not to overlap
+ * Notes:
+ *         Long runs are swapped ROW_CHUNK bytes at a time, so a whole row
+ *         never has to be copied aside
+ *
+ *****************************************************************************/
+static inline void swapBytes(char *a, char *b, size_t n)
+{
+        char tmp[ROW_CHUNK];
+        while (n > 0) {
+                size_t chunk = n < ROW_CHUNK ? n : ROW_CHUNK;
+                memcpy(tmp, a, chunk);
+                memcpy(a, b, chunk);
+                memcpy(b, tmp, chunk);
+                a += chunk;
+                b += chunk;
+                n -= chunk;
+        }
+}
@@ -0,0 +1,27 @@
+
+/******************************************************************************
+ *
+ *                               inplace.h
+ *
+ *     Assignment: locality
+ *     Authors:    Marten Tropp and Matt Carey
+ *     Date:       10/10/2023
+ *
+ *     The purpose of this file is to declare the in-place transform used by
+ *     ppmtrans -in-place. It rotates, flips, or transposes an image by
+ *     moving pixels around inside the image's own memory, so no second
+ *     image has to be allocated for the result.
+ *
+ *****************************************************************************/
+
+#ifndef INPLACE_H
+#define INPLACE_H
+
+#include <stdbool.h>
+
+#include "kernels.h"
+
+void transformInPlace(PlainImage *image, bool transposes, bool flipsCols,
+                      bool flipsRows);
+
+#endif
@@ -0,0 +1,978 @@
+
+/******************************************************************************
+ *
+ *                               kernels.c
+ *
+ *     Assignment: locality
+ *     Authors:    Marten Tropp and Matt Carey
+ *     Date:       10/10/2023
+ *
+ *     The purpose of this file is to implement the transform kernels used by
+ *     ppmtrans -kernel. Rotating by 90 or 270 degrees and transposing across
+ *     either diagonal all turn columns of the original into rows of the
+ *     result, so they share one tiled kernel that fills each row of a tile
+ *     of the result from one column of the original, four rows at a time
+ *     from four columns. That is the only part that depends on the CPU: it
+ *     is done one pixel at a time, or with SSE2 or AVX2 by loading blocks
+ *     of pixels from rows of the original and transposing them in
+ *     registers, whichever selectKernels picked. Rotating by 180 degrees
+ *     and flipping keep rows as rows, and are plain loops over the rows.
+ *
+ *     With setKernelThreads(n), a kernel splits the result into n parts
+ *     and fills them on n threads. The parts are ranges of the result in
+ *     memory order. Each range starts on a cache line boundary, so no two
+ *     threads write the same cache line. setKernelThreads starts the
+ *     other n - 1 threads once, and they wait in a pool between kernel
+ *     calls; each call hands them their parts and waits until all are
+ *     filled.
+ *
+ *****************************************************************************/
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "assert.h"
+#include "mem.h"
+#include "pnm.h"
+#include "kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNELS_X86 1
+#endif
+
+/* Bytes in a pixel; the SIMD code moves pixels as three 4 byte words */
+#define PIXEL sizeof(struct Pnm_rgb)
+
+/* The result is filled TILE by TILE pixels at a time */
+#define TILE 32
+
+/* A transpose fills BLOCK rows of the result from BLOCK columns at once */
+#define BLOCK 4
+
+/* Threads never write the same CACHE_LINE bytes */
+#define CACHE_LINE 64
+
+/*
+ * A transpose function fills rows rows of the result, each rowStride bytes
+ * after the one before, with n consecutive pixels each. Row k comes from
+ * the column of the original whose first pixel is at src + k * colStep,
+ * and each pixel after that is step bytes further on. colStep is minus a
+ * pixel when the next row comes from the column to the left, and step is
+ * negative to walk up the columns.
+ */
+typedef void transposeFun(char *out, ptrdiff_t rowStride, const char *src,
+                          ptrdiff_t colStep, ptrdiff_t step, int rows, int n);
+
+static transposeFun transposeScalar;
+#ifdef KERNELS_X86
+static transposeFun transposeSSE2;
+static transposeFun transposeAVX2;
+#endif
+
+/* The transpose function picked by selectKernels */
+static transposeFun *transpose = transposeScalar;
+
+/* The number of threads picked by setKernelThreads */
+static int kernelThreads = 1;
+
+/*
+ * A transform to run: part fills the pixels of dst numbered begin up to
+ * end, counting across each row and then down
+ */
+struct job {
+        PlainImage dst;
+        PlainImage src;
+        bool reverseCols;
+        bool reverseRows;
+        void (*part)(const struct job *job, size_t begin, size_t end);
+};
+
+/* The pixels one thread fills */
+struct share {
+        const struct job *job;
+        size_t begin;
+        size_t end;
+};
+
+/*
+ * The threads that fill all but the first share of a job. Worker t (from 1)
+ * fills shares[t] of each round, if the round has that many shares, and
+ * each round ends when every worker is done with it.
+ */
+static struct {
+        pthread_mutex_t lock;
+        pthread_cond_t work;            /* a round starts, or stop is set */
+        pthread_cond_t done;            /* busy reaches 0 */
+        pthread_t ids[MAX_KERNEL_THREADS];
+        int workers;                    /* ids[1] to ids[workers] run */
+        unsigned long round;            /* rounds handed out so far */
+        unsigned long firstRound;       /* round when the workers started */
+        struct share *shares;           /* this round's shares */
+        int shareCount;
+        int busy;                       /* workers not done with the round */
+        bool stop;                      /* workers are to return */
+} pool = { .lock = PTHREAD_MUTEX_INITIALIZER,
+           .work = PTHREAD_COND_INITIALIZER,
+           .done = PTHREAD_COND_INITIALIZER };
+
+static void stopPool(void);
+static void *poolWorker(void *index);
+static void runJob(const struct job *job);
+static void runShare(struct share *share);
+static size_t lineBoundary(PlainImage image, size_t pixel, size_t total);
+static void transposeTiles(const struct job *job, size_t begin, size_t end);
+static void copyRows(const struct job *job, size_t begin, size_t end);
+static void gatherScalar(char *out, const char *src, ptrdiff_t step, int n);
+
+/*******************************selectKernels**********************************
+ *
+ * Pick the instructions the kernels use to turn columns into rows
+ * Inputs:
+ *         const char *isa: "scalar", "sse2", "avx2", or "auto" for the best
+ *         one this CPU has
+ * Return: true if isa names a variant this CPU can run, false otherwise
+ * Expects:
+ *         isa to be non-null
+ * Notes:
+ *         CRE if isa is NULL
+ *         The choice is kept until the next call
+ *
+ *****************************************************************************/
+bool selectKernels(const char *isa)
+{
+        assert(isa != NULL);
+        assert(PIXEL == 3 * sizeof(uint32_t));
+
+        if (strcmp(isa, "scalar") == 0) {
+                transpose = transposeScalar;
+                return true;
+        }
+#ifdef KERNELS_X86
+        __builtin_cpu_init();
+        bool hasSSE2 = __builtin_cpu_supports("sse2");
+        bool hasAVX2 = __builtin_cpu_supports("avx2");
+
+        if (strcmp(isa, "sse2") == 0 && hasSSE2) {
+                transpose = transposeSSE2;
+                return true;
+        }
+        if (strcmp(isa, "avx2") == 0 && hasAVX2) {
+                transpose = transposeAVX2;
+                return true;
+        }
+        if (strcmp(isa, "auto") == 0) {
+                transpose = hasAVX2 ? transposeAVX2
+                          : hasSSE2 ? transposeSSE2 : transposeScalar;
+                return true;
+        }
+#else
+        if (strcmp(isa, "auto") == 0) {
+                transpose = transposeScalar;
+                return true;
+        }
+#endif
+        return false;
+}
+
+/*****************************setKernelThreads*********************************
+ *
+ * Pick how many threads each kernel uses, and start them
+ * Inputs:
+ *         int threads: the number of threads
+ * Return: the number of threads the kernels will use, which is threads or
+ *         THREADS_PER_CPU for each online CPU, whichever is fewer
+ * Expects:
+ *         threads to be from 1 to MAX_KERNEL_THREADS
+ * Notes:
+ *         CRE if threads is out of that range
+ *         The threads of the last call are stopped, and all but one of
+ *         the new ones are started and wait in the pool until a kernel
+ *         runs. setKernelThreads(1) leaves no threads running. If a thread
+ *         cannot be started, the calling thread fills its share of each
+ *         kernel instead (see runJob).
+ *
+ *****************************************************************************/
+int setKernelThreads(int threads)
+{
+        assert(threads >= 1 && threads <= MAX_KERNEL_THREADS);
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cpus >= 1 && threads > cpus * THREADS_PER_CPU) {
+                threads = cpus * THREADS_PER_CPU;
+        }
+
+        stopPool();
+        kernelThreads = threads;
+        pool.firstRound = pool.round;
+        for (int t = 1; t < threads; t++) {
+                if (pthread_create(&pool.ids[t], NULL, poolWorker,
+                                   (void *) (intptr_t) t) != 0) {
+                        break;
+                }
+                pool.workers = t;
+        }
+        return threads;
+}
+
+/*******************************kernelRotate90*********************************
+ *
+ * Rotate an image 90 degrees clockwise
+ * Inputs:
+ *         PlainImage dst: where the result is written
+ *         PlainImage src: the image to rotate
+ * Return: none
+ * Expects:
+ *         dst to be src->height wide and src->width high, and not to overlap
+ *         src
+ * Notes:
+ *         Row y of the result is column y of the original, read bottom up
+ *
+ *****************************************************************************/
+void kernelRotate90(PlainImage dst, PlainImage src)
+{
+        assert(dst.width == src.height && dst.height == src.width
+               && dst.size == src.size);
+        struct job job = { dst, src, false, true, transposeTiles };
+        runJob(&job);
+}
+
+/*******************************kernelRotate270********************************
+ *
+ * Rotate an image 270 degrees clockwise
+ * Inputs:
+ *         PlainImage dst: where the result is written
+ *         PlainImage src: the image to rotate
+ * Return: none
+ * Expects:
+ *         dst to be src->height wide and src->width high, and not to overlap
+ *         src
+ * Notes:
+ *         Row y of the result is column width - y - 1 of the original, read
+ *         top down
+ *
+ *****************************************************************************/
+void kernelRotate270(PlainImage dst, PlainImage src)
+{
+        assert(dst.width == src.height && dst.height == src.width
+               && dst.size == src.size);
+        struct job job = { dst, src, true, false, transposeTiles };
+        runJob(&job);
+}
+
+/*******************************kernelTranspose********************************
+ *
+ * Transpose an image across its top left to bottom right diagonal
+ * Inputs:
+ *         PlainImage dst: where the result is written
+ *         PlainImage src: the image to transpose
+ * Return: none
+ * Expects:
+ *         dst to be src->height wide and src->width high, and not to overlap
+ *         src
+ * Notes:
+ *         Row y of the result is column y of the original, read top down
+ *
+ *****************************************************************************/
+void kernelTranspose(PlainImage dst, PlainImage src)
+{
+        assert(dst.width == src.height && dst.height == src.width
+               && dst.size == src.size);
+        struct job job = { dst, src, false, false, transposeTiles };
+        runJob(&job);
+}
+
+/*******************************kernelTransverse*******************************
+ *
+ * Transpose an image across its top right to bottom left diagonal
+ * Inputs:
+ *         PlainImage dst: where the result is written
+ *         PlainImage src: the image to transpose
+ * Return: none
+ * Expects:
+ *         dst to be src->height wide and src->width high, and not to overlap
+ *         src
+ * Notes:
+ *         Row y of the result is column width - y - 1 of the original, read
+ *         bottom up. This is a transpose followed by a rotation by 180
+ *         degrees, done in one pass
+ *
+ *****************************************************************************/
+void kernelTransverse(PlainImage dst, PlainImage src)
+{
+        assert(dst.width == src.height && dst.height == src.width
+               && dst.size == src.size);
+        struct job job = { dst, src, true, true, transposeTiles };
+        runJob(&job);
+}
+
+/*******************************kernelRotate180********************************
+ *
+ * Rotate an image 180 degrees
+ * Inputs:
+ *         PlainImage dst: where the result is written
+ *         PlainImage src: the image to rotate
+ * Return: none
+ * Expects:
+ *         dst to be the same size as src, and not to overlap src
+ * Notes:
+ *         Row y of the result is row height - y - 1 of the original, back
+ *         to front
+ *
+ *****************************************************************************/
+void kernelRotate180(PlainImage dst, PlainImage src)
+{
+        assert(dst.width == src.width && dst.height == src.height
+               && dst.size == src.size);
+        struct job job = { dst, src, true, true, copyRows };
+        runJob(&job);
+}
+
+/****************************kernelFlipHorizontal******************************
+ *
+ * Flip an image left to right
+ * Inputs:
+ *         PlainImage dst: where the result is written
+ *         PlainImage src: the image to flip
+ * Return: none
+ * Expects:
+ *         dst to be the same size as src, and not to overlap src
+ * Notes:
+ *         Row y of the result is row y of the original, back to front
+ *
+ *****************************************************************************/
+void kernelFlipHorizontal(PlainImage dst, PlainImage src)
+{
+        assert(dst.width == src.width && dst.height == src.height
+               && dst.size == src.size);
+        struct job job = { dst, src, true, false, copyRows };
+        runJob(&job);
+}
+
+/*****************************kernelFlipVertical*******************************
+ *
+ * Flip an image top to bottom
+ * Inputs:
+ *         PlainImage dst: where the result is written
+ *         PlainImage src: the image to flip
+ * Return: none
+ * Expects:
+ *         dst to be the same size as src, and not to overlap src
+ * Notes:
+ *         Row y of the result is a copy of row height - y - 1 of the original
+ *
+ *****************************************************************************/
+void kernelFlipVertical(PlainImage dst, PlainImage src)
+{
+        assert(dst.width == src.width && dst.height == src.height
+               && dst.size == src.size);
+        struct job job = { dst, src, false, true, copyRows };
+        runJob(&job);
+}
+
+/***********************************runJob*************************************
+ *
+ * Fill the result of a transform, on as many threads as setKernelThreads
+ * picked
+ * Inputs:
+ *         const struct job *job: the transform
+ * Return: none
+ * Expects:
+ *         the pixels to be struct Pnm_rgb
+ * Notes:
+ *         CRE if the pixels are another size
+ *         No more threads are used than the result has rows. The pixels of
+ *         the result are split into one range per thread, of about the
+ *         same size, moved on to start on a cache line. The workers in the
+ *         pool fill all but the first range, and this thread fills the
+ *         first one, and those of any workers that could not be started.
+ *         Returns once every range is filled.
+ *
+ *****************************************************************************/
+static void runJob(const struct job *job)
+{
+        assert(job->dst.size == PIXEL);
+        size_t total = (size_t) job->dst.width * job->dst.height;
+        int threads = kernelThreads;
+        if (threads > job->dst.height) {
+                threads = job->dst.height;
+        }
+        if (threads <= 1 || total == 0) {
+                job->part(job, 0, total);
+                return;
+        }
+
+        struct share *shares = CALLOC(threads, sizeof(*shares));
+        size_t begin = 0;
+        for (int t = 0; t < threads; t++) {
+                size_t end = total;
+                if (t + 1 < threads) {
+                        end = lineBoundary(job->dst, total / threads * (t + 1),
+                                           total);
+                }
+                if (end < begin) {
+                        end = begin;
+                }
+                shares[t] = (struct share) { job, begin, end };
+                begin = end;
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        pool.shares = shares;
+        pool.shareCount = threads;
+        pool.busy = pool.workers;
+        pool.round++;
+        pthread_cond_broadcast(&pool.work);
+        pthread_mutex_unlock(&pool.lock);
+
+        runShare(&shares[0]);
+        for (int t = pool.workers + 1; t < threads; t++) {
+                runShare(&shares[t]);
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        while (pool.busy > 0) {
+                pthread_cond_wait(&pool.done, &pool.lock);
+        }
+        pool.shares = NULL;
+        pthread_mutex_unlock(&pool.lock);
+        FREE(shares);
+}
+
+/**********************************runShare************************************
+ *
+ * Fill one thread's range of the result
+ * Inputs:
+ *         struct share *share: the range to fill
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         none
+ *
+ *****************************************************************************/
+static void runShare(struct share *share)
+{
+        share->job->part(share->job, share->begin, share->end);
+}
+
+/*********************************poolWorker***********************************
+ *
+ * Fill shares of the pool's rounds until the pool is stopped
+ * Inputs:
+ *         void *index: the worker's number, from 1, as an intptr_t
+ * Return: NULL
+ * Expects:
+ *         none
+ * Notes:
+ *         Has the type pthread_create wants. The worker counts itself
+ *         done with every round, even one with no share for it, so runJob
+ *         can wait for busy to reach 0.
+ *
+ *****************************************************************************/
+static void *poolWorker(void *index)
+{
+        int me = (int) (intptr_t) index;
+
+        pthread_mutex_lock(&pool.lock);
+        unsigned long seen = pool.firstRound;
+        for (;;) {
+                while (!pool.stop && pool.round == seen) {
+                        pthread_cond_wait(&pool.work, &pool.lock);
+                }
+                if (pool.stop) {
+                        break;
+                }
+                seen = pool.round;
+                if (me < pool.shareCount) {
+                        struct share *mine = &pool.shares[me];
+                        pthread_mutex_unlock(&pool.lock);
+                        runShare(mine);
+                        pthread_mutex_lock(&pool.lock);
+                }
+                pool.busy--;
+                if (pool.busy == 0) {
+                        pthread_cond_signal(&pool.done);
+                }
+        }
+        pthread_mutex_unlock(&pool.lock);
+        return NULL;
+}
+
+/**********************************stopPool************************************
+ *
+ * Stop and join the pool's workers
+ * Inputs:
+ *         none
+ * Return: none
+ * Expects:
+ *         no kernel to be running
+ * Notes:
+ *         The pool is empty afterward, and can be started again
+ *
+ *****************************************************************************/
+static void stopPool(void)
+{
+        pthread_mutex_lock(&pool.lock);
+        pool.stop = true;
+        pthread_cond_broadcast(&pool.work);
+        pthread_mutex_unlock(&pool.lock);
+
+        for (int t = 1; t <= pool.workers; t++) {
+                pthread_join(pool.ids[t], NULL);
+        }
+        pool.workers = 0;
+        pool.stop = false;
+}
+
+/*********************************lineBoundary*********************************
+ *
+ * Find the first pixel at or after a given one that starts on a cache line
+ * Inputs:
+ *         PlainImage image: the image the pixels are in
+ *         size_t pixel: the pixel to start from, counting across each row
+ *                       and then down
+ *         size_t total: the number of pixels in the image
+ * Return: the first such pixel, or total if there is none
+ * Expects:
+ *         none
+ * Notes:
+ *         With rows that have no gaps between them, one pixel in 16 starts
+ *         on a cache line
+ *
+ *****************************************************************************/
+static size_t lineBoundary(PlainImage image, size_t pixel, size_t total)
+{
+        for (; pixel < total; pixel++) {
+                const char *p = image.pixels 
+                                + pixel / image.width * image.stride
+                                + pixel % image.width * image.size;
+                if ((uintptr_t) p % CACHE_LINE == 0) {
+                        break;
+                }
+        }
+        return pixel;
+}
+
+/*******************************transposeTiles*********************************
+ *
+ * Fill part of the result of a rotation by 90 or 270 degrees or a
+ * transpose, one TILE by TILE tile at a time
+ * Inputs:
+ *         const struct job *job: the transform. Row y of the result comes 
+ *                      from column width - y - 1 of the original if 
+ *                      reverseCols is set and column y if not, read bottom
+ *                      up if reverseRows is set and top down if not
+ *         size_t begin: the first pixel of the result to fill
+ *         size_t end: one past the last pixel of the result to fill
+ * Return: none
+ * Expects:
+ *         dst to be src->height wide and src->width high
+ * Notes:
+ *         A tile of the result reads a TILE by TILE square of the original,
+ *         so both stay in the cache while the tile is filled. Only the 
+ *         pixels of each tile from begin up to end are filled. The rows of
+ *         a tile are filled BLOCK at a time, except where fewer are left or
+ *         the range cuts one of them.
+ *
+ *****************************************************************************/
+static void transposeTiles(const struct job *job, size_t begin, size_t end)
+{
+        PlainImage dst = job->dst;
+        PlainImage src = job->src;
+        if (begin >= end) {
+                return;
+        }
+        int yFirst = begin / dst.width;
+        int yLast = (end - 1) / dst.width;
+        ptrdiff_t step = job->reverseRows ? -(ptrdiff_t) src.stride
+                                          : (ptrdiff_t) src.stride;
+        ptrdiff_t colStep = job->reverseCols ? -(ptrdiff_t) src.size
+                                             : (ptrdiff_t) src.size;
+
+        for (int y0 = yFirst - yFirst % TILE; y0 <= yLast; y0 += TILE) {
+                int yStart = y0 > yFirst ? y0 : yFirst;
+                int yEnd = y0 + TILE - 1 < yLast ? y0 + TILE - 1 : yLast;
+
+                for (int x0 = 0; x0 < dst.width; x0 += TILE) {
+                        int xEnd = x0 + TILE < dst.width ? x0 + TILE 
+                                                         : dst.width;
+                        int rows = 1;
+                        for (int y = yStart; y <= yEnd; y += rows) {
+                                /* BLOCK rows at once if the range cuts none */
+                                size_t rowStart = (size_t) y * dst.width;
+                                size_t blockEnd = rowStart + xEnd 
+                                        + (size_t) (BLOCK - 1) * dst.width;
+                                rows = y + BLOCK - 1 <= yEnd
+                                       && rowStart + x0 >= begin
+                                       && blockEnd <= end ? BLOCK : 1;
+
+                                /* this row of the tile, cut to the range */
+                                int lo = x0;
+                                int hi = xEnd;
+                                if (rowStart + lo < begin) {
+                                        lo = begin - rowStart;
+                                }
+                                if (rowStart + hi > end) {
+                                        hi = end - rowStart;
+                                }
+                                if (lo >= hi) {
+                                        continue;
+                                }
+
+                                int col = job->reverseCols ? src.width - y - 1
+                                                           : y;
+                                int row = job->reverseRows ? src.height - lo - 1
+                                                           : lo;
+                                transpose(dst.pixels + y * dst.stride 
+                                          + lo * dst.size, dst.stride,
+                                          src.pixels + row * src.stride
+                                          + col * src.size,
+                                          colStep, step, rows, hi - lo);
+                        }
+                }
+        }
+}
+
+/**********************************copyRows************************************
+ *
+ * Fill part of the result of a rotation by 180 degrees or a flip
+ * Inputs:
+ *         const struct job *job: the transform. Row y of the result comes 
+ *                      from row height - y - 1 of the original if 
+ *                      reverseRows is set and row y if not, back to front
+ *                      if reverseCols is set and front to back if not
+ *         size_t begin: the first pixel of the result to fill
+ *         size_t end: one past the last pixel of the result to fill
+ * Return: none
+ * Expects:
+ *         dst to be the same size as src
+ * Notes:
+ *         Rows read front to back are copied with memcpy
+ *
+ *****************************************************************************/
+static void copyRows(const struct job *job, size_t begin, size_t end)
+{
+        PlainImage dst = job->dst;
+        PlainImage src = job->src;
+
+        while (begin < end) {
+                /* the rest of this row, cut to the range */
+                int y = begin / dst.width;
+                int lo = begin % dst.width;
+                int hi = end - (size_t) y * dst.width < (size_t) dst.width 
+                         ? (int) (end - (size_t) y * dst.width) : dst.width;
+
+                char *out = dst.pixels + y * dst.stride + lo * dst.size;
+                const char *in = src.pixels + (job->reverseRows 
+                                               ? src.height - y - 1 : y)
+                                              * src.stride;
+                if (job->reverseCols) {
+                        gatherScalar(out, in + (src.width - lo - 1) * PIXEL,
+                                     -(ptrdiff_t) PIXEL, hi - lo);
+                } else {
+                        memcpy(out, in + lo * src.size, (hi - lo) * src.size);
+                }
+                begin = (size_t) y * dst.width + hi;
+        }
+}
+
+/*******************************gatherScalar*********************************
+ *
+ * Copy n 12 byte pixels, step bytes apart, into consecutive pixels one at a
+ * time
+ * Inputs:
+ *         char *out: where the first pixel is copied to
+ *         const char *src: the first pixel copied
+ *         ptrdiff_t step: bytes from one pixel copied to the next
+ *         int n: the number of pixels copied
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         none
+ *
+ *****************************************************************************/
+static void gatherScalar(char *out, const char *src, ptrdiff_t step, int n)
+{
+        for (int i = 0; i < n; i++) {
+                memcpy(out, src, PIXEL);
+                out += PIXEL;
+                src += step;
+        }
+}
+
+/*****************************transposeScalar*********************************
+ *
+ * Fill rows of the result from columns of the original, one pixel at a time
+ * Inputs:
+ *         char *out: the first pixel filled in the first row
+ *         ptrdiff_t rowStride: bytes from one row of the result to the next
+ *         const char *src: the first pixel of the first column copied
+ *         ptrdiff_t colStep: bytes from one column copied to the next
+ *         ptrdiff_t step: bytes from one pixel of a column to the next
+ *         int rows: the number of rows filled
+ *         int n: the number of pixels filled in each row
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         none
+ *
+ *****************************************************************************/
+static void transposeScalar(char *out, ptrdiff_t rowStride, const char *src,
+                            ptrdiff_t colStep, ptrdiff_t step, int rows, int n)
+{
+        for (int k = 0; k < rows; k++) {
+                gatherScalar(out + k * rowStride, src + k * colStep, step, n);
+        }
+}
+
+#ifdef KERNELS_X86
+/*********************************splitPixels**********************************
+ *
+ * Load four pixels in a row into four registers, one pixel each
+ * Inputs:
+ *         const char *p: the first of the four pixels
+ *         __m128 pixel[]: the four registers
+ * Return: none (pixel[j] holds pixel j's red, green, and blue in lanes 0 to
+ *         2; what lane 3 holds is unspecified)
+ * Expects:
+ *         none
+ * Notes:
+ *         The 48 bytes of the pixels are three loads, never past the last
+ *         pixel, and three shuffles and a shift split them.
+ *
+ *****************************************************************************/
+__attribute__((target("sse2")))
+static inline void splitPixels(const char *p, __m128 pixel[BLOCK])
+{
+        /* a0 a1 a2 b0 | b1 b2 c0 c1 | c2 d0 d1 d2 */
+        __m128 x = _mm_loadu_ps((const float *) p);
+        __m128 y = _mm_loadu_ps((const float *) (p + 16));
+        __m128 z = _mm_loadu_ps((const float *) (p + 32));
+
+        __m128 b0b1 = _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 3, 3));
+        pixel[0] = x;
+        pixel[1] = _mm_shuffle_ps(b0b1, y, _MM_SHUFFLE(1, 1, 2, 0));
+        pixel[2] = _mm_shuffle_ps(y, z, _MM_SHUFFLE(0, 0, 3, 2));
+        pixel[3] = _mm_castsi128_ps(_mm_srli_si128(_mm_castps_si128(z), 4));
+}
+
+/*********************************joinPixels***********************************
+ *
+ * Store four registers holding one pixel each as four pixels in a row
+ * Inputs:
+ *         char *out: where the first of the four pixels is stored
+ *         __m128 a, b, c, d: the pixels, in lanes 0 to 2 of each
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         The inverse of splitPixels: four shuffles make the three
+ *         registers written out.
+ *
+ *****************************************************************************/
+__attribute__((target("sse2")))
+static inline void joinPixels(char *out, __m128 a, __m128 b, __m128 c, 
+                              __m128 d)
+{
+        /* a0 a1 a2 b0 | b1 b2 c0 c1 | c2 d0 d1 d2 */
+        __m128 ab = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 2, 2));
+        __m128 cd = _mm_shuffle_ps(c, d, _MM_SHUFFLE(0, 0, 2, 2));
+        _mm_storeu_ps((float *) out,
+                      _mm_shuffle_ps(a, ab, _MM_SHUFFLE(2, 0, 1, 0)));
+        _mm_storeu_ps((float *) (out + 16),
+                      _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 2, 1)));
+        _mm_storeu_ps((float *) (out + 32),
+                      _mm_shuffle_ps(cd, d, _MM_SHUFFLE(2, 1, 2, 0)));
+}
+
+/******************************transposeSSE2**********************************
+ *
+ * Fill rows of the result from columns of the original, transposing four
+ * by four blocks of pixels in registers, two at a time
+ * Inputs:
+ *         char *out: the first pixel filled in the first row
+ *         ptrdiff_t rowStride: bytes from one row of the result to the next
+ *         const char *src: the first pixel of the first column copied
+ *         ptrdiff_t colStep: bytes from one column copied to the next
+ *         ptrdiff_t step: bytes from one pixel of a column to the next
+ *         int rows: the number of rows filled
+ *         int n: the number of pixels filled in each row
+ * Return: none
+ * Expects:
+ *         colStep to be one pixel either way
+ * Notes:
+ *         A block reads four pixels from each of four rows of the original
+ *         with splitPixels and writes four pixels to each of four rows of
+ *         the result with joinPixels. Each step does two blocks, loading
+ *         eight rows of the original before storing anything, which keeps
+ *         more of the misses on those rows going at once. Fewer than BLOCK
+ *         rows, and fewer than eight pixels left over, go to
+ *         transposeScalar.
+ *
+ *****************************************************************************/
+__attribute__((target("sse2")))
+static void transposeSSE2(char *out, ptrdiff_t rowStride, const char *src,
+                          ptrdiff_t colStep, ptrdiff_t step, int rows, int n)
+{
+        if (rows < BLOCK) {
+                transposeScalar(out, rowStride, src, colStep, step, rows, n);
+                return;
+        }
+
+        /* column j from the left of the block fills row j of the result,
+           or row BLOCK - 1 - j when the columns are taken right to left */
+        ptrdiff_t left = colStep < 0 ? (BLOCK - 1) * colStep : 0;
+        ptrdiff_t outStep = colStep < 0 ? -rowStride : rowStride;
+        ptrdiff_t first = colStep < 0 ? (BLOCK - 1) * rowStride : 0;
+        int i = 0;
+        for (; i + 2 * BLOCK <= n; i += 2 * BLOCK) {
+                /* a[j] to h[j]: pixel j from the left in rows 0 to 7 */
+                const char *p = src + left;
+                __m128 a[BLOCK], b[BLOCK], c[BLOCK], d[BLOCK];
+                __m128 e[BLOCK], f[BLOCK], g[BLOCK], h[BLOCK];
+                splitPixels(p, a);
+                splitPixels(p + step, b);
+                splitPixels(p + 2 * step, c);
+                splitPixels(p + 3 * step, d);
+                splitPixels(p + 4 * step, e);
+                splitPixels(p + 5 * step, f);
+                splitPixels(p + 6 * step, g);
+                splitPixels(p + 7 * step, h);
+
+                char *row = out + first;
+                joinPixels(row, a[0], b[0], c[0], d[0]);
+                joinPixels(row + 4 * PIXEL, e[0], f[0], g[0], h[0]);
+                row += outStep;
+                joinPixels(row, a[1], b[1], c[1], d[1]);
+                joinPixels(row + 4 * PIXEL, e[1], f[1], g[1], h[1]);
+                row += outStep;
+                joinPixels(row, a[2], b[2], c[2], d[2]);
+                joinPixels(row + 4 * PIXEL, e[2], f[2], g[2], h[2]);
+                row += outStep;
+                joinPixels(row, a[3], b[3], c[3], d[3]);
+                joinPixels(row + 4 * PIXEL, e[3], f[3], g[3], h[3]);
+                out += 2 * BLOCK * PIXEL;
+                src += 2 * BLOCK * step;
+        }
+        transposeScalar(out, rowStride, src, colStep, step, rows, n - i);
+}
+
+/********************************splitPixels2**********************************
+ *
+ * splitPixels for two rows at once, one in each 128 bit lane
+ * Inputs:
+ *         const char *low: the first of four pixels for the low lanes
+ *         const char *high: the first of four pixels for the high lanes
+ *         __m256 pixel[]: the four registers
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         AVX2 shuffles and shifts each lane on its own, so the steps are
+ *         those of splitPixels.
+ *
+ *****************************************************************************/
+__attribute__((target("avx2")))
+static inline void splitPixels2(const char *low, const char *high,
+                                __m256 pixel[BLOCK])
+{
+        __m256 x = _mm256_loadu2_m128((const float *) high,
+                                      (const float *) low);
+        __m256 y = _mm256_loadu2_m128((const float *) (high + 16),
+                                      (const float *) (low + 16));
+        __m256 z = _mm256_loadu2_m128((const float *) (high + 32),
+                                      (const float *) (low + 32));
+
+        __m256 b0b1 = _mm256_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 3, 3));
+        pixel[0] = x;
+        pixel[1] = _mm256_shuffle_ps(b0b1, y, _MM_SHUFFLE(1, 1, 2, 0));
+        pixel[2] = _mm256_shuffle_ps(y, z, _MM_SHUFFLE(0, 0, 3, 2));
+        pixel[3] = _mm256_castsi256_ps(
+                        _mm256_srli_si256(_mm256_castps_si256(z), 4));
+}
+
+/********************************joinPixels2***********************************
+ *
+ * Store four registers holding two pixels each, one per 128 bit lane, as
+ * eight pixels in a row: the four low lanes first, then the four high ones
+ * Inputs:
+ *         char *out: where the first of the eight pixels is stored
+ *         __m256 a, b, c, d: the pixels, in words 0 to 2 of each lane
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         The shuffles of joinPixels pack each lane; three lane permutes
+ *         then put the low lanes' 48 bytes before the high lanes'.
+ *
+ *****************************************************************************/
+__attribute__((target("avx2")))
+static inline void joinPixels2(char *out, __m256 a, __m256 b, __m256 c,
+                               __m256 d)
+{
+        __m256 ab = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 2, 2));
+        __m256 cd = _mm256_shuffle_ps(c, d, _MM_SHUFFLE(0, 0, 2, 2));
+        __m256 first = _mm256_shuffle_ps(a, ab, _MM_SHUFFLE(2, 0, 1, 0));
+        __m256 second = _mm256_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 2, 1));
+        __m256 third = _mm256_shuffle_ps(cd, d, _MM_SHUFFLE(2, 1, 2, 0));
+
+        _mm256_storeu_ps((float *) out,
+                         _mm256_permute2f128_ps(first, second, 0x20));
+        _mm256_storeu_ps((float *) (out + 32),
+                         _mm256_permute2f128_ps(third, first, 0x30));
+        _mm256_storeu_ps((float *) (out + 64),
+                         _mm256_permute2f128_ps(second, third, 0x31));
+}
+
+/******************************transposeAVX2**********************************
+ *
+ * Fill rows of the result from columns of the original, transposing four
+ * by eight blocks of pixels in registers
+ * Inputs:
+ *         char *out: the first pixel filled in the first row
+ *         ptrdiff_t rowStride: bytes from one row of the result to the next
+ *         const char *src: the first pixel of the first column copied
+ *         ptrdiff_t colStep: bytes from one column copied to the next
+ *         ptrdiff_t step: bytes from one pixel of a column to the next
+ *         int rows: the number of rows filled
+ *         int n: the number of pixels filled in each row
+ * Return: none
+ * Expects:
+ *         colStep to be one pixel either way
+ * Notes:
+ *         The same as transposeSSE2, with rows r and r + 4 of the original
+ *         in the two lanes, so each block fills eight pixels of each of
+ *         four rows. What is left over goes to transposeSSE2.
+ *
+ *****************************************************************************/
+__attribute__((target("avx2")))
+static void transposeAVX2(char *out, ptrdiff_t rowStride, const char *src,
+                          ptrdiff_t colStep, ptrdiff_t step, int rows, int n)
+{
+        ptrdiff_t left = colStep < 0 ? (BLOCK - 1) * colStep : 0;
+        ptrdiff_t outStep = colStep < 0 ? -rowStride : rowStride;
+        ptrdiff_t first = colStep < 0 ? (BLOCK - 1) * rowStride : 0;
+        int i = 0;
+        for (; rows == BLOCK && i + 2 * BLOCK <= n; i += 2 * BLOCK) {
+                const char *p = src + left;
+                __m256 a[BLOCK], b[BLOCK], c[BLOCK], d[BLOCK];
+                splitPixels2(p, p + 4 * step, a);
+                splitPixels2(p + step, p + 5 * step, b);
+                splitPixels2(p + 2 * step, p + 6 * step, c);
+                splitPixels2(p + 3 * step, p + 7 * step, d);
+
+                char *row = out + first;
+                joinPixels2(row, a[0], b[0], c[0], d[0]);
+                joinPixels2(row + outStep, a[1], b[1], c[1], d[1]);
+                joinPixels2(row + 2 * outStep, a[2], b[2], c[2], d[2]);
+                joinPixels2(row + 3 * outStep, a[3], b[3], c[3], d[3]);
+                out += 2 * BLOCK * PIXEL;
+                src += 2 * BLOCK * step;
+        }
+        transposeSSE2(out, rowStride, src, colStep, step, rows, n - i);
+}
+
+#endif
@@ -0,0 +1,55 @@
+
+/******************************************************************************
+ *
+ *                               kernels.h
+ *
+ *     Assignment: locality
+ *     Authors:    Marten Tropp and Matt Carey
+ *     Date:       10/10/2023
+ *
+ *     The purpose of this file is to declare the transform kernels used by
+ *     ppmtrans -kernel. Each kernel rotates, flips, or transposes a whole
+ *     image by reading and writing pixel memory directly, instead of calling
+ *     an apply function and methods->at for every pixel. The kernels that
+ *     turn rows into columns copy small tiles at a time, with SSE2 or AVX2
+ *     when the CPU has them, and the result can be filled on several
+ *     threads at once.
+ *
+ *****************************************************************************/
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * An image stored row by row: pixel (col, row) is at
+ * pixels + row * stride + col * size. The kernels take only struct Pnm_rgb
+ * pixels.
+ */
+typedef struct PlainImage {
+        char *pixels;
+        size_t stride;
+        size_t size;
+        int width;
+        int height;
+} PlainImage;
+
+/* The most threads setKernelThreads accepts */
+#define MAX_KERNEL_THREADS 256
+
+/* The kernels run at most THREADS_PER_CPU threads for each online CPU */
+#define THREADS_PER_CPU 4
+
+bool selectKernels(const char *isa);
+int setKernelThreads(int threads);
+void kernelRotate90(PlainImage dst, PlainImage src);
+void kernelRotate180(PlainImage dst, PlainImage src);
+void kernelRotate270(PlainImage dst, PlainImage src);
+void kernelFlipHorizontal(PlainImage dst, PlainImage src);
+void kernelFlipVertical(PlainImage dst, PlainImage src);
+void kernelTranspose(PlainImage dst, PlainImage src);
+void kernelTransverse(PlainImage dst, PlainImage src);
+
+#endif
@@ -0,0 +1,138 @@
+/******************************************************************************
+ *
+ *                              kerneltest.c
+ *
+ *     Assignment: locality
+ *     Authors:    Marten Tropp and Matt Carey
+ *     Date:       10/10/2023
+ *
+ *     The purpose of this file is to test the transform kernels. Every
+ *     kernel is run one pixel at a time, and with each SIMD variant the CPU
+ *     has, on one thread and on several. Every pixel of every result must
+ *     be the pixel of the original that the transform maps to it, worked
+ *     out here from coordinates rather than by any kernel.
+ *
+ *****************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assert.h"
+#include "mem.h"
+#include "pnm.h"
+#include "kernels.h"
+
+#define PIXEL sizeof(struct Pnm_rgb)
+
+typedef void Kernel(PlainImage dst, PlainImage src);
+
+static Kernel *const kernels[] = {
+        kernelRotate90, kernelRotate180, kernelRotate270,
+        kernelFlipHorizontal, kernelFlipVertical, kernelTranspose,
+        kernelTransverse
+};
+/* whether each kernel swaps the width and height */
+static const bool turns[] = { true, false, true, false, false, true, true };
+
+#define KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static const char *const isas[] = { "scalar", "sse2", "avx2" };
+
+/* odd sizes leave partial tiles and SIMD tails on every edge */
+static const int sizes[][2] = { { 1, 1 }, { 1, 9 }, { 9, 1 }, { 5, 3 },
+                                { 33, 65 }, { 67, 129 }, { 300, 7 } };
+
+static PlainImage newImage(int width, int height)
+{
+        PlainImage image = { NULL, width * PIXEL, PIXEL, width, height };
+        image.pixels = CALLOC((long) width * height + 1, PIXEL);
+        return image;
+}
+
+static PlainImage randomImage(int width, int height)
+{
+        PlainImage image = newImage(width, height);
+        for (int y = 0; y < height; y++) {
+                struct Pnm_rgb *row = (struct Pnm_rgb *)
+                                      (image.pixels + y * image.stride);
+                for (int x = 0; x < width; x++) {
+                        row[x].red = rand();
+                        row[x].green = rand();
+                        row[x].blue = rand();
+                }
+        }
+        return image;
+}
+
+/* the pixel of an image w wide and h high that kernel k moves to (x, y) */
+static void sourceOf(size_t k, int w, int h, int x, int y, int *sx, int *sy)
+{
+        switch (k) {
+        case 0: *sx = y;         *sy = h - x - 1; break;  /* rotate 90 */
+        case 1: *sx = w - x - 1; *sy = h - y - 1; break;  /* rotate 180 */
+        case 2: *sx = w - y - 1; *sy = x;         break;  /* rotate 270 */
+        case 3: *sx = w - x - 1; *sy = y;         break;  /* horizontal */
+        case 4: *sx = x;         *sy = h - y - 1; break;  /* vertical */
+        case 5: *sx = y;         *sy = x;         break;  /* transpose */
+        default: *sx = w - y - 1; *sy = h - x - 1; break; /* transverse */
+        }
+}
+
+/* every variant of one kernel must put every pixel where sourceOf says */
+static void checkKernel(size_t k, PlainImage src)
+{
+        int width = turns[k] ? src.height : src.width;
+        int height = turns[k] ? src.width : src.height;
+        size_t bytes = (size_t) width * height * PIXEL;
+        PlainImage expected = newImage(width, height);
+        PlainImage result = newImage(width, height);
+
+        for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                        int sx, sy;
+                        sourceOf(k, src.width, src.height, x, y, &sx, &sy);
+                        memcpy(expected.pixels + y * expected.stride
+                               + x * PIXEL,
+                               src.pixels + sy * src.stride + sx * PIXEL,
+                               PIXEL);
+                }
+        }
+
+        for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); i++) {
+                if (!selectKernels(isas[i])) {
+                        continue;       /* not on this CPU */
+                }
+                for (int threads = 1; threads <= 3; threads += 2) {
+                        setKernelThreads(threads);
+                        memset(result.pixels, 0, bytes);
+                        kernels[k](result, src);
+                        assert(memcmp(result.pixels, expected.pixels,
+                                      bytes) == 0);
+                }
+        }
+
+        FREE(result.pixels);
+        FREE(expected.pixels);
+}
+
+int main(int argc, char *argv[])
+{
+        assert(argc == 1);
+        (void)argv;
+
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+                PlainImage src = randomImage(sizes[s][0], sizes[s][1]);
+                for (size_t k = 0; k < KERNELS; k++) {
+                        checkKernel(k, src);
+                }
+                FREE(src.pixels);
+        }
+        setKernelThreads(1);    /* stop the pool's threads */
+
+        printf("Passed.\n");  /* only if we reach this point without
+                               * assertion failure
+                               */
+        return 0;
+}
@@ -20,31 +20,68 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <time.h>
+#include <sys/resource.h>
 
 #include "assert.h"
 #include "a2methods.h"
 #include "a2plain.h"
 #include "a2blocked.h"
+#include "uarray2.h"
 #include "pnm.h"
 #include "mem.h"
 #include "cputiming.h"
+#include "kernels.h"
+#include "inplace.h"
 
+/*
+ * One of the eight ways to rotate and flip an image, the dihedral group of
+ * the rectangle: pixel (col, row) of the original moves to (row, col) if
+ * transposes is set, and what that gives is then flipped horizontally if
+ * flipsCols is set and vertically if flipsRows is set
+ */
+typedef struct Transform {
+        bool transposes;
+        bool flipsCols;
+        bool flipsRows;
+} Transform;
+
+Transform composeTransforms(Transform first, Transform then);
+Transform rotationTransform(int rotation);
+void reduceTransform(Transform transform, int *rotation, char **flip_type,
+                     bool *transp, bool *transv);
 Pnm_ppm Pnm_ppm_new(unsigned width, unsigned height, 
                     unsigned denominator, A2Methods_T methods);
 FILE *openForReading(char filename[]);
-Pnm_ppm rotate(Pnm_ppm image, A2Methods_T methods, 
+Pnm_ppm rotate(Pnm_ppm image, A2Methods_T methods, A2Methods_mapfun *map,
                char time_file[], int rotation);
-Pnm_ppm flip(Pnm_ppm image, A2Methods_T methods, 
+Pnm_ppm flip(Pnm_ppm image, A2Methods_T methods, A2Methods_mapfun *map,
              char time_file[], char *flip_type);
-Pnm_ppm transpose(Pnm_ppm image, A2Methods_T methods, char time_file[]);
+Pnm_ppm transpose(Pnm_ppm image, A2Methods_T methods, A2Methods_mapfun *map,
+                  char time_file[], bool transv);
+Pnm_ppm applyKernel(Pnm_ppm image, A2Methods_T methods, char time_file[],
+                    int rotation, char *flip_type, bool transp, bool transv,
+                    int threads);
+void runKernel(PlainImage dst, PlainImage src, int rotation, 
+               char *flip_type, bool transp, bool transv);
+void applyInPlace(Pnm_ppm image, char time_file[], Transform transform);
+PlainImage plainImage(Pnm_ppm image);
 void helper90(int col, int row, A2Methods_UArray2 arr, void *elem, void *cl);
 void helper180(int col, int row, A2Methods_UArray2 arr, void *elem, void *cl);
 void helper270(int col, int row, A2Methods_UArray2 arr, void *elem, void *cl);
 void helperHori(int col, int row, A2Methods_UArray2 arr, void *elem, void *cl);
 void helperVert(int col, int row, A2Methods_UArray2 arr, void *elem, void *cl);
 void helperTran(int col, int row, A2Methods_UArray2 arr, void *elem, void *cl);
+void helperTranv(int col, int row, A2Methods_UArray2 arr, void *elem, void *cl);
+typedef void UArray2_applyfun(int col, int row, UArray2_T array2, void *elem,
+                              void *cl);
+void mapCacheOblivious(A2Methods_UArray2 array2, A2Methods_applyfun apply,
+                       void *cl);
 CPUTime_T startTimer(char *time_file);
 void stopTimer(char *time_file, CPUTime_T timer);
+struct timespec startWallTimer(void);
+void stopWallTimer(char *time_file, struct timespec start);
+void reportPeakRss(char *rss_file);
 
 #define SET_METHODS(METHODS, MAP, WHAT) do {                    \
         methods = (METHODS);                                    \
@@ -62,8 +99,12 @@ static void
 usage(const char *progname)
 {
         fprintf(stderr, "Usage: %s "
-                "[{-rotate <angle>,-flip <{vertical,horizontal}>,-transpose}]"
-                        "[-{row,col,block}-major] [filename]\n",
+                "[{-rotate <angle>,-flip <{vertical,horizontal}>,-transpose}"
+                        "...]"
+                        "[-{row,col,block}-major,-cache-oblivious,"
+                        "-kernel <{auto,scalar,sse2,avx2}>] "
+                        "[-threads <n>] [-in-place] "
+                        "[-time <file>] [-rss <file>] [filename]\n",
                         progname);
         exit(1);
 }
@@ -71,12 +112,17 @@ usage(const char *progname)
 int main(int argc, char *argv[]) 
 {
         char *time_file_name = NULL;
-        bool commandGiven = false;
         (void) time_file_name;
+        char *rss_file_name = NULL;
         char *flip_type = NULL;
         (void) flip_type;
         bool transp = false;
         (void) transp;
+        bool transv = false;        /* transpose, then rotate 180 */
+        Transform transform = { false, false, false };
+        bool useKernels = false;
+        int threads = 0;            /* 0 until -threads is given */
+        bool inPlace = false;
         int rotation = 0;
         int i;
 
@@ -92,24 +138,77 @@ int main(int argc, char *argv[])
                 if (strcmp(argv[i], "-row-major") == 0) {
                         SET_METHODS(uarray2_methods_plain, map_row_major, 
                                     "row-major");
+                        useKernels = false;
+                        inPlace = false;
                 } else if (strcmp(argv[i], "-col-major") == 0) {
                         SET_METHODS(uarray2_methods_plain, map_col_major, 
                                     "column-major");
+                        useKernels = false;
+                        inPlace = false;
                 } else if (strcmp(argv[i], "-block-major") == 0) {
                         SET_METHODS(uarray2_methods_blocked, map_block_major,
                                     "block-major");
-                } else if (strcmp(argv[i], "-rotate") == 0) {
-                        if (commandGiven) {
+                        useKernels = false;
+                        inPlace = false;
+                } else if (strcmp(argv[i], "-cache-oblivious") == 0) {
+                        /* recursive traversal of a plain UArray2 */
+                        methods = uarray2_methods_plain;
+                        map = mapCacheOblivious;
+                        useKernels = false;
+                        inPlace = false;
+                } else if (strcmp(argv[i], "-kernel") == 0) {
+                        if (!(i + 1 < argc)) {      /* no kernel value */
+                                usage(argv[0]);
+                        }
+                        if (!selectKernels(argv[++i])) {
+                                fprintf(stderr, "%s: unknown or unsupported "
+                                        "kernel '%s'\n", argv[0], argv[i]);
+                                usage(argv[0]);
+                        }
+                        /* the kernels read the pixels of a plain UArray2 */
+                        methods = uarray2_methods_plain;
+                        useKernels = true;
+                        inPlace = false;
+                } else if (strcmp(argv[i], "-threads") == 0) {
+                        if (!(i + 1 < argc)) {      /* no thread count */
+                                usage(argv[0]);
+                        }
+                        char *endptr;
+                        long count = strtol(argv[++i], &endptr, 10);
+                        if (*endptr != '\0' || count < 1 
+                                             || count > MAX_KERNEL_THREADS) {
+                                fprintf(stderr, "Threads must be from 1 "
+                                        "to %d\n", MAX_KERNEL_THREADS);
                                 usage(argv[0]);
                         }
-                        commandGiven = true;
+                        threads = setKernelThreads(count);
+                        if (threads < count) {
+                                fprintf(stderr, "%s: -threads %ld is more "
+                                        "than %d per online CPU, using %d\n",
+                                        argv[0], count, THREADS_PER_CPU,
+                                        threads);
+                        }
+
+                        /* threads need the kernels; auto unless -kernel */
+                        if (!useKernels) {
+                                selectKernels("auto");
+                                methods = uarray2_methods_plain;
+                                useKernels = true;
+                                inPlace = false;
+                        }
+                } else if (strcmp(argv[i], "-in-place") == 0) {
+                        /* transform the pixels of a plain UArray2 in place */
+                        methods = uarray2_methods_plain;
+                        useKernels = false;
+                        inPlace = true;
+                } else if (strcmp(argv[i], "-rotate") == 0) {
                         if (!(i + 1 < argc)) {      /* no rotate value */
                                 usage(argv[0]);
                         }
                         char *endptr;
-                        rotation = strtol(argv[++i], &endptr, 10);
-                        if (!(rotation == 0 || rotation == 90 ||
-                            rotation == 180 || rotation == 270)) {
+                        int angle = strtol(argv[++i], &endptr, 10);
+                        if (!(angle == 0 || angle == 90 ||
+                            angle == 180 || angle == 270)) {
                                 fprintf(stderr, 
                                         "Rotation must be 0, 90 180 or 270\n");
                                 usage(argv[0]);
@@ -117,30 +216,35 @@ int main(int argc, char *argv[])
                         if (!(*endptr == '\0')) {    /* Not a number */
                                 usage(argv[0]);
                         }
+                        transform = composeTransforms(transform, 
+                                                      rotationTransform(angle));
                 } else if (strcmp(argv[i], "-transpose") == 0) {
-                        if (commandGiven) {
-                                usage(argv[0]);
-                        }
-                        commandGiven = true;
-                        transp = true;
+                        Transform step = { true, false, false };
+                        transform = composeTransforms(transform, step);
                 } else if (strcmp(argv[i], "-flip") == 0) {
-                        if (commandGiven) {
-                                usage(argv[0]);
-                        }
-                        commandGiven = true;
                         if (!(i + 1 < argc)) {      /* no flip value */
                                 usage(argv[0]);
                         }
-                        flip_type = argv[++i];
-                        if (strcmp(flip_type, "horizontal") != 0 &&
-                            strcmp(flip_type, "vertical") != 0) {
+                        char *type = argv[++i];
+                        Transform step = { false, false, false };
+                        if (strcmp(type, "horizontal") == 0) {
+                                step.flipsCols = true;
+                        } else if (strcmp(type, "vertical") == 0) {
+                                step.flipsRows = true;
+                        } else {
                                 fprintf(stderr, 
                                         "Flip must be horizontal or "
                                          "vertical\n");
                                 usage(argv[0]);
                         }
+                        transform = composeTransforms(transform, step);
                 } else if (strcmp(argv[i], "-time") == 0) {
                         time_file_name = argv[++i];
+                } else if (strcmp(argv[i], "-rss") == 0) {
+                        if (!(i + 1 < argc)) {      /* no rss file */
+                                usage(argv[0]);
+                        }
+                        rss_file_name = argv[++i];
                 } else if (*argv[i] == '-') {
                         fprintf(stderr, "%s: unknown option '%s'\n", argv[0],
                                 argv[i]);
@@ -153,16 +257,30 @@ int main(int argc, char *argv[])
                 }
         }
 
+        /* Do all the transforms that were given as one */
+        reduceTransform(transform, &rotation, &flip_type, &transp, &transv);
+
         /* Opening image file that will be read */
         FILE *fp = openForReading(argv[i]);
         /* Reading contents from the image file */
         Pnm_ppm image = Pnm_ppmread(fp, methods);
         Pnm_ppm result = NULL;
-        if (flip_type != NULL) {
-                result = flip(image, methods, time_file_name, flip_type);
+        if (inPlace) {
+                applyInPlace(image, time_file_name, transform);
+                Pnm_ppmwrite(stdout, image);
+        }
+        else if (useKernels && (flip_type != NULL || transp || transv 
+                           || rotation != 0)) {
+                result = applyKernel(image, methods, time_file_name, rotation,
+                                     flip_type, transp, transv, threads);
         }
-        else if (transp) {
-                result = transpose(image, methods, time_file_name);
+        else if (flip_type != NULL) {
+                result = flip(image, methods, map, time_file_name, 
+                              flip_type);
+        }
+        else if (transp || transv) {
+                result = transpose(image, methods, map, time_file_name, 
+                                   transv);
         }
         else if (rotation == 0) {
                 CPUTime_T timer = startTimer(time_file_name);
@@ -171,7 +289,8 @@ int main(int argc, char *argv[])
 
         }
         else if (rotation == 90 || rotation == 180 || rotation == 270) {
-                result = rotate(image, methods, time_file_name, rotation);
+                result = rotate(image, methods, map, time_file_name, 
+                                rotation);
         }
 
         /* Freeing memory and closing file */
@@ -180,11 +299,130 @@ int main(int argc, char *argv[])
                 Pnm_ppmfree(&result);
         }
         fclose(fp);
+        reportPeakRss(rss_file_name);
         Pnm_ppmfree(&image);
+        if (threads > 0) {
+                setKernelThreads(1);    /* stop the pool's threads */
+        }
         
         exit(0);
 }
 
+/******************************composeTransforms*******************************
+ *
+ * Find the single transform that does one transform and then another
+ * Inputs:
+ *         Transform first: The transform done first
+ *         Transform then: The transform done to the result of first
+ * Return: The transform that does both
+ * Expects:
+ *         none
+ * Notes:
+ *         A transpose turns a flip of columns into a flip of rows and the
+ *         other way around, so the flips of first trade places when then
+ *         transposes
+ *                      
+ *****************************************************************************/
+Transform composeTransforms(Transform first, Transform then)
+{
+        Transform both;
+        both.transposes = first.transposes != then.transposes;
+        both.flipsCols = then.flipsCols != (then.transposes ? first.flipsRows
+                                                            : first.flipsCols);
+        both.flipsRows = then.flipsRows != (then.transposes ? first.flipsCols
+                                                            : first.flipsRows);
+        return both;
+}
+
+/******************************rotationTransform*******************************
+ *
+ * Find the transform that rotates an image clockwise
+ * Inputs:
+ *         int rotation: The angle of the rotation
+ * Return: The transform that rotates by rotation degrees
+ * Expects:
+ *         int rotation to be 0, 90, 180, or 270
+ * Notes:
+ *         CRE if rotation is anything else
+ *                      
+ *****************************************************************************/
+Transform rotationTransform(int rotation)
+{
+        assert(rotation == 0 || rotation == 90 || rotation == 180 
+               || rotation == 270);
+
+        Transform transform = { false, false, false };
+        if (rotation == 90) {
+                transform.transposes = true;
+                transform.flipsCols = true;
+        }
+        else if (rotation == 180) {
+                transform.flipsCols = true;
+                transform.flipsRows = true;
+        }
+        else if (rotation == 270) {
+                transform.transposes = true;
+                transform.flipsRows = true;
+        }
+        return transform;
+}
+
+/*******************************reduceTransform********************************
+ *
+ * Find the one rotation, flip, or transpose that does a transform
+ * Inputs:
+ *         Transform transform: The transform to do
+ *         int *rotation: Set to the angle of the rotation, or 0 if the 
+ *         transform is not a rotation
+ *         char **flip_type: Set to "horizontal" or "vertical" if the 
+ *         transform is a flip, or NULL if it is not
+ *         bool *transp: Set to whether the transform is a transpose
+ *         bool *transv: Set to whether the transform is a transpose across
+ *         the other diagonal (a transpose, then a rotation by 180 degrees)
+ * Return: none
+ * Expects:
+ *         the pointers to be non-null
+ * Notes:
+ *         CRE if a pointer is NULL
+ *         The identity leaves rotation at 0 and everything else unset
+ *                      
+ *****************************************************************************/
+void reduceTransform(Transform transform, int *rotation, char **flip_type,
+                     bool *transp, bool *transv)
+{
+        assert(rotation != NULL && flip_type != NULL);
+        assert(transp != NULL && transv != NULL);
+
+        *rotation = 0;
+        *flip_type = NULL;
+        *transp = false;
+        *transv = false;
+
+        if (!transform.transposes) {
+                if (transform.flipsCols && transform.flipsRows) {
+                        *rotation = 180;
+                }
+                else if (transform.flipsCols) {
+                        *flip_type = "horizontal";
+                }
+                else if (transform.flipsRows) {
+                        *flip_type = "vertical";
+                }
+        }
+        else if (transform.flipsCols && transform.flipsRows) {
+                *transv = true;
+        }
+        else if (transform.flipsCols) {
+                *rotation = 90;
+        }
+        else if (transform.flipsRows) {
+                *rotation = 270;
+        }
+        else {
+                *transp = true;
+        }
+}
+
 /**********************************openForReading******************************
  *
  * Open a file for reading or if filename is not provided read input from
@@ -229,6 +467,8 @@ FILE *openForReading(char filename[])
  *         on the original image that will be manipulated
  *         A2Methods_T methods: A pointer to a A2Methods_T struct that contains
  *         the methods used for storing and handling data
+ *         A2Methods_mapfun *map: The mapping function chosen on the command
+ *         line, used to visit the pixels of the original image
  *         char time_file[]: A char array representing the name of a file that
  *         the timing information should be stored in
  *         int rotation: The angle of the rotation that was requested
@@ -240,8 +480,8 @@ FILE *openForReading(char filename[])
  *         The value of rotation is already checked in the for loop in main
  *                      
  *****************************************************************************/
-Pnm_ppm rotate(Pnm_ppm image, A2Methods_T methods, char time_file[],
-               int rotation)
+Pnm_ppm rotate(Pnm_ppm image, A2Methods_T methods, A2Methods_mapfun *map,
+               char time_file[], int rotation)
 {
         /* Allocating memory for result image based on rotation value */
         Pnm_ppm result;
@@ -259,13 +499,13 @@ Pnm_ppm rotate(Pnm_ppm image, A2Methods_T methods, char time_file[],
 
         /* Rotate based on the rotation provided */
         if (rotation == 90) {
-                image->methods->map_default(image->pixels, helper90, result);
+                map(image->pixels, helper90, result);
         }
         else if (rotation == 180) {
-                image->methods->map_default(image->pixels, helper180, result);
+                map(image->pixels, helper180, result);
         }
         else if (rotation == 270) {
-                image->methods->map_default(image->pixels, helper270, result);
+                map(image->pixels, helper270, result);
         }
 
         /* Stop timer and write to file if timing was requested */
@@ -282,6 +522,8 @@ Pnm_ppm rotate(Pnm_ppm image, A2Methods_T methods, char time_file[],
  *         on the original image that will be manipulated
  *         A2Methods_T methods: A pointer to a A2Methods_T struct that contains
  *         the methods used for storing and handling data
+ *         A2Methods_mapfun *map: The mapping function chosen on the command
+ *         line, used to visit the pixels of the original image
  *         char time_file[]: A char array representing the name of a file that
  *         the timing information should be stored in
  *         char *flip_type: A char array containing the type of flip that was
@@ -293,8 +535,8 @@ Pnm_ppm rotate(Pnm_ppm image, A2Methods_T methods, char time_file[],
  *         char *flip_type is already checked in the for loop in main
  *                      
  *****************************************************************************/
-Pnm_ppm flip(Pnm_ppm image, A2Methods_T methods, char time_file[], 
-             char *flip_type)
+Pnm_ppm flip(Pnm_ppm image, A2Methods_T methods, A2Methods_mapfun *map,
+             char time_file[], char *flip_type)
 {
         /* Allocating memory for result image based on rotation value */
         Pnm_ppm result;
@@ -306,10 +548,10 @@ Pnm_ppm flip(Pnm_ppm image, A2Methods_T methods, char time_file[],
 
         /* Rotate based on the rotation provided */
         if (strcmp(flip_type, "horizontal") == 0) {
-                image->methods->map_default(image->pixels, helperHori, result);
+                map(image->pixels, helperHori, result);
         }
         else if (strcmp(flip_type, "vertical") == 0) {
-                image->methods->map_default(image->pixels, helperVert, result);
+                map(image->pixels, helperVert, result);
         }
 
         /* Stop timer and write to file if timing was requested */
@@ -326,8 +568,12 @@ Pnm_ppm flip(Pnm_ppm image, A2Methods_T methods, char time_file[],
  *         on the original image that will be manipulated
  *         A2Methods_T methods: A pointer to a A2Methods_T struct that contains
  *         the methods used for storing and handling data
+ *         A2Methods_mapfun *map: The mapping function chosen on the command
+ *         line, used to visit the pixels of the original image
  *         char time_file[]: A char array representing the name of a file that
  *         the timing information should be stored in
+ *         bool transv: Whether to transpose across the other diagonal, which
+ *         is a transpose followed by a rotation by 180 degrees
  * Return: A pointer to a Pnm_ppm struct that contains the result of the flip
  * Expects:
  *         none
@@ -335,7 +581,8 @@ Pnm_ppm flip(Pnm_ppm image, A2Methods_T methods, char time_file[],
  *         none
  *                      
  *****************************************************************************/
-Pnm_ppm transpose(Pnm_ppm image, A2Methods_T methods, char time_file[])
+Pnm_ppm transpose(Pnm_ppm image, A2Methods_T methods, A2Methods_mapfun *map,
+                  char time_file[], bool transv)
 {
         /* Allocating memory for result image based on rotation value */
         Pnm_ppm result = Pnm_ppm_new(image->height, image->width, 
@@ -344,8 +591,8 @@ Pnm_ppm transpose(Pnm_ppm image, A2Methods_T methods, char time_file[])
         /* Start the timer */
         CPUTime_T timer = startTimer(time_file);
 
-        /* Rotate based on the rotation provided */
-        image->methods->map_default(image->pixels, helperTran, result);
+        /* Transpose across the diagonal that was requested */
+        map(image->pixels, transv ? helperTranv : helperTran, result);
 
         /* Stop timer and write to file if timing was requested */
         stopTimer(time_file, timer);
@@ -353,6 +600,186 @@ Pnm_ppm transpose(Pnm_ppm image, A2Methods_T methods, char time_file[])
         return result;
 }
 
+/*********************************applyKernel**********************************
+ *
+ * Rotate, flip, or transpose a provided image with the kernel for that
+ * transform, which reads and writes pixel memory directly
+ * Inputs:
+ *         Pnm_ppm image: A pointer to a Pnm_ppm struct that contains the data
+ *         on the original image that will be manipulated
+ *         A2Methods_T methods: A pointer to a A2Methods_T struct that contains
+ *         the methods used for storing and handling data
+ *         char time_file[]: A char array representing the name of a file that
+ *         the timing information should be stored in
+ *         int rotation: The angle of the rotation that was requested, used if
+ *         neither a flip nor a transpose was
+ *         char *flip_type: The type of flip that was requested, or NULL
+ *         bool transp: Whether a transpose was requested
+ *         bool transv: Whether a transpose across the other diagonal was
+ *         requested
+ *         int threads: The number of threads given by -threads, or 0 if
+ *         -threads was not given
+ * Return: A pointer to a Pnm_ppm struct that contains the result
+ * Expects:
+ *         image and the result to be stored with uarray2_methods_plain
+ * Notes:
+ *         CRE if either image is not stored with uarray2_methods_plain
+ *         CPU time adds up over threads, so with -threads the time written
+ *         to time_file is the elapsed time instead
+ *                      
+ *****************************************************************************/
+Pnm_ppm applyKernel(Pnm_ppm image, A2Methods_T methods, char time_file[],
+                    int rotation, char *flip_type, bool transp, bool transv,
+                    int threads)
+{
+        /* Allocating memory for result image based on the transform */
+        Pnm_ppm result;
+        if (transp || transv || (flip_type == NULL && 
+                                 (rotation == 90 || rotation == 270))) {
+                result = Pnm_ppm_new(image->height, image->width, 
+                                     image->denominator, methods);
+        }
+        else {
+                result = Pnm_ppm_new(image->width, image->height, 
+                                     image->denominator, methods);
+        }
+        PlainImage src = plainImage(image);
+        PlainImage dst = plainImage(result);
+
+        /* Start the timer, by the clock if -threads was given */
+        CPUTime_T timer = threads == 0 ? startTimer(time_file) : NULL;
+        struct timespec start = startWallTimer();
+
+        /* Run the kernel for the transform that was requested */
+        runKernel(dst, src, rotation, flip_type, transp, transv);
+
+        /* Stop timer and write to file if timing was requested */
+        if (threads == 0) {
+                stopTimer(time_file, timer);
+        }
+        else {
+                stopWallTimer(time_file, start);
+        }
+
+        return result;
+}
+
+/**********************************runKernel***********************************
+ *
+ * Run the kernel for the transform that was requested
+ * Inputs:
+ *         PlainImage dst: Where the result is written
+ *         PlainImage src: The image that is transformed
+ *         int rotation: The angle of the rotation that was requested, used if
+ *         neither a flip nor a transpose was
+ *         char *flip_type: The type of flip that was requested, or NULL
+ *         bool transp: Whether a transpose was requested
+ *         bool transv: Whether a transpose across the other diagonal was
+ *         requested
+ * Return: none
+ * Expects:
+ *         dst to have the shape of the result of the transform, and the same
+ *         pixel size as src
+ * Notes:
+ *         CRE if the shapes or pixel sizes do not match
+ *                      
+ *****************************************************************************/
+void runKernel(PlainImage dst, PlainImage src, int rotation, 
+               char *flip_type, bool transp, bool transv)
+{
+        if (transp) {
+                kernelTranspose(dst, src);
+        }
+        else if (transv) {
+                kernelTransverse(dst, src);
+        }
+        else if (flip_type != NULL && strcmp(flip_type, "horizontal") == 0) {
+                kernelFlipHorizontal(dst, src);
+        }
+        else if (flip_type != NULL) {
+                kernelFlipVertical(dst, src);
+        }
+        else if (rotation == 90) {
+                kernelRotate90(dst, src);
+        }
+        else if (rotation == 180) {
+                kernelRotate180(dst, src);
+        }
+        else if (rotation == 270) {
+                kernelRotate270(dst, src);
+        }
+}
+
+/*********************************applyInPlace*********************************
+ *
+ * Rotate, flip, or transpose a provided image in its own memory, so no 
+ * second image is allocated for the result
+ * Inputs:
+ *         Pnm_ppm image: A pointer to a Pnm_ppm struct that contains the data
+ *         on the original image, which is changed into the result
+ *         char time_file[]: A char array representing the name of a file that
+ *         the timing information should be stored in
+ *         Transform transform: The transform to do, with all the ones given
+ *         on the command line composed
+ * Return: none
+ * Expects:
+ *         image to be stored with uarray2_methods_plain
+ * Notes:
+ *         CRE if image is not stored with uarray2_methods_plain
+ *         The width and height of image trade places if transform 
+ *         transposes
+ *                      
+ *****************************************************************************/
+void applyInPlace(Pnm_ppm image, char time_file[], Transform transform)
+{
+        PlainImage plain = plainImage(image);
+
+        /* Start the timer */
+        CPUTime_T timer = startTimer(time_file);
+
+        transformInPlace(&plain, transform.transposes, transform.flipsCols,
+                         transform.flipsRows);
+
+        /* Stop timer and write to file if timing was requested */
+        stopTimer(time_file, timer);
+
+        /* The same pixels are now rows of the new width */
+        if (transform.transposes) {
+                UArray2_reshape(image->pixels, plain.width, plain.height);
+                image->width = plain.width;
+                image->height = plain.height;
+        }
+}
+
+/*********************************plainImage***********************************
+ *
+ * Describe where the pixels of an image stored in a plain UArray2 are
+ * Inputs:
+ *         Pnm_ppm image: A pointer to the Pnm_ppm struct to describe
+ * Return: A PlainImage with the address of the top left pixel and the
+ *         number of bytes from one row to the next
+ * Expects:
+ *         image to be stored with uarray2_methods_plain
+ * Notes:
+ *         CRE if image is not stored with uarray2_methods_plain
+ *         A UArray2 keeps its rows one after the other with no gaps, so the
+ *         stride is the width times the size of a pixel
+ *                      
+ *****************************************************************************/
+PlainImage plainImage(Pnm_ppm image)
+{
+        assert(image->methods == uarray2_methods_plain);
+
+        PlainImage plain = { NULL, image->width * sizeof(struct Pnm_rgb),
+                             sizeof(struct Pnm_rgb), image->width, 
+                             image->height };
+        if (image->width > 0 && image->height > 0) {
+                plain.pixels = image->methods->at(image->pixels, 0, 0);
+        }
+
+        return plain;
+}
+
 /**********************************helperHori**********************************
  *
  * Put an element from the original image to a position in the result image
@@ -452,6 +879,42 @@ void helperTran(int col, int row, A2Methods_UArray2 arr, void *elem, void *cl)
         (void) arr;   
 }
 
+/*********************************helperTranv**********************************
+ *
+ * Put an element from the original image to a position in the result image
+ * Inputs:
+ *         int col: The column position of elem in A2Methods_UArray2 arr
+ *         int row: The row position of elem in A2Methods_UArray2 arr
+ *         A2Methods_UArray2 arr: A 2D array that contains elem at position
+ *         (col, row)
+ *         void *elem: The element at location (col, row) in 
+ *         A2Methods_UArray2 arr that is put into the result Pnm_ppm struct
+ *         passed in through void *cl
+ *         void *cl: Closure pointer that in this case contains a pointer to a
+ *         Pnm_ppm struct that will be used to store the result of the 
+ *         transpose
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         helperTranv is a helper function that is called in transpose while
+ *         mapping through the data in Pnm_ppm image while transposing across
+ *         the diagonal from the top right to the bottom left
+ *                      
+ *****************************************************************************/
+void helperTranv(int col, int row, A2Methods_UArray2 arr, void *elem, void *cl)
+{
+        /* Accessing location where elem needs to be put in result */
+        Pnm_ppm result = cl;
+        struct Pnm_rgb *c = result->methods->at(result->pixels, 
+                                                result->width - row - 1,
+                                                result->height - col - 1);
+
+        /* Placing element in correct location */
+        *c = *(struct Pnm_rgb *)elem;
+        (void) arr;
+}
+
 /**********************************helper90************************************
  *
  * Put an element from the original image to a position in the result image
@@ -593,6 +1056,31 @@ Pnm_ppm Pnm_ppm_new(unsigned width, unsigned height, unsigned denominator,
         return newResultA2;
 }
 
+/******************************mapCacheOblivious******************************
+ *
+ * Visit every element of a plain 2D array by recursively splitting it in 
+ * half until the pieces are small, so that the elements visited together, 
+ * and the elements of the result they are copied to, are close in memory 
+ * whatever the sizes of the caches are
+ * Inputs:
+ *         A2Methods_UArray2 array2: The 2D array whose elements are visited
+ *         A2Methods_applyfun apply: The function called on every element
+ *         void *cl: Closure pointer passed to every call of apply
+ * Return: none
+ * Expects:
+ *         A2Methods_UArray2 array2 to have been made by uarray2_methods_plain
+ * Notes:
+ *         A2Methods_T has no slot for this traversal, so it calls UArray2 
+ *         directly. Has the type of an A2Methods_mapfun, so rotate, flip, 
+ *         and transpose use it like any other map.
+ *                      
+ *****************************************************************************/
+void mapCacheOblivious(A2Methods_UArray2 array2, A2Methods_applyfun apply,
+                       void *cl)
+{
+        UArray2_map_cache_oblivious(array2, (UArray2_applyfun *) apply, cl);
+}
+
 /**********************************startTimer**********************************
  *
  * Initiate a new CPUTime_T and start a timer that will measure the time it
@@ -660,4 +1148,93 @@ void stopTimer(char *time_file, CPUTime_T timer)
                 /* Free memory associated with the timer */
                 CPUTime_Free(&timer);
         }
-}
\ No newline at end of file
+}
+/********************************startWallTimer********************************
+ *
+ * Read the clock at the start of something to be timed
+ * Inputs:
+ *         none
+ * Return: The time now, from a clock that only goes forward
+ * Expects:
+ *         none
+ * Notes:
+ *         Used instead of a CPUTime_T to time work spread over threads
+ *                      
+ *****************************************************************************/
+struct timespec startWallTimer(void)
+{
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        return start;
+}
+
+/********************************stopWallTimer*********************************
+ *
+ * Write the time elapsed since a start time into a file whose name was
+ * provided
+ * Inputs:
+ *         char *time_file: A char array representing the name of a file that
+ *         should store the elapsed time, or NULL if timing was not requested
+ *         struct timespec start: The time returned by startWallTimer
+ * Return: none
+ * Expects:
+ *         char *time_file to either contain a NULL or the name of a openable
+ *         file
+ * Notes:
+ *         CRE if file could not be opened but name was provided
+ *         The time is written in nanoseconds, like stopTimer writes it
+ *                      
+ *****************************************************************************/
+void stopWallTimer(char *time_file, struct timespec start)
+{
+        /* Check if timing was requested */
+        if (time_file != NULL) {
+                struct timespec stop;
+                clock_gettime(CLOCK_MONOTONIC, &stop);
+                double time_used = (stop.tv_sec - start.tv_sec) * 1e9 
+                                   + (stop.tv_nsec - start.tv_nsec);
+
+                /* Open file to store time_used */
+                FILE *tfp = fopen(time_file, "w");
+                assert(tfp != NULL);
+
+                /* Write to file and close it */
+                fprintf(tfp, "%f", time_used);
+                fclose(tfp);
+        }
+}
+
+/********************************reportPeakRss*********************************
+ *
+ * Write the most memory the program has had resident at once into a file
+ * whose name was provided
+ * Inputs:
+ *         char *rss_file: A char array representing the name of a file that
+ *         should store the peak resident set size, or NULL if it was not 
+ *         requested
+ * Return: none
+ * Expects:
+ *         char *rss_file to either contain a NULL or the name of a openable
+ *         file
+ * Notes:
+ *         CRE if file could not be opened but name was provided
+ *         The size is written in kilobytes, as getrusage gives it on Linux
+ *                      
+ *****************************************************************************/
+void reportPeakRss(char *rss_file)
+{
+        /* Check if the peak was requested */
+        if (rss_file != NULL) {
+                struct rusage usage;
+                int status = getrusage(RUSAGE_SELF, &usage);
+                assert(status == 0);
+
+                /* Open file to store the peak */
+                FILE *rfp = fopen(rss_file, "w");
+                assert(rfp != NULL);
+
+                /* Write to file and close it */
+                fprintf(rfp, "%ld", usage.ru_maxrss);
+                fclose(rfp);
+        }
+}
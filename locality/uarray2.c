@@ -1,72 +1,81 @@
 #line 50 "www/solutions/uarray2.nw"
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "assert.h"
 #include "mem.h"
-#include "uarray.h"
 #include "uarray2.h"
 
 #define T UArray2_T
 
-/* 
- * Element (i, j) in the world of ideas maps to
- * rows[j][i] where the square brackets stand for access
- * to a Hanson UArray_T
+/* regions of at most this many cells are not split any further */
+#define OBLIVIOUS_BASE_CELLS 64
+
+/*
+ * Element (i, j) in the world of ideas lives at
+ * cells + (j * width + i) * size: all the rows are in one
+ * allocation, one after the other, with no gaps between them
  */
 struct T {
         int width, height;
         int size;
-        UArray_T rows; /* UArray_T of 'height' UArray_Ts,
-                          each of length 'width' and size 'size' */
+        char *cells; /* height rows of width cells, each 'size' bytes */
 };
 #line 79 "www/solutions/uarray2.nw"
-static inline UArray_T row(T a, int j)
+static inline char *cell(T a, int i, int j)
 {
-        UArray_T *prow = UArray_at(a->rows, j);   /* Ramsey idiom */
-        return *prow;
+        return a->cells + ((size_t) j * a->width + i) * a->size;
 }
 #line 92 "www/solutions/uarray2.nw"
 static int is_ok(T a)
 {
-        return a && UArray_length(a->rows) == a->height &&
-               UArray_size(a->rows) == sizeof(UArray_T) &&
-               (a->height == 0 || (UArray_length(row(a, 0)) == a->width
-                                   && UArray_size  (row(a, 0)) == a->size));
+        return a && a->width >= 0 && a->height >= 0 && a->size > 0 &&
+               a->cells != NULL;
 }
 #line 109 "www/solutions/uarray2.nw"
 T UArray2_new(int width, int height, int size)
 {
-        int i;  /* interates over row number */
+        assert(width >= 0 && height >= 0 && size > 0);
+        size_t ncells = (size_t) width * height;
+        assert(ncells == 0 || (size_t) size <= SIZE_MAX / ncells);
         T array;
         NEW(array);
         array->width  = width;
         array->height = height;
         array->size   = size;
-        array->rows   = UArray_new(height, sizeof(UArray_T));
-        for (i = 0; i < height; i++) {
-                UArray_T *rowp = UArray_at(array->rows, i);
-                *rowp = UArray_new(width, size);
-        }
+        /* CALLOC zeroes the cells like UArray; at least one, never NULL */
+        array->cells  = CALLOC(ncells == 0 ? 1 : (long) ncells, size);
         assert(is_ok(array));
         return array;
 }
 #line 131 "www/solutions/uarray2.nw"
 void UArray2_free(T *array2)
 {
-        int i;
         assert(array2 != NULL && *array2 != NULL);
-        for (i = 0; i < (*array2)->height; i++) {
-                UArray_T p = row(*array2, i);
-                UArray_free(&p);
-        }
-        UArray_free(&(*array2)->rows);
+        FREE((*array2)->cells);
         FREE(*array2);
 }
 #line 151 "www/solutions/uarray2.nw"
 void *UArray2_at(T array2, int i, int j)
 {
         assert(array2 != NULL);
-        return UArray_at(row(array2, j), i);
+        assert(i >= 0 && i < array2->width);
+        assert(j >= 0 && j < array2->height);
+        return cell(array2, i, j);
+}
+
+/*
+ * Give array2 new dimensions with the same number of cells. No cell moves:
+ * the buffer is just read as rows of the new width, which is what an
+ * in-place transpose leaves behind
+ */
+void UArray2_reshape(T array2, int width, int height)
+{
+        assert(array2 != NULL && width >= 0 && height >= 0);
+        assert((size_t) width * height 
+               == (size_t) array2->width * array2->height);
+        array2->width  = width;
+        array2->height = height;
 }
 #line 162 "www/solutions/uarray2.nw"
 int UArray2_height(T array2)
@@ -87,31 +96,77 @@ int UArray2_size(T array2)
         return array2->size;
 }
 #line 193 "www/solutions/uarray2.nw"
-void UArray2_map_row_major(T array2, 
-                           void apply(int i, int j, T array2, 
-                                      void *elem, void *cl), 
+void UArray2_map_row_major(T array2,
+                           void apply(int i, int j, T array2,
+                                      void *elem, void *cl),
                            void *cl)
 {
-        assert(array2!= NULL);
+        assert(array2 != NULL);
         int h = array2->height;  /* keeping height and width in registers */
         int w = array2->width;   /* avoids extra memory traffic           */
+        int size = array2->size;
+        char *elem = array2->cells;
+        /* row-major order is memory order, so one pointer walks it all */
         for (int j = 0; j < h; j++) {
-                /* don't want row/UArray_at in inner loop */
-                UArray_T thisrow = row(array2, j); 
-                for (int i = 0; i < w; i++)
-                        apply(i, j, array2, UArray_at(thisrow, i), cl);
+                for (int i = 0; i < w; i++) {
+                        apply(i, j, array2, elem, cl);
+                        elem += size;
+                }
         }
 }
 #line 211 "www/solutions/uarray2.nw"
-void UArray2_map_col_major(T array2, 
-                           void apply(int i, int j, T array2, 
-                                      void *elem, void *cl), 
+void UArray2_map_col_major(T array2,
+                           void apply(int i, int j, T array2,
+                                      void *elem, void *cl),
                            void *cl)
 {
         assert(array2 != NULL);
         int h = array2->height;  /* keeping height and width in registers */
         int w = array2->width;   /* avoids extra memory traffic           */
-        for (int i = 0; i < w; i++)
-                for (int j = 0; j < h; j++)
-                        apply(i, j, array2, UArray_at(row(array2, j), i), cl);
-}
\ No newline at end of file
+        size_t stride = (size_t) w * array2->size;  /* bytes per row */
+        for (int i = 0; i < w; i++) {
+                char *elem = cell(array2, i, 0);
+                for (int j = 0; j < h; j++) {
+                        apply(i, j, array2, elem, cl);
+                        elem += stride;
+                }
+        }
+}
+
+/*
+ * Visit the w by h region whose top left cell is (i0, j0), splitting
+ * its longer side in half until it is small. Each half is finished
+ * before the other is started, so at every size of cache there is a
+ * level of the recursion whose regions fit in it
+ */
+static void map_region(T array2, int i0, int j0, int w, int h,
+                       void apply(int i, int j, T array2,
+                                  void *elem, void *cl),
+                       void *cl)
+{
+        if ((size_t) w * h <= OBLIVIOUS_BASE_CELLS) {
+                int size = array2->size;
+                for (int j = j0; j < j0 + h; j++) {
+                        char *elem = cell(array2, i0, j);
+                        for (int i = i0; i < i0 + w; i++) {
+                                apply(i, j, array2, elem, cl);
+                                elem += size;
+                        }
+                }
+        } else if (w >= h) {
+                map_region(array2, i0, j0, w / 2, h, apply, cl);
+                map_region(array2, i0 + w / 2, j0, w - w / 2, h, apply, cl);
+        } else {
+                map_region(array2, i0, j0, w, h / 2, apply, cl);
+                map_region(array2, i0, j0 + h / 2, w, h - h / 2, apply, cl);
+        }
+}
+
+void UArray2_map_cache_oblivious(T array2,
+                                 void apply(int i, int j, T array2,
+                                            void *elem, void *cl),
+                                 void *cl)
+{
+        assert(array2 != NULL);
+        map_region(array2, 0, 0, array2->width, array2->height, apply, cl);
+}
@@ -25,15 +25,23 @@
 
 typedef struct UArray2_T *UArray2_T;
 
+/*
+ * The cells are stored row by row in one buffer with no gaps: cell (col, row)
+ * is (row * width + col) * size bytes after cell (0, 0)
+ */
+
 UArray2_T UArray2_new(int cols, int rows, int size_elem);
 int UArray2_width(UArray2_T arr);
 int UArray2_height(UArray2_T arr);
 int UArray2_size(UArray2_T arr);
 void *UArray2_at(UArray2_T arr, int col, int row);
+void UArray2_reshape(UArray2_T arr, int cols, int rows);
 void UArray2_map_col_major(UArray2_T arr, void apply(int col, int row, 
                            UArray2_T arr, void *x, void *cl), void *cl);
 void UArray2_map_row_major(UArray2_T arr, void apply(int col, int row, 
                            UArray2_T arr, void *x, void *cl), void *cl);
+void UArray2_map_cache_oblivious(UArray2_T arr, void apply(int col, int row,
+                                 UArray2_T arr, void *x, void *cl), void *cl);
 void UArray2_free(UArray2_T *arr);
 
 #endif
\ No newline at end of file
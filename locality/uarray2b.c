@@ -17,13 +17,15 @@
  *
  *****************************************************************************/
 #include "stdlib.h"
+#include "stdint.h"
 #include "uarray2b.h"
-#include "uarray2.h"
-#include "uarray.h"
 #include "mem.h"
 #include "math.h"
 #include "assert.h"
 
+/* Blocks start on a cache line boundary */
+#define CACHE_LINE 64
+
 /******************************UArray2b_T**************************************
  *
  * Blocked two dimensional array
@@ -32,7 +34,19 @@
  *         int height: The height of the array
  *         int blocksize: The size of a block in the array
  *         int size: The size of an element in the array
- *         UArray2_T data: The two dimensional array that stores the blocks
+ *         int blocks_wide: The number of blocks across the array
+ *         size_t block_bytes: The distance in bytes from one block to the 
+ *                      next, blocksize * blocksize * size rounded up to a 
+ *                      whole number of cache lines
+ *         char *cells: The first cell of the first block, aligned to a 
+ *                      cache line
+ *         void *memory: The allocation that cells points into, for freeing
+ *
+ * Notes:
+ *         All the blocks live in one allocation, one after another in block 
+ *         major order: the blocks of the top row of blocks from left to right,
+ *         then the next row of blocks, and so on. The cells of a block are 
+ *         stored row by row, so a block major traversal walks memory in order.
  *                      
  *****************************************************************************/
 struct UArray2b_T {
@@ -40,12 +54,21 @@ struct UArray2b_T {
         int height;
         int blocksize;
         int size;
-        UArray2_T data;
+        int blocks_wide;
+        size_t block_bytes;
+        char *cells;
+        void *memory;
 };
 
 typedef struct UArray2b_T *T;
 
-UArray2_T allocateBlocks(int width, int height, int blocksize, int size);
+void allocateBlocks(T array2b);
+static inline void mapFullBlock(T array2b, int bCol, int bRow, char *elem,
+                                void apply(int col, int row, T array2b, 
+                                           void *elem, void *cl), void *cl);
+static void mapEdgeBlock(T array2b, int bCol, int bRow, int cols, int rows,
+                         char *block, void apply(int col, int row, 
+                         T array2b, void *elem, void *cl), void *cl);
 
 /******************************UArray2b_new************************************
 *
@@ -84,9 +107,7 @@ extern T UArray2b_new (int width, int height, int size, int blocksize)
         curr->size = size;
 
         /* Allocate memory for storage */
-        UArray2_T data = NULL;
-        data = allocateBlocks(width, height, blocksize, size);
-        curr->data = data;
+        allocateBlocks(curr);
 
         return curr;
 }
@@ -132,9 +153,7 @@ extern T UArray2b_new_64K_block(int width, int height, int size)
         curr->size = size;
 
         /* Allocate memory for storage */
-        UArray2_T data = NULL;
-        data = allocateBlocks(width, height, curr->blocksize, size);
-        curr->data = data;
+        allocateBlocks(curr);
 
         return curr;
 }
@@ -158,22 +177,8 @@ extern void UArray2b_free (T *array2b)
         /* Make sure provided value is correct */
         assert(array2b != NULL && *array2b != NULL); 
 
-        /* Avoid freeing NULL */
-        if ((*array2b)->data != NULL) {
-                UArray2_T data = (*array2b)->data;
-
-                /* Free every block in data */
-                for (int row = 0; row < UArray2_height(data); row++) {
-                        for (int col = 0; col < UArray2_width(data); col++) {
-                                UArray_free(&(*((UArray_T *)UArray2_at(data, 
-                                                                       col, 
-                                                                       row))));
-                        }
-                }
-
-                UArray2_free(&data);
-        }
-        
+        /* Every block is in the one allocation */
+        FREE((*array2b)->memory);
         FREE(*array2b);
 }
 
@@ -288,15 +293,15 @@ extern void *UArray2b_at(T array2b, int column, int row)
         assert(column >= 0 && column < array2b->width);
         assert(row >= 0 && row < array2b->height);
 
-        /* Access block where the element is located */
+        /* Find the block where the element is located */
         int bsize = array2b->blocksize;
-        UArray_T *curr = UArray2_at(array2b->data, column / bsize, 
-                                    row / bsize);
-        assert(curr != NULL);
+        size_t block = (size_t) (row / bsize) * array2b->blocks_wide 
+                       + column / bsize;
 
-        /* Calculate index of element and return it */
-        int index = bsize * (column % bsize) + (row % bsize); 
-        return UArray_at(*curr, index);
+        /* Calculate index of element within the block and return it */
+        int index = bsize * (row % bsize) + (column % bsize);
+        return array2b->cells + block * array2b->block_bytes 
+               + (size_t) index * array2b->size;
 }
 
 /***************************UArray2b_map***************************************
@@ -315,6 +320,9 @@ extern void *UArray2b_at(T array2b, int column, int row)
  *         CRE if the UArray2b passed is a null pointer. 
  *         maps through blocks as row-major 
  *         maps through cells within each block as row-major
+ *         Walks each block's memory with a pointer instead of calling 
+ *         UArray2b_at. Only the blocks on the right and bottom edges are
+ *         cut short, and only those pay to skip their unused cells.
  *                      
  *****************************************************************************/
 extern void UArray2b_map(T array2b, void apply(int col, int row, T array2b, 
@@ -322,72 +330,148 @@ extern void UArray2b_map(T array2b, void apply(int col, int row, T array2b,
 {
         /* Make sure provided value is correct */
         assert(array2b != NULL); 
-        int height = array2b->height;
-        int width = array2b->width;
         int bSize = array2b->blocksize;
-
-        /* Iterate through the start of each block */
-        for (int bRow = 0; bRow < height; bRow += bSize) {
-                for (int bCol = 0; bCol < array2b->width; bCol += bSize) {
-
-                        /* Iterate through the block */
-                        for (int row = bRow; row < bRow + bSize && 
-                                           row < height; row++) {      
-
-                                for (int col = bCol; col < bCol + bSize && 
-                                                     col < width; col++) {
-                                                        
-                                        /* Calling apply on the element */
-                                        apply(col, row, array2b, 
-                                              UArray2b_at(array2b, col, row), 
-                                              cl);
-                                }
+        int full_wide = array2b->width / bSize;
+        int full_high = array2b->height / bSize;
+        int edge_wide = array2b->width % bSize;
+        int edge_high = array2b->height % bSize;
+
+        /* Iterate through the blocks, a row of blocks at a time */
+        char *block = array2b->cells;
+        for (int bRow = 0; bRow < array2b->height; bRow += bSize) {
+                int rows = bRow / bSize < full_high ? bSize : edge_high;
+
+                for (int bCol = 0; bCol < full_wide * bSize; bCol += bSize) {
+                        if (rows == bSize) {
+                                mapFullBlock(array2b, bCol, bRow, block, 
+                                             apply, cl);
+                        } else {
+                                mapEdgeBlock(array2b, bCol, bRow, bSize, rows,
+                                             block, apply, cl);
                         }
+                        block += array2b->block_bytes;
+                }
+
+                /* The last block in the row may be cut short on the right */
+                if (edge_wide != 0) {
+                        mapEdgeBlock(array2b, full_wide * bSize, bRow, 
+                                     edge_wide, rows, block, apply, cl);
+                        block += array2b->block_bytes;
+                }
+        }
+}
+
+/***************************mapFullBlock***************************************
+ *
+ * call apply on every cell of a block that is entirely inside the array
+ * Inputs:
+ *         T array2b: the UArray2b_T being mapped
+ *         int bCol: the column of the block's top left cell
+ *         int bRow: the row of the block's top left cell
+ *         char *elem: the block's first cell
+ *         void apply(int col, int row, T array2b, void *elem, void *cl): 
+ *                     function to apply to every cell in the block
+ *         void *cl: void pointer to the closure
+ * Return: void
+ * Expects:
+ *         the block's blocksize by blocksize cells to all be in bounds
+ * Notes:
+ *         the cells of a full block are consecutive, so elem just moves on 
+ *         by size each time
+ *                      
+ *****************************************************************************/
+static inline void mapFullBlock(T array2b, int bCol, int bRow, char *elem,
+                                void apply(int col, int row, T array2b, 
+                                           void *elem, void *cl), void *cl)
+{
+        int bSize = array2b->blocksize;
+        int size = array2b->size;
 
+        for (int row = bRow; row < bRow + bSize; row++) {
+                for (int col = bCol; col < bCol + bSize; col++) {
+                        apply(col, row, array2b, elem, cl);
+                        elem += size;
                 }
         }
 }
 
+/***************************mapEdgeBlock***************************************
+ *
+ * call apply on the cells of a block on the right or bottom edge of the 
+ * array that are inside the array
+ * Inputs:
+ *         T array2b: the UArray2b_T being mapped
+ *         int bCol: the column of the block's top left cell
+ *         int bRow: the row of the block's top left cell
+ *         int cols: the number of the block's columns inside the array
+ *         int rows: the number of the block's rows inside the array
+ *         char *block: the block's first cell
+ *         void apply(int col, int row, T array2b, void *elem, void *cl): 
+ *                     function to apply to every cell in the block
+ *         void *cl: void pointer to the closure
+ * Return: void
+ * Expects:
+ *         cols and rows to be between 1 and the blocksize
+ * Notes:
+ *         skips the unused cells at the end of each row of the block
+ *                      
+ *****************************************************************************/
+static void mapEdgeBlock(T array2b, int bCol, int bRow, int cols, int rows,
+                         char *block, void apply(int col, int row, 
+                         T array2b, void *elem, void *cl), void *cl)
+{
+        int size = array2b->size;
+        size_t row_bytes = (size_t) array2b->blocksize * size;
+
+        for (int row = bRow; row < bRow + rows; row++) {
+                char *elem = block;
+                for (int col = bCol; col < bCol + cols; col++) {
+                        apply(col, row, array2b, elem, cl);
+                        elem += size;
+                }
+                block += row_bytes;
+        }
+}
+
 /***************************allocateBlocks*************************************
  *
- * Initializes the UArray2_T that represents our UArray2b and allocate the 
- * memory for each block, storing it in the UArray2
+ * Allocates one zeroed buffer big enough for every block of a UArray2b and 
+ * records where the blocks are in it
  * Inputs:
- *         int width: integer describing the number of cells in the width of 
- *         the 2D array
- *         int height: integer describing the number of cells in the height of 
- *         the 2D array
- *         int size: An int representing the size of each element in bytes. 
- *         int blocksize: an integer representing the number of cells across
- *         and down that each block is.
- * Return: UaArray2_T of given dimensions and blcok size, with a UArray in each
- *         block
+ *         T array2b: a UArray2b_T whose width, height, blocksize, and size 
+ *                    have been set
+ * Return: void
  * Expects:
  *         width and height to be greater than or equal to 0, size and 
  *         blocksize to be greater than or equal to 1.
  * Notes:
  *         Expecations have been checked in the function that calls this one.
+ *         Sets blocks_wide, block_bytes, cells, and memory.
+ *         The buffer is over-allocated by one cache line so that cells can be
+ *         moved up to the first cache line boundary.
  *                      
  *****************************************************************************/
-UArray2_T allocateBlocks(int width, int height, int blocksize, int size)
+void allocateBlocks(T array2b)
 {
-        /* Allocating memory for a UArray2_T */
-        UArray2_T data = NULL;
-        data = UArray2_new(ceil((double) width / blocksize), 
-                           ceil((double) height / blocksize), 
-                           sizeof(UArray_T));
-
-        int data_height = UArray2_height(data);
-        int data_width = UArray2_width(data);
-        
-        /* Allocate memory for the blocks and store them in data */
-        UArray_T *elem = NULL;
-        for (int row = 0; row < data_height; row++) {
-                for (int col = 0; col < data_width; col++) {
-                        elem = UArray2_at(data, col, row);
-                        *elem = UArray_new(blocksize * blocksize, size);
-                }
-        }
-
-        return data;
-}
\ No newline at end of file
+        int bsize = array2b->blocksize;
+        int blocks_wide = (array2b->width + bsize - 1) / bsize;
+        int blocks_high = (array2b->height + bsize - 1) / bsize;
+
+        /* Round each block up to whole cache lines */
+        size_t block_bytes = (size_t) bsize * bsize * array2b->size;
+        block_bytes = (block_bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+
+        size_t nblocks = (size_t) blocks_wide * blocks_high;
+        assert(nblocks == 0 
+               || block_bytes <= (SIZE_MAX - CACHE_LINE) / nblocks);
+
+        /* One allocation holds every block; CALLOC zeroes it like UArray */
+        char *memory = CALLOC(1, (long) (nblocks * block_bytes + CACHE_LINE));
+        uintptr_t misaligned = (uintptr_t) memory % CACHE_LINE;
+
+        array2b->blocks_wide = blocks_wide;
+        array2b->block_bytes = block_bytes;
+        array2b->memory = memory;
+        array2b->cells = misaligned == 0 ? memory 
+                                         : memory + CACHE_LINE - misaligned;
+}
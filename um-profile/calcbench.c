@@ -0,0 +1,704 @@
+/******************************************************************************
+ *
+ *                                calcbench.c
+ *
+ *     Assignment: um
+ *     Authors:    Marten Tropp and Matthew Carey
+ *     Date:       11/20/2023
+ *
+ *     The purpose of this file is to measure calc40 (asmcoding/calc40.um)
+ *     and the engines that run it on long streams of RPN operations, and to
+ *     check every answer. It generates a stream of OPS operations from a
+ *     seeded random mix of operation kinds, works out the output calc40
+ *     must print with an evaluator of its own, then runs calc40 under each
+ *     engine given and compares what it prints. For each engine it prints
+ *     the wall-clock time and the RPN operations per second. If um-profile
+ *     has been built, calc40 is also run under it once to count the UM
+ *     instructions executed per RPN operation, which is the number to
+ *     watch when calc40 itself changes.
+ *
+ *     The mix gives a weight to each kind of operation: number (push a
+ *     number of 1 to 10 digits), arith (+ - * / | &), unary (c ~), stack
+ *     (s d p), print (a newline, which prints the whole stack), zero (z)
+ *     and bad (a character calc40 does not know). Each operation is drawn
+ *     from the kinds that make sense at the current depth: nothing pops
+ *     more values than there are, newlines are only drawn while the stack
+ *     holds at most PRINT_DEPTH values so that the output stays in
+ *     proportion to the input, and nothing pushes beyond -depth values.
+ *     Division by zero still happens whenever the top value is 0.
+ *
+ *     Usage: calcbench [-ops N] [-seed N] [-mix kind=weight,...] [-depth N]
+ *                      [-calc40 FILE] [-save FILE] [engine ...]
+ *
+ *     Engines are executables in the current directory by default, and
+ *     those of um, um-checked, um-guard, um-slab, um-seq, um-chunked,
+ *     um-idiom, um-reclaim, um-relocate and um-ext that have been built are
+ *     run when none are named. -save writes the generated input to FILE.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <time.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/* Largest stack a newline may be drawn for */
+#define PRINT_DEPTH 8
+
+/* Room for why a run failed: its status and a line of its errors */
+#define FAILURE_SIZE 256
+
+enum kind { NUMBER, ARITH, UNARY, STACK, PRINT, ZERO, BAD, KINDS };
+
+static const char *kind_names[KINDS] = { "number", "arith", "unary",
+                                         "stack", "print", "zero", "bad" };
+
+static const char *default_engines[] = { "um", "um-checked", "um-guard",
+                                         "um-slab", "um-seq", "um-chunked",
+                                         "um-idiom", "um-reclaim",
+                                         "um-relocate", "um-ext" };
+
+static inline uint64_t now_ns(void)
+{
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (uint64_t) t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+/*******************************buffer*****************************************
+ *
+ * Bytes appended to as they are made.
+ * Stores:
+ *         char *bytes:     The bytes
+ *         size_t length:   Number of bytes
+ *         size_t capacity: Room for bytes
+ *
+ *****************************************************************************/
+struct buffer {
+        char *bytes;
+        size_t length;
+        size_t capacity;
+};
+
+static void append(struct buffer *buf, const char *bytes, size_t length)
+{
+        if (buf->length + length > buf->capacity) {
+                while (buf->length + length > buf->capacity) {
+                        buf->capacity = buf->capacity == 0 ? 4096 :
+                                        buf->capacity * 2;
+                }
+                buf->bytes = realloc(buf->bytes, buf->capacity);
+                assert(buf->bytes);
+        }
+        memcpy(buf->bytes + buf->length, bytes, length);
+        buf->length += length;
+}
+
+static void append_string(struct buffer *buf, const char *s)
+{
+        append(buf, s, strlen(s));
+}
+
+/* xorshift64*, so that a seed makes the same stream everywhere */
+static uint64_t next_random(uint64_t *state)
+{
+        *state ^= *state >> 12;
+        *state ^= *state << 25;
+        *state ^= *state >> 27;
+        return *state * UINT64_C(2685821657736338717);
+}
+
+static uint32_t random_below(uint64_t *state, uint32_t n)
+{
+        return (uint32_t) ((next_random(state) >> 32) % n);
+}
+
+/**********************************generate************************************
+ *
+ * Writes a stream of RPN operations for calc40
+ * Inputs:
+ *         struct buffer *input: Where the stream is appended
+ *         uint64_t ops:         Number of operations
+ *         uint64_t seed:        Seed of the random choices
+ *         unsigned *mix:        Weight of each kind of operation
+ *         uint64_t max_depth:   Most values the stream may push
+ *         uint64_t *counts:     Operations made of each kind
+ * Return: none
+ * Expects:
+ *         mix[NUMBER] or mix[ZERO] to be nonzero
+ * Notes:
+ *         Every operation is followed by a space, except a newline. The
+ *         stream ends with a newline, which prints what is left, as long as
+ *         it is at most PRINT_DEPTH values.
+ *****************************************************************************/
+static void generate(struct buffer *input, uint64_t ops, uint64_t seed,
+                     unsigned *mix, uint64_t max_depth, uint64_t *counts)
+{
+        static const char arith[] = "+-*/|&", unary[] = "c~",
+                          stack[] = "sdp", bad[] = "x#!?";
+        uint64_t state = seed * 2 + 1;
+        uint64_t depth = 0;
+        char token[16];
+
+        for (uint64_t op = 0; op < ops; op++) {
+                bool allowed[KINDS] = {
+                        [NUMBER] = depth < max_depth,
+                        [ARITH] = depth >= 2,
+                        [UNARY] = depth >= 1,
+                        [STACK] = depth >= 1,
+                        [PRINT] = depth <= PRINT_DEPTH,
+                        [ZERO] = true,
+                        [BAD] = true,
+                };
+                unsigned total = 0;
+                for (int k = 0; k < KINDS; k++) {
+                        total += allowed[k] ? mix[k] : 0;
+                }
+                enum kind kind = ZERO;
+                if (total > 0) {
+                        uint32_t pick = random_below(&state, total);
+                        for (kind = 0; !allowed[kind] || pick >= mix[kind];
+                             kind++) {
+                                pick -= allowed[kind] ? mix[kind] : 0;
+                        }
+                }
+                counts[kind]++;
+
+                switch (kind) {
+                case NUMBER: {
+                        uint32_t digits = 1 + random_below(&state, 10);
+                        uint64_t value = 0;
+                        for (uint32_t d = 0; d < digits; d++) {
+                                value = value * 10 + random_below(&state, 10);
+                        }
+                        if (value > UINT32_MAX) {
+                                value %= (uint64_t) UINT32_MAX + 1;
+                        }
+                        sprintf(token, "%" PRIu64 " ", value);
+                        depth++;
+                        break;
+                }
+                case ARITH:
+                        sprintf(token, "%c ", arith[random_below(&state, 6)]);
+                        depth--;
+                        break;
+                case UNARY:
+                        sprintf(token, "%c ", unary[random_below(&state, 2)]);
+                        break;
+                case STACK: {
+                        /* swap needs two values, duplicate room for one */
+                        char c = stack[random_below(&state, 3)];
+                        if (c == 's' && depth < 2) {
+                                c = 'd';
+                        } else if (c == 'd' && depth >= max_depth) {
+                                c = 'p';
+                        }
+                        sprintf(token, "%c ", c);
+                        if (c == 'd') {
+                                depth++;
+                        } else if (c == 'p') {
+                                depth--;
+                        }
+                        break;
+                }
+                case PRINT:
+                        sprintf(token, "\n");
+                        break;
+                case ZERO:
+                        sprintf(token, "z ");
+                        depth = 0;
+                        break;
+                default:
+                        sprintf(token, "%c ", bad[random_below(&state, 4)]);
+                        break;
+                }
+                append_string(input, token);
+        }
+        if (depth <= PRINT_DEPTH) {
+                append_string(input, "\n");
+        }
+}
+
+/* calc40 prints values as signed words */
+static void print_value(struct buffer *output, uint32_t value)
+{
+        char line[32];
+        sprintf(line, ">>> %" PRId64 "\n", value > INT32_MAX ?
+                (int64_t) value - ((int64_t) 1 << 32) : (int64_t) value);
+        append_string(output, line);
+}
+
+/**********************************evaluate************************************
+ *
+ * Works out what calc40 prints for an input
+ * Inputs:
+ *         const char *input:     The input
+ *         size_t length:         Its length in bytes
+ *         struct buffer *output: Where the output is appended
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         Follows calc40.ums, including its messages and its division,
+ *         which rounds towards zero. A digit straight after a number adds
+ *         a digit to it. CRE if the stack cannot grow.
+ *****************************************************************************/
+static void evaluate(const char *input, size_t length, struct buffer *output)
+{
+        uint32_t *stack = NULL;
+        size_t depth = 0, capacity = 0;
+        bool entering = false;
+
+        for (size_t i = 0; i < length; i++) {
+                unsigned char c = input[i];
+                if (c >= '0' && c <= '9') {
+                        if (entering) {
+                                stack[depth - 1] = stack[depth - 1] * 10 +
+                                                   (c - '0');
+                                continue;
+                        }
+                        if (depth == capacity) {
+                                capacity = capacity == 0 ? 64 : capacity * 2;
+                                stack = realloc(stack,
+                                                capacity * sizeof(uint32_t));
+                                assert(stack);
+                        }
+                        stack[depth++] = c - '0';
+                        entering = true;
+                        continue;
+                }
+                entering = false;
+
+                if (c == ' ') {
+                        continue;
+                } else if (c == '\n') {
+                        for (size_t v = depth; v > 0; v--) {
+                                print_value(output, stack[v - 1]);
+                        }
+                } else if (c != '\0' && strchr("+-*/|&s", c) != NULL) {
+                        if (depth < 2) {
+                                append_string(output, "Stack underflow---"
+                                              "expected at least 2 "
+                                              "elements\n");
+                                continue;
+                        }
+                        uint32_t y = stack[depth - 1], x = stack[depth - 2];
+                        uint32_t *result = &stack[depth - 2];
+                        switch (c) {
+                        case '+': *result = x + y; break;
+                        case '-': *result = x - y; break;
+                        case '*': *result = x * y; break;
+                        case '|': *result = x | y; break;
+                        case '&': *result = x & y; break;
+                        case 's':
+                                stack[depth - 2] = y;
+                                stack[depth - 1] = x;
+                                continue;
+                        default:
+                                if (y == 0) {
+                                        append_string(output, "Division by "
+                                                      "zero\n");
+                                        continue;
+                                }
+                                int64_t n = (int32_t) x, d = (int32_t) y;
+                                *result = (uint32_t) (n / d);
+                                break;
+                        }
+                        depth--;
+                } else if (c != '\0' && strchr("c~dp", c) != NULL) {
+                        if (depth < 1) {
+                                append_string(output, "Stack underflow---"
+                                              "expected at least 1 "
+                                              "element\n");
+                                continue;
+                        }
+                        if (c == 'c') {
+                                stack[depth - 1] = -stack[depth - 1];
+                        } else if (c == '~') {
+                                stack[depth - 1] = ~stack[depth - 1];
+                        } else if (c == 'p') {
+                                depth--;
+                        } else {
+                                if (depth == capacity) {
+                                        capacity *= 2;
+                                        stack = realloc(stack, capacity *
+                                                        sizeof(uint32_t));
+                                        assert(stack);
+                                }
+                                stack[depth] = stack[depth - 1];
+                                depth++;
+                        }
+                } else if (c == 'z') {
+                        depth = 0;
+                } else {
+                        append_string(output, "Unknown character '");
+                        append(output, (const char *) &input[i], 1);
+                        append_string(output, "'\n");
+                }
+        }
+        free(stack);
+}
+
+/*************************************run**************************************
+ *
+ * Runs calc40 under an engine, from and to files
+ * Inputs:
+ *         const char *engine: Path of the engine
+ *         const char *calc40: Path of calc40.um
+ *         const char *input:  File given as standard input
+ *         const char *output: File standard output is written to
+ *         const char *dir:    Directory to run in, or NULL for this one
+ *         char *failure:      Where why the run failed is written, at least
+ *                             FAILURE_SIZE bytes
+ * Return: the wall-clock time it took in nanoseconds, or 0 if the engine
+ *         could not be run or did not exit with status 0
+ * Expects:
+ *         the paths to be absolute if dir is not NULL
+ * Notes:
+ *         Standard error goes to a temporary file. If the run fails,
+ *         failure gets the exit status or signal and the first line the
+ *         engine wrote there, which for a UM fault says where calc40 was
+ *****************************************************************************/
+static uint64_t run(const char *engine, const char *calc40, const char *input,
+                    const char *output, const char *dir, char *failure)
+{
+        char errors[] = "/tmp/calcbench-errors.XXXXXX";
+        int err = mkstemp(errors);
+        if (err < 0) {
+                perror("calcbench: mkstemp");
+                sprintf(failure, "could not run");
+                return 0;
+        }
+        uint64_t start = now_ns();
+        pid_t pid = fork();
+        if (pid < 0) {
+                perror("calcbench: fork");
+                return 0;
+        }
+        if (pid == 0) {
+                int in = open(input, O_RDONLY);
+                int out = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+                if (in < 0 || out < 0 || dup2(in, 0) < 0 || dup2(out, 1) < 0 ||
+                    dup2(err, 2) < 0 || (dir != NULL && chdir(dir) != 0)) {
+                        perror("calcbench");
+                        _exit(127);
+                }
+                execl(engine, engine, calc40, (char *) NULL);
+                perror(engine);
+                _exit(127);
+        }
+
+        int status;
+        pid_t waited = waitpid(pid, &status, 0);
+        uint64_t elapsed = now_ns() - start;
+        bool ok = waited == pid && WIFEXITED(status) &&
+                  WEXITSTATUS(status) == 0;
+        if (!ok) {
+                char line[FAILURE_SIZE / 2] = "";
+                /* the engine's writes moved the shared offset to the end */
+                FILE *fp = lseek(err, 0, SEEK_SET) == 0 ?
+                           fdopen(dup(err), "r") : NULL;
+                if (fp != NULL) {
+                        if (fgets(line, sizeof(line), fp) == NULL) {
+                                line[0] = '\0';
+                        }
+                        line[strcspn(line, "\n")] = '\0';
+                        fclose(fp);
+                }
+                if (waited != pid) {
+                        snprintf(failure, FAILURE_SIZE, "could not wait");
+                } else if (WIFSIGNALED(status)) {
+                        snprintf(failure, FAILURE_SIZE, "killed by signal "
+                                 "%d%s%s", WTERMSIG(status),
+                                 line[0] ? ": " : "", line);
+                } else {
+                        snprintf(failure, FAILURE_SIZE, "exit %d%s%s",
+                                 WEXITSTATUS(status), line[0] ? ": " : "",
+                                 line);
+                }
+        }
+        close(err);
+        unlink(errors);
+        if (!ok) {
+                return 0;
+        }
+        return elapsed > 0 ? elapsed : 1;
+}
+
+/**********************************matches*************************************
+ *
+ * Compares a file with the expected output
+ * Inputs:
+ *         const char *path:       The file
+ *         struct buffer *expect:  What it should hold
+ *         char *verdict:          Where "ok" or where it differs is written,
+ *                                 at least 64 bytes
+ * Return: true if the file holds exactly the expected bytes
+ * Expects:
+ *         none
+ * Notes:
+ *         none
+ *****************************************************************************/
+static bool matches(const char *path, struct buffer *expect, char *verdict)
+{
+        FILE *fp = fopen(path, "rb");
+        if (fp == NULL) {
+                sprintf(verdict, "no output");
+                return false;
+        }
+        char chunk[65536];
+        size_t offset = 0, line = 1, n;
+        while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+                for (size_t i = 0; i < n; i++, offset++) {
+                        if (offset >= expect->length ||
+                            chunk[i] != expect->bytes[offset]) {
+                                fclose(fp);
+                                sprintf(verdict, "differs at line %zu", line);
+                                return false;
+                        }
+                        line += chunk[i] == '\n';
+                }
+        }
+        fclose(fp);
+        if (offset < expect->length) {
+                sprintf(verdict, "ends early at line %zu", line);
+                return false;
+        }
+        sprintf(verdict, "ok");
+        return true;
+}
+
+/**********************************count***************************************
+ *
+ * Counts the UM instructions calc40 executes on the input, with um-profile
+ * Inputs:
+ *         const char *calc40: Absolute path of calc40.um
+ *         const char *input:  Absolute path of the input
+ *         struct buffer *expect: The expected output
+ * Return: the number of instructions, or 0 if um-profile is not built or
+ *         its run failed or printed the wrong output
+ * Expects:
+ *         none
+ * Notes:
+ *         um-profile writes um.prof in the directory it runs in, so it is
+ *         run in a temporary one
+ *****************************************************************************/
+static uint64_t count(const char *calc40, const char *input,
+                      struct buffer *expect)
+{
+        char engine[PATH_MAX], dir[] = "/tmp/calcbench.XXXXXX";
+        char output[PATH_MAX], prof[PATH_MAX], verdict[FAILURE_SIZE];
+        if (realpath("um-profile", engine) == NULL ||
+            access(engine, X_OK) != 0 || mkdtemp(dir) == NULL) {
+                return 0;
+        }
+        snprintf(output, sizeof(output), "%s/output", dir);
+        snprintf(prof, sizeof(prof), "%s/um.prof", dir);
+
+        uint64_t instructions = 0;
+        if (run(engine, calc40, input, output, dir, verdict) != 0 &&
+            matches(output, expect, verdict)) {
+                FILE *fp = fopen(prof, "r");
+                if (fp == NULL || fscanf(fp, "# um profile: %" SCNu64,
+                                         &instructions) != 1) {
+                        instructions = 0;
+                }
+                if (fp != NULL) {
+                        fclose(fp);
+                }
+        } else {
+                fprintf(stderr, "calcbench: um-profile: %s\n", verdict);
+        }
+        unlink(output);
+        unlink(prof);
+        rmdir(dir);
+        return instructions;
+}
+
+/* Reads kind=weight,... into mix; false if it names no known kind */
+static bool parse_mix(const char *spec, unsigned *mix)
+{
+        char *copy = strdup(spec);
+        assert(copy);
+        bool ok = true;
+        for (char *item = strtok(copy, ","); item != NULL && ok;
+             item = strtok(NULL, ",")) {
+                char *equals = strchr(item, '=');
+                ok = false;
+                for (int k = 0; k < KINDS && equals != NULL; k++) {
+                        if (strncmp(item, kind_names[k], equals - item) ==
+                            0 && kind_names[k][equals - item] == '\0') {
+                                mix[k] = (unsigned) strtoul(equals + 1, NULL,
+                                                            10);
+                                ok = true;
+                        }
+                }
+        }
+        free(copy);
+        return ok && (mix[NUMBER] > 0 || mix[ZERO] > 0);
+}
+
+static void usage(void)
+{
+        fprintf(stderr, "Usage: calcbench [-ops N] [-seed N] "
+                "[-mix kind=weight,...] [-depth N]\n"
+                "                 [-calc40 FILE] [-save FILE] [engine ...]\n"
+                "kinds: number arith unary stack print zero bad\n");
+        exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+        uint64_t ops = 2000000, seed = 40, max_depth = 1000000;
+        unsigned mix[KINDS] = { [NUMBER] = 40, [ARITH] = 30, [UNARY] = 5,
+                                [STACK] = 15, [PRINT] = 5, [ZERO] = 1,
+                                [BAD] = 1 };
+        const char *calc40_path = "../asmcoding/calc40.um", *save = NULL;
+
+        int i = 1;
+        for (; i < argc && argv[i][0] == '-'; i++) {
+                if (i + 1 == argc) {
+                        usage();
+                }
+                if (strcmp(argv[i], "-ops") == 0) {
+                        ops = strtoull(argv[++i], NULL, 10);
+                } else if (strcmp(argv[i], "-seed") == 0) {
+                        seed = strtoull(argv[++i], NULL, 10);
+                } else if (strcmp(argv[i], "-depth") == 0) {
+                        max_depth = strtoull(argv[++i], NULL, 10);
+                } else if (strcmp(argv[i], "-calc40") == 0) {
+                        calc40_path = argv[++i];
+                } else if (strcmp(argv[i], "-save") == 0) {
+                        save = argv[++i];
+                } else if (strcmp(argv[i], "-mix") == 0) {
+                        memset(mix, 0, sizeof(mix));
+                        if (!parse_mix(argv[++i], mix)) {
+                                usage();
+                        }
+                } else {
+                        usage();
+                }
+        }
+        if (ops == 0 || max_depth == 0) {
+                usage();
+        }
+
+        char calc40[PATH_MAX];
+        if (realpath(calc40_path, calc40) == NULL) {
+                perror(calc40_path);
+                return EXIT_FAILURE;
+        }
+
+        struct buffer input = { NULL, 0, 0 }, expect = { NULL, 0, 0 };
+        uint64_t counts[KINDS] = { 0 };
+        generate(&input, ops, seed, mix, max_depth, counts);
+
+        uint64_t start = now_ns();
+        evaluate(input.bytes, input.length, &expect);
+        uint64_t native = now_ns() - start;
+
+        char input_path[] = "/tmp/calcbench-input.XXXXXX";
+        char output_path[] = "/tmp/calcbench-output.XXXXXX";
+        int in = mkstemp(input_path), out = mkstemp(output_path);
+        if (in < 0 || out < 0 ||
+            write(in, input.bytes, input.length) != (ssize_t) input.length) {
+                perror("calcbench");
+                return EXIT_FAILURE;
+        }
+        close(in);
+        close(out);
+        if (save != NULL) {
+                FILE *fp = fopen(save, "wb");
+                if (fp == NULL || fwrite(input.bytes, 1, input.length, fp) !=
+                                  input.length) {
+                        perror(save);
+                }
+                if (fp != NULL) {
+                        fclose(fp);
+                }
+        }
+
+        size_t lines = 0;
+        for (size_t b = 0; b < expect.length; b++) {
+                lines += expect.bytes[b] == '\n';
+        }
+        printf("%s: %" PRIu64 " operations (", calc40_path, ops);
+        for (int k = 0; k < KINDS; k++) {
+                printf("%s%s %" PRIu64, k == 0 ? "" : ", ", kind_names[k],
+                       counts[k]);
+        }
+        printf("), seed %" PRIu64 "\n", seed);
+        printf("input %zu bytes, output %zu lines; native evaluator %.1f "
+               "ms\n", input.length, lines, native / 1e6);
+
+        uint64_t instructions = count(calc40, input_path, &expect);
+        if (instructions > 0) {
+                printf("%" PRIu64 " UM instructions, %.1f per operation\n",
+                       instructions, (double) instructions / ops);
+        }
+
+        const char **engines = (const char **) argv + i;
+        int n = argc - i;
+        bool named = n > 0;
+        if (!named) {
+                engines = default_engines;
+                n = sizeof(default_engines) / sizeof(default_engines[0]);
+        }
+
+        bool all_ok = true;
+        int ran = 0, failed = 0;
+        printf("%-14s %10s %12s  %s\n", "engine", "ms", "ops/s", "output");
+        for (int e = 0; e < n; e++) {
+                char engine[PATH_MAX], verdict[FAILURE_SIZE];
+                if (realpath(engines[e], engine) == NULL ||
+                    access(engine, X_OK) != 0) {
+                        if (named) {
+                                printf("%-14s %10s %12s  not found\n",
+                                       engines[e], "-", "-");
+                                all_ok = false;
+                        }
+                        continue;
+                }
+                uint64_t elapsed = run(engine, calc40, input_path,
+                                       output_path, NULL, verdict);
+                ran++;
+                if (elapsed == 0) {
+                        printf("%-14s %10s %12s  failed (%s)\n", engines[e],
+                               "-", "-", verdict);
+                        all_ok = false;
+                        failed++;
+                        continue;
+                }
+                if (!matches(output_path, &expect, verdict)) {
+                        all_ok = false;
+                        failed++;
+                }
+                printf("%-14s %10.1f %12.0f  %s\n", engines[e],
+                       elapsed / 1e6, ops / (elapsed / 1e9), verdict);
+        }
+
+        /*
+         * Engines are checked against each other and against the UM tests;
+         * if none of them can run calc40 on this input, calc40 is at fault
+         */
+        if (ran > 0 && failed == ran) {
+                printf("calc40 failed under every engine: %s itself crashes "
+                       "or prints the wrong output on this input, so no "
+                       "engine was timed.\n", calc40_path);
+        }
+
+        unlink(input_path);
+        unlink(output_path);
+        free(input.bytes);
+        free(expect.bytes);
+        return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,192 @@
+/******************************************************************************
+ *
+ *                                  guard.h
+ *
+ *     Assignment: um
+ *     Authors:    Marten Tropp and Matthew Carey
+ *     Date:       11/20/2023
+ *
+ *     The purpose of this file is to allocate segment storage whose last word
+ *     abuts an inaccessible guard page. Reading or writing past the end of
+ *     such a segment raises SIGSEGV in hardware, so the unchecked engine gets
+ *     bounds checking on SLOAD/SSTORE without a compare on the hot path. The
+ *     SIGSEGV handler hands the faulting address back to the engine, which
+ *     turns it into a UM fault report.
+ *
+ *     Only offsets that land in the guard region are caught. The region is
+ *     GUARD_BYTES long (one page unless overridden at compile time), so an
+ *     offset more than GUARD_BYTES / 4 words past the end may reach other
+ *     memory instead of faulting; use um-checked to catch those. GUARD_BYTES
+ *     must be a multiple of the system page size.
+ *
+ *     mmap, mprotect and sigaction are POSIX, so anything including this file
+ *     must be compiled with -D_DEFAULT_SOURCE.
+ *
+ *****************************************************************************/
+#ifndef GUARD_INCLUDED
+#define GUARD_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#ifndef GUARD_BYTES
+#define GUARD_BYTES 4096
+#endif
+
+/* Mappings of up to GUARD_CACHED data pages are kept for reuse */
+#define GUARD_CACHED 16
+
+static inline uint32_t *Guard_words_new(uint32_t size);
+static inline void Guard_words_free(uint32_t *words, uint32_t size);
+static inline void Guard_install(void handler(void *addr));
+
+/* Free lists of retired mappings, indexed by number of data pages */
+static void *guard_cache[GUARD_CACHED + 1];
+static void (*guard_handler)(void *addr);
+
+/******************************guard_data_bytes********************************
+ *
+ * Returns the number of bytes of readable memory backing a segment
+ * Inputs:
+ *         uint32_t size: The number of words in the segment
+ * Return: size words rounded up to a whole number of pages
+ * Expects:
+ *         none
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline size_t guard_data_bytes(uint32_t size)
+{
+        size_t page = GUARD_BYTES;
+        return ((size_t) size * sizeof(uint32_t) + page - 1) / page * page;
+}
+
+/********************************Guard_words_new*******************************
+ *
+ * Allocates zero-filled storage for a segment that ends at a guard page
+ * Inputs:
+ *         uint32_t size: The number of words in the segment
+ * Return: A pointer to the first word of the segment
+ * Expects:
+ *         none
+ * Notes:
+ *         CRE if the mapping cannot be made
+ *         Small mappings are reused from the cache, which costs a memset
+ *         instead of three system calls
+ *         Storage is released with Guard_words_free
+ *****************************************************************************/
+static inline uint32_t *Guard_words_new(uint32_t size)
+{
+        size_t data = guard_data_bytes(size);
+        size_t pages = data / GUARD_BYTES;
+        size_t bytes = (size_t) size * sizeof(uint32_t);
+        char *base;
+
+        /* Only the words of the segment are reachable, so only they need
+           clearing when a mapping is reused */
+        if (pages <= GUARD_CACHED && guard_cache[pages] != NULL) {
+                base = guard_cache[pages];
+                guard_cache[pages] = *(void **) base;
+                memset(base + data - bytes, 0, bytes);
+        }
+        else {
+                base = mmap(NULL, data + GUARD_BYTES, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                assert(base != MAP_FAILED);
+                int r = mprotect(base + data, GUARD_BYTES, PROT_NONE);
+                assert(r == 0);
+                (void) r;
+        }
+
+        return (uint32_t *) (base + data - bytes);
+}
+
+/*******************************Guard_words_free*******************************
+ *
+ * Releases storage allocated by Guard_words_new
+ * Inputs:
+ *         uint32_t *words: The first word of the segment
+ *         uint32_t size:   The number of words it was allocated with
+ * Return: none
+ * Expects:
+ *         words to come from Guard_words_new(size)
+ * Notes:
+ *         The segment starts less than one page into its mapping, so the
+ *         mapping is found by rounding words down to a page boundary
+ *****************************************************************************/
+static inline void Guard_words_free(uint32_t *words, uint32_t size)
+{
+        size_t data = guard_data_bytes(size);
+        size_t pages = data / GUARD_BYTES;
+        char *base = (char *) ((uintptr_t) words & ~(uintptr_t)
+                                                   (GUARD_BYTES - 1));
+
+        if (pages > 0 && pages <= GUARD_CACHED) {
+                *(void **) base = guard_cache[pages];
+                guard_cache[pages] = base;
+        }
+        else {
+                munmap(base, data + GUARD_BYTES);
+        }
+}
+
+/********************************guard_sigsegv********************************
+ *
+ * SIGSEGV handler that passes the faulting address to the installed handler
+ * Inputs:
+ *         int sig:          The signal number
+ *         siginfo_t *info:  Information about the fault
+ *         void *context:    Unused
+ * Return: none
+ * Expects:
+ *         Guard_install to have been called
+ * Notes:
+ *         The installed handler is expected not to return; if it does, the
+ *         default action is restored so the fault is fatal
+ *****************************************************************************/
+static void guard_sigsegv(int sig, siginfo_t *info, void *context)
+{
+        (void) context;
+        guard_handler(info->si_addr);
+        signal(sig, SIG_DFL);
+}
+
+/*********************************Guard_install********************************
+ *
+ * Installs a handler to be called with the address of any segmentation fault
+ * Inputs:
+ *         void handler(void *addr): Called from the signal handler with the
+ *                                   faulting address
+ * Return: none
+ * Expects:
+ *         handler to not return
+ * Notes:
+ *         The handler runs on an alternate stack so that it still works if
+ *         the fault was a stack overflow
+ *****************************************************************************/
+static inline void Guard_install(void handler(void *addr))
+{
+        static char stack[1 << 16];
+        stack_t ss;
+        ss.ss_sp = stack;
+        ss.ss_size = sizeof(stack);
+        ss.ss_flags = 0;
+        sigaltstack(&ss, NULL);
+
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = guard_sigsegv;
+        sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+        sigemptyset(&sa.sa_mask);
+
+        guard_handler = handler;
+        sigaction(SIGSEGV, &sa, NULL);
+        sigaction(SIGBUS, &sa, NULL);
+}
+
+#endif
@@ -0,0 +1,102 @@
+#!/bin/sh
+#
+# Compares um with um-relocate, which moves hot small segments into one
+# arena (see segment_flat.h), on the same workloads. When perf is available
+# it prints the cache and TLB miss rates counted by the hardware for each
+# engine and workload; otherwise, or when the machine has no counters to
+# read, it prints only the wall-clock time in milliseconds. Every run's
+# output must match um's (and sandmark.out for sandmark).
+#
+# Usage: ./hotbench.sh
+
+engines="um um-relocate"
+workloads="midmark sandmark advent"
+events="cache-references,cache-misses,L1-dcache-loads,L1-dcache-load-misses"
+events="$events,dTLB-loads,dTLB-load-misses"
+
+# run_workload engine workload: runs one workload, output on stdout
+run_workload() {
+    case "$2" in
+        midmark)  ./"$1" umbin/midmark.um ;;
+        sandmark) ./"$1" umbin/sandmark.umz ;;
+        advent)   ./"$1" umbin/advent.umz < adventure_input.txt ;;
+    esac
+}
+
+# perf runs this script again to run a single workload under it
+if [ "$1" = "--run" ]; then
+    run_workload "$2" "$3"
+    exit
+fi
+
+make $engines > /dev/null || exit 1
+
+now_ms() {
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+# counted stat_file event: the count perf -x, recorded for event, or "-"
+counted() {
+    count=$(grep -E ",$2(:[a-z]+)?," "$1" | head -n 1 | cut -d, -f1)
+    case "$count" in
+        ''|*[!0-9]*) echo "-" ;;
+        *) echo "$count" ;;
+    esac
+}
+
+# rate misses total: misses per hundred, or "-" if either is unknown
+rate() {
+    if [ "$1" = "-" ] || [ "$2" = "-" ] || [ "$2" -eq 0 ]; then
+        echo "-"
+    else
+        echo "$1 $2" | awk '{ printf "%.2f%%", 100 * $1 / $2 }'
+    fi
+}
+
+perf=false
+if command -v perf > /dev/null 2>&1; then
+    perf=true
+else
+    echo "perf not found: printing wall-clock times only"
+fi
+
+ref=$(mktemp)
+out=$(mktemp)
+stat=$(mktemp)
+trap 'rm -f "$ref" "$out" "$stat"' EXIT
+
+printf "%-10s %-14s %10s %10s %10s %10s\n" "workload" "engine" "ms" \
+       "LLC miss" "L1d miss" "dTLB miss"
+
+for workload in $workloads; do
+    if [ "$workload" = sandmark ]; then
+        cp umbin/sandmark.out "$ref"
+    else
+        run_workload um "$workload" > "$ref"
+    fi
+
+    for engine in $engines; do
+        : > "$stat"
+        start=$(now_ms)
+        if $perf; then
+            perf stat -x, -o "$stat" -e "$events" -- \
+                "$0" --run "$engine" "$workload" > "$out" 2> /dev/null
+        else
+            run_workload "$engine" "$workload" > "$out"
+        fi
+        end=$(now_ms)
+
+        if ! cmp -s "$ref" "$out"; then
+            printf "%-10s %-14s %10s\n" "$workload" "$engine" "wrong"
+            continue
+        fi
+        printf "%-10s %-14s %10s %10s %10s %10s\n" "$workload" "$engine" \
+               $((end - start)) \
+               "$(rate "$(counted "$stat" cache-misses)" \
+                       "$(counted "$stat" cache-references)")" \
+               "$(rate "$(counted "$stat" L1-dcache-load-misses)" \
+                       "$(counted "$stat" L1-dcache-loads)")" \
+               "$(rate "$(counted "$stat" dTLB-load-misses)" \
+                       "$(counted "$stat" dTLB-loads)")"
+    done
+done
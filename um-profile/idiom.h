@@ -0,0 +1,642 @@
+/******************************************************************************
+ *
+ *                                  idiom.h
+ *
+ *     Assignment: um
+ *     Authors:    Marten Tropp and Matthew Carey
+ *     Date:       11/20/2023
+ *
+ *     The purpose of this file is to recognize word-copy and word-fill loops
+ *     in segment zero and run them as native bulk operations. It is used by
+ *     um.h when compiled with -DUM_LOOP_IDIOMS.
+ *
+ *     A loop is a straight-line block of segment zero ending in a LOADP that
+ *     jumps back to the block's first instruction. It qualifies when one
+ *     iteration, worked out symbolically from the registers at the moment
+ *     the back edge is taken, shows that:
+ *
+ *         - every register is left unchanged (invariant), advanced by a
+ *           constant (a counter), or recomputed from scratch each time
+ *         - the block stores exactly once, to a fixed segment at an offset
+ *           that grows by one per iteration, either a fixed value (fill) or
+ *           the word it loaded at such an offset (copy)
+ *         - the LOADP goes back to the block or out of it depending on the
+ *           sign or non-zeroness of a counter-derived value, so the number
+ *           of further iterations can be calculated
+ *
+ *     The engine then does the stores of every iteration but the last at
+ *     once, advances the counters, and lets the last iteration run normally
+ *     so every temporary ends up with its exact value. Whenever a condition
+ *     does not hold (a segment is unmapped, a range runs past the end of a
+ *     segment, the loop would overwrite itself, an operation could fault)
+ *     the loop runs instruction by instruction, exactly as without this file,
+ *     and is not considered again until segment zero changes.
+ *
+ *     These are the loops umasm produces from a store, a counter increment
+ *     and an `if (rX <=s K) goto L` back edge, such as calc40's jump table
+ *     initialization.
+ *
+ *****************************************************************************/
+#ifndef IDIOM_INCLUDED
+#define IDIOM_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+/* Longest loop body, in instructions, that is analyzed */
+#define IDIOM_MAX_BLOCK 64
+
+/* Per-word flags of segment zero: what is known about a loop starting at
+   the word, and whether the word is part of an analyzed loop */
+#define IDIOM_REJECTED  1
+#define IDIOM_CANDIDATE 2
+#define IDIOM_COVERED   4
+
+/********************************Idiom_T***************************************
+ *
+ * What is known about the loops of the current segment zero.
+ * Stores:
+ *         unsigned char *flags: IDIOM_* flags per word of segment zero, or
+ *                               NULL before the first back edge
+ *         uint32_t length:      Number of flags
+ *
+ *****************************************************************************/
+struct Idiom_T {
+        unsigned char *flags;
+        uint32_t length;
+};
+
+/*****************************idiom_value**************************************
+ *
+ * The symbolic value of a register during one iteration, as a function of
+ * the iteration number k counted from the current one.
+ *         IDIOM_CONST:    base, whatever k
+ *         IDIOM_AFFINE:   base + step * k
+ *         IDIOM_QUOTIENT: (base + step * k) / divisor
+ *         IDIOM_SIGN:     the sign bit of base + step * k
+ *         IDIOM_SELECT:   then if test(base + step * k) else otherwise, where
+ *                         test is the sign bit or non-zeroness (is_sign)
+ *         IDIOM_LOADED:   the word loaded by the block's SLOAD
+ *         IDIOM_UNKNOWN:  anything else
+ * stale marks a value that depends on what a register held before the
+ * iteration without being a counter or invariant.
+ *
+ *****************************************************************************/
+enum idiom_kind {
+        IDIOM_CONST, IDIOM_AFFINE, IDIOM_QUOTIENT, IDIOM_SIGN, IDIOM_SELECT,
+        IDIOM_LOADED, IDIOM_UNKNOWN
+};
+
+struct idiom_value {
+        enum idiom_kind kind;
+        bool stale;
+        bool is_sign;
+        uint32_t base;
+        uint32_t step;
+        uint32_t divisor;
+        uint32_t then;
+        uint32_t otherwise;
+};
+
+/* A memory access of the block: segment, offset at iteration 0 */
+struct idiom_access {
+        bool present;
+        uint32_t segment;
+        uint32_t offset;
+};
+
+static inline struct Idiom_T Idiom_new(void);
+static inline void Idiom_free(struct Idiom_T *idioms);
+static inline void Idiom_reset(struct Idiom_T *idioms);
+static inline void Idiom_store(struct Idiom_T *idioms, uint32_t offset);
+static inline void Idiom_run(struct Idiom_T *idioms, struct Segment_T *seg,
+                             uint32_t *r, uint32_t head, uint32_t end);
+static bool idiom_classify(uint32_t *words, uint32_t head, uint32_t end,
+                           int32_t *step, bool *written);
+static bool idiom_iterations(struct idiom_value *target, uint32_t head,
+                             uint64_t *count);
+
+static inline struct Idiom_T Idiom_new(void)
+{
+        struct Idiom_T idioms = { NULL, 0 };
+        return idioms;
+}
+
+static inline void Idiom_free(struct Idiom_T *idioms)
+{
+        free(idioms->flags);
+        idioms->flags = NULL;
+        idioms->length = 0;
+}
+
+/********************************Idiom_reset***********************************
+ *
+ * Forgets every loop, for when segment zero has been replaced or changed
+ *
+ *****************************************************************************/
+static inline void Idiom_reset(struct Idiom_T *idioms)
+{
+        Idiom_free(idioms);
+}
+
+/********************************Idiom_store***********************************
+ *
+ * Notes a store to segment zero
+ * Inputs:
+ *         struct Idiom_T *idioms: The loops of segment zero
+ *         uint32_t offset:        The word stored to
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         A store into an analyzed loop forgets every loop, since the code
+ *         they were analyzed from may have changed
+ *****************************************************************************/
+static inline void Idiom_store(struct Idiom_T *idioms, uint32_t offset)
+{
+        if (offset < idioms->length &&
+            (idioms->flags[offset] & IDIOM_COVERED)) {
+                Idiom_reset(idioms);
+        }
+}
+
+/*********************************idiom_op*************************************
+ *
+ * Extracts the fields of an instruction word
+ *
+ *****************************************************************************/
+static inline uint32_t idiom_op(uint32_t word)
+{
+        return word >> 28;
+}
+
+static inline uint32_t idiom_ra(uint32_t word)
+{
+        return idiom_op(word) == 13 ? (word >> 25) & 7 : (word >> 6) & 7;
+}
+
+static inline uint32_t idiom_rb(uint32_t word)
+{
+        return (word >> 3) & 7;
+}
+
+static inline uint32_t idiom_rc(uint32_t word)
+{
+        return word & 7;
+}
+
+/******************************idiom_classify**********************************
+ *
+ * Finds the counters of a loop: registers that one iteration advances by a
+ * constant
+ * Inputs:
+ *         uint32_t *words:      Segment zero
+ *         uint32_t head, end:   The block, end being its LOADP
+ *         int32_t *step:        Set to each register's advance per
+ *                               iteration (0 for invariants)
+ *         bool *written:        Set for registers that are neither counters
+ *                               nor invariant
+ * Return: false if the block holds an instruction a loop may not contain
+ * Expects:
+ *         end - head < IDIOM_MAX_BLOCK
+ * Notes:
+ *         Tracks each register as a starting register plus a constant;
+ *         every other value is simply "written"
+ *****************************************************************************/
+static bool idiom_classify(uint32_t *words, uint32_t head, uint32_t end,
+                           int32_t *step, bool *written)
+{
+        /* origin[i] is the register whose starting value plus delta[i]
+           register i holds, -1 for a constant (delta), -2 for anything */
+        int origin[8];
+        uint32_t delta[8];
+        int stores = 0, loads = 0;
+
+        for (int i = 0; i < 8; i++) {
+                origin[i] = i;
+                delta[i] = 0;
+        }
+
+        for (uint32_t pc = head; pc < end; pc++) {
+                uint32_t word = words[pc];
+                uint32_t a = idiom_ra(word), b = idiom_rb(word);
+                uint32_t c = idiom_rc(word);
+
+                switch (idiom_op(word)) {
+                case 13:
+                        origin[a] = -1;
+                        delta[a] = word & 0x1ffffff;
+                        break;
+                case 3:
+                        if (origin[b] == -1 && origin[c] != -2) {
+                                origin[a] = origin[c];
+                                delta[a] = delta[b] + delta[c];
+                        }
+                        else if (origin[c] == -1 && origin[b] != -2) {
+                                origin[a] = origin[b];
+                                delta[a] = delta[b] + delta[c];
+                        }
+                        else {
+                                origin[a] = -2;
+                        }
+                        break;
+                case 0:
+                case 4:
+                case 5:
+                case 6:
+                        origin[a] = -2;
+                        break;
+                case 1:
+                        loads++;
+                        origin[a] = -2;
+                        break;
+                case 2:
+                        stores++;
+                        break;
+                default:
+                        return false;
+                }
+        }
+
+        for (int i = 0; i < 8; i++) {
+                step[i] = 0;
+                written[i] = false;
+                if (origin[i] == i && (int32_t) delta[i] != 0 &&
+                    (int32_t) delta[i] != INT32_MIN) {
+                        step[i] = (int32_t) delta[i];
+                }
+                else if (origin[i] != i || delta[i] != 0) {
+                        written[i] = true;
+                }
+        }
+
+        return stores == 1 && loads <= 1 && idiom_op(words[end]) == 12;
+}
+
+/*******************************idiom_binary***********************************
+ *
+ * Combines two symbolic values with ADD, MUL or NAND
+ *
+ *****************************************************************************/
+static struct idiom_value idiom_binary(uint32_t op, struct idiom_value x,
+                                       struct idiom_value y)
+{
+        struct idiom_value v = { IDIOM_UNKNOWN, x.stale || y.stale, false,
+                                 0, 0, 0, 0, 0 };
+
+        if (x.kind == IDIOM_CONST && y.kind == IDIOM_CONST) {
+                v.kind = IDIOM_CONST;
+                v.base = op == 3 ? x.base + y.base :
+                         op == 4 ? x.base * y.base : ~(x.base & y.base);
+                return v;
+        }
+        if (op == 3 && (x.kind == IDIOM_CONST || x.kind == IDIOM_AFFINE) &&
+            (y.kind == IDIOM_CONST || y.kind == IDIOM_AFFINE)) {
+                v.kind = IDIOM_AFFINE;
+                v.base = x.base + y.base;
+                v.step = (x.kind == IDIOM_AFFINE ? x.step : 0) +
+                         (y.kind == IDIOM_AFFINE ? y.step : 0);
+                return v;
+        }
+        if (op == 4 && x.kind == IDIOM_AFFINE && y.kind == IDIOM_CONST) {
+                v.kind = IDIOM_AFFINE;
+                v.base = x.base * y.base;
+                v.step = x.step * y.base;
+                return v;
+        }
+        if (op == 6 && x.kind == IDIOM_AFFINE && y.kind == IDIOM_AFFINE &&
+            x.base == y.base && x.step == y.step) {
+                /* ~v = -v - 1 */
+                v.kind = IDIOM_AFFINE;
+                v.base = ~x.base;
+                v.step = -x.step;
+                return v;
+        }
+        return v;
+}
+
+/*****************************idiom_iterations*********************************
+ *
+ * Works out how many further iterations a loop runs before leaving
+ * Inputs:
+ *         struct idiom_value *target: The jump target of the block's LOADP
+ *         uint32_t head:              The first instruction of the block
+ *         uint64_t *count:            Set to the number of iterations, from
+ *                                     the one about to start, that jump back
+ * Return: false if the number cannot be calculated or is infinite
+ * Expects:
+ *         none
+ * Notes:
+ *         The tested value moves by step each iteration, so the sign bit
+ *         first changes when it crosses zero or wraps around, whichever it
+ *         reaches first
+ *****************************************************************************/
+static bool idiom_iterations(struct idiom_value *target, uint32_t head,
+                             uint64_t *count)
+{
+        if (target->kind != IDIOM_SELECT || target->stale ||
+            (target->then == head) == (target->otherwise == head)) {
+                return false;
+        }
+        bool want = target->then == head;
+        int64_t v = (int32_t) target->base;
+        int64_t s = (int32_t) target->step;
+        bool now = target->is_sign ? v < 0 : v != 0;
+
+        if (now != want) {
+                *count = 0;
+                return true;
+        }
+        if (s == 0) {
+                return false;
+        }
+
+        if (!target->is_sign) {
+                /* continue while zero: one step makes it non-zero */
+                if (!want) {
+                        *count = 1;
+                }
+                else if (s == 1) {
+                        *count = (uint32_t) -target->base;
+                }
+                else if (s == -1) {
+                        *count = target->base;
+                }
+                else {
+                        return false;
+                }
+                return true;
+        }
+
+        const int64_t wrap = (int64_t) 1 << 31;
+        if (v < 0 && s > 0) {
+                *count = (-v + s - 1) / s;
+        }
+        else if (v < 0) {
+                *count = (v + wrap) / -s + 1;
+        }
+        else if (s < 0) {
+                *count = v / -s + 1;
+        }
+        else {
+                *count = (wrap - 1 - v) / s + 1;
+        }
+        return true;
+}
+
+/*********************************Idiom_run************************************
+ *
+ * Runs all but the last iteration of a copy or fill loop at once
+ * Inputs:
+ *         struct Idiom_T *idioms:  The loops of segment zero
+ *         struct Segment_T *seg:   The machine's memory
+ *         uint32_t *r:             The machine's registers
+ *         uint32_t head:           Target of a LOADP of segment zero
+ *         uint32_t end:            Offset of that LOADP
+ * Return: none
+ * Expects:
+ *         head <= end
+ * Notes:
+ *         Leaves the machine as if the iterations had been executed one
+ *         instruction at a time, except for temporaries that the last
+ *         iteration recomputes. Does nothing if [head, end] is not a loop
+ *         this file can run.
+ *****************************************************************************/
+static inline void Idiom_run(struct Idiom_T *idioms, struct Segment_T *seg,
+                             uint32_t *r, uint32_t head, uint32_t end)
+{
+        uint32_t length = Segment_length(seg, 0);
+        uint32_t *words = Segment_words(seg, 0);
+
+        if (end - head >= IDIOM_MAX_BLOCK || end >= length) {
+                return;
+        }
+        if (idioms->flags == NULL) {
+                idioms->flags = calloc(length, 1);
+                assert(idioms->flags);
+                idioms->length = length;
+        }
+        unsigned char *flags = idioms->flags;
+        if (flags[head] & IDIOM_REJECTED) {
+                return;
+        }
+
+        int32_t step[8];
+        bool written[8];
+        if (!(flags[head] & IDIOM_CANDIDATE)) {
+                for (uint32_t pc = head; pc <= end; pc++) {
+                        flags[pc] |= IDIOM_COVERED;
+                }
+                if (!idiom_classify(words, head, end, step, written)) {
+                        flags[head] |= IDIOM_REJECTED;
+                        return;
+                }
+                flags[head] |= IDIOM_CANDIDATE;
+        }
+        else if (!idiom_classify(words, head, end, step, written)) {
+                flags[head] |= IDIOM_REJECTED;
+                return;
+        }
+
+        /* One iteration, symbolically */
+        struct idiom_value v[8];
+        for (int i = 0; i < 8; i++) {
+                struct idiom_value start = { IDIOM_CONST, false, false, r[i],
+                                             0, 0, 0, 0 };
+                if (step[i] != 0) {
+                        start.kind = IDIOM_AFFINE;
+                        start.step = step[i];
+                }
+                else if (written[i]) {
+                        start.kind = IDIOM_UNKNOWN;
+                        start.stale = true;
+                }
+                v[i] = start;
+        }
+
+        struct idiom_access load = { false, 0, 0 }, store = { false, 0, 0 };
+        bool copy = false, ok = true;
+        uint32_t fill = 0;
+
+        for (uint32_t pc = head; pc < end && ok; pc++) {
+                uint32_t word = words[pc];
+                uint32_t a = idiom_ra(word), b = idiom_rb(word);
+                uint32_t c = idiom_rc(word);
+                struct idiom_value x = v[b], y = v[c];
+                struct idiom_value unknown = { IDIOM_UNKNOWN,
+                                               x.stale || y.stale, false,
+                                               0, 0, 0, 0, 0 };
+
+                switch (idiom_op(word)) {
+                case 13: {
+                        struct idiom_value k = { IDIOM_CONST, false, false,
+                                                 word & 0x1ffffff, 0, 0, 0,
+                                                 0 };
+                        v[a] = k;
+                        break;
+                }
+                case 3:
+                case 4:
+                case 6:
+                        v[a] = idiom_binary(idiom_op(word), x, y);
+                        break;
+                case 5:
+                        /* A divisor that might be zero could fault */
+                        ok = y.kind == IDIOM_CONST && y.base != 0 && !y.stale;
+                        if (!ok) {
+                                break;
+                        }
+                        if (x.kind == IDIOM_CONST) {
+                                v[a] = x;
+                                v[a].base = x.base / y.base;
+                        }
+                        else if ((x.kind == IDIOM_AFFINE ||
+                                  x.kind == IDIOM_QUOTIENT) &&
+                                 (y.base & (y.base - 1)) == 0) {
+                                uint64_t d = (uint64_t) y.base *
+                                             (x.kind == IDIOM_AFFINE ?
+                                              1 : x.divisor);
+                                v[a] = x;
+                                v[a].kind = d == (uint64_t) 1 << 31 ?
+                                            IDIOM_SIGN : IDIOM_QUOTIENT;
+                                v[a].divisor = d;
+                                if (d > (uint64_t) 1 << 31) {
+                                        v[a] = unknown;
+                                }
+                        }
+                        else {
+                                v[a] = unknown;
+                        }
+                        break;
+                case 0:
+                        if (y.kind == IDIOM_CONST) {
+                                if (y.base != 0) {
+                                        v[a] = x;
+                                }
+                                v[a].stale |= y.stale;
+                        }
+                        else if ((y.kind == IDIOM_SIGN ||
+                                  y.kind == IDIOM_AFFINE) &&
+                                 x.kind == IDIOM_CONST &&
+                                 v[a].kind == IDIOM_CONST) {
+                                struct idiom_value s = y;
+                                s.kind = IDIOM_SELECT;
+                                s.is_sign = y.kind == IDIOM_SIGN;
+                                s.then = x.base;
+                                s.otherwise = v[a].base;
+                                s.stale |= x.stale || v[a].stale;
+                                v[a] = s;
+                        }
+                        else {
+                                unknown.stale |= v[a].stale;
+                                v[a] = unknown;
+                        }
+                        break;
+                case 1:
+                        ok = x.kind == IDIOM_CONST && y.kind == IDIOM_AFFINE &&
+                             y.step == 1 && !x.stale && !y.stale;
+                        load.present = true;
+                        load.segment = x.base;
+                        load.offset = y.base;
+                        v[a] = unknown;
+                        v[a].kind = IDIOM_LOADED;
+                        v[a].stale = false;
+                        break;
+                case 2: {
+                        struct idiom_value s = v[a];
+                        ok = s.kind == IDIOM_CONST && x.kind == IDIOM_AFFINE &&
+                             x.step == 1 && !s.stale && !x.stale && !y.stale &&
+                             (y.kind == IDIOM_CONST || y.kind == IDIOM_LOADED);
+                        store.present = true;
+                        store.segment = s.base;
+                        store.offset = x.base;
+                        copy = y.kind == IDIOM_LOADED;
+                        fill = y.base;
+                        break;
+                }
+                default:
+                        ok = false;
+                        break;
+                }
+        }
+
+        /* The iteration must leave each register as it was classified */
+        struct idiom_value zero = v[idiom_rb(words[end])];
+        ok = ok && zero.kind == IDIOM_CONST && zero.base == 0 && !zero.stale;
+        for (int i = 0; i < 8 && ok; i++) {
+                if (step[i] != 0) {
+                        ok = v[i].kind == IDIOM_AFFINE && !v[i].stale &&
+                             v[i].step == (uint32_t) step[i] &&
+                             v[i].base == r[i] + (uint32_t) step[i];
+                }
+                else if (!written[i]) {
+                        ok = v[i].kind == IDIOM_CONST && v[i].base == r[i];
+                }
+                else {
+                        ok = !v[i].stale;
+                }
+        }
+
+        uint64_t count = 0;
+        if (!ok || !idiom_iterations(&v[idiom_rc(words[end])], head, &count)) {
+                flags[head] |= IDIOM_REJECTED;
+                return;
+        }
+        if (count == 0) {
+                return;
+        }
+
+        /* Every access of the skipped iterations must be valid */
+        uint64_t to = (uint64_t) store.offset + count;
+        if (!Segment_is_mapped(seg, store.segment) ||
+            to > Segment_length(seg, store.segment) ||
+            (load.present && (!Segment_is_mapped(seg, load.segment) ||
+                              (uint64_t) load.offset + count >
+                              Segment_length(seg, load.segment))) ||
+            (store.segment == 0 && store.offset <= end && to > head)) {
+                flags[head] |= IDIOM_REJECTED;
+                return;
+        }
+
+        uint32_t *dst = Segment_words(seg, store.segment) + store.offset;
+        if (copy) {
+                uint32_t *src = Segment_words(seg, load.segment) +
+                                load.offset;
+                if (dst > src && dst < src + count) {
+                        /* Overlapping forwards: the loop repeats a pattern */
+                        for (uint64_t k = 0; k < count; k++) {
+                                dst[k] = src[k];
+                        }
+                }
+                else {
+                        memmove(dst, src, count * sizeof(uint32_t));
+                }
+        }
+        else if (fill == 0) {
+                memset(dst, 0, count * sizeof(uint32_t));
+        }
+        else {
+                for (uint64_t k = 0; k < count; k++) {
+                        dst[k] = fill;
+                }
+        }
+
+        for (int i = 0; i < 8; i++) {
+                r[i] += (uint32_t) step[i] * (uint32_t) count;
+        }
+
+        /* The stores may have overwritten other analyzed loops */
+        if (store.segment == 0) {
+                for (uint64_t k = 0; k < count; k++) {
+                        if (flags[store.offset + k] & IDIOM_COVERED) {
+                                Idiom_reset(idioms);
+                                break;
+                        }
+                }
+        }
+}
+
+#endif
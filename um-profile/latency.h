@@ -0,0 +1,311 @@
+/******************************************************************************
+ *
+ *                                 latency.h
+ *
+ *     Assignment: um
+ *     Authors:    Marten Tropp and Matthew Carey
+ *     Date:       11/20/2023
+ *
+ *     The purpose of this file is to measure how long an interactive UM
+ *     program takes to answer each line of input. It is used by um.h when
+ *     compiled with -DUM_LATENCY.
+ *
+ *     An interaction starts when IN delivers the newline (or end of input)
+ *     that completes a line. It is measured, in instructions and wall-clock
+ *     time, until the program's next OUT (when the user starts to see an
+ *     answer) and until its next IN (when the answer is complete and the
+ *     program waits for the user again). Time spent blocked in getchar is
+ *     never counted. When the machine halts the percentiles of the four
+ *     measurements and the slowest interactions are printed to stderr.
+ *
+ *****************************************************************************/
+#ifndef LATENCY_INCLUDED
+#define LATENCY_INCLUDED
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <assert.h>
+
+/* Characters of each line kept to identify it in the report */
+#define LATENCY_TEXT 28
+
+/* Slowest interactions listed in the report */
+#define LATENCY_WORST 5
+
+/*****************************latency_record***********************************
+ *
+ * One interaction.
+ * Stores:
+ *         unsigned line:             Number of the input line, from 1
+ *         char text[]:               Start of the line
+ *         uint64_t out_instructions: Instructions until the next OUT, or
+ *                                    UINT64_MAX if there was none
+ *         double out_seconds:        Time until the next OUT
+ *         uint64_t in_instructions:  Instructions until the next IN or halt
+ *         double in_seconds:         Time until the next IN or halt
+ *
+ *****************************************************************************/
+struct latency_record {
+        unsigned line;
+        char text[LATENCY_TEXT + 1];
+        uint64_t out_instructions;
+        double out_seconds;
+        uint64_t in_instructions;
+        double in_seconds;
+};
+
+/*******************************Latency_T**************************************
+ *
+ * The interactions of one machine.
+ * Stores:
+ *         uint64_t instructions:  Instructions executed so far, counted by
+ *                                 the engine
+ *         bool waiting_out:       The open interaction has not seen an OUT
+ *         bool open:              An interaction is open
+ *         uint64_t start:         Instruction count when it opened
+ *         double started:         Time when it opened
+ *         struct latency_record current: The line being read or answered
+ *         size_t text_length:     Characters of the line kept so far
+ *         struct latency_record *records: Every closed interaction
+ *         size_t n, capacity:     Number of records and room for them
+ *
+ *****************************************************************************/
+struct Latency_T {
+        uint64_t instructions;
+        bool waiting_out;
+        bool open;
+        uint64_t start;
+        double started;
+        struct latency_record current;
+        size_t text_length;
+        struct latency_record *records;
+        size_t n;
+        size_t capacity;
+};
+
+static inline struct Latency_T Latency_new(void);
+static inline void Latency_wait(struct Latency_T *lat);
+static inline void Latency_read(struct Latency_T *lat, uint32_t c);
+static inline void Latency_output(struct Latency_T *lat);
+static void Latency_report(struct Latency_T *lat);
+
+static inline double latency_now(void)
+{
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static inline struct Latency_T Latency_new(void)
+{
+        struct Latency_T lat;
+        memset(&lat, 0, sizeof(lat));
+        lat.current.line = 1;
+        return lat;
+}
+
+/*******************************Latency_wait***********************************
+ *
+ * Notes that the program is about to read input, closing the open
+ * interaction
+ * Inputs:
+ *         struct Latency_T *lat: The machine's interactions
+ * Return: none
+ * Expects:
+ *         Called before IN blocks in getchar
+ * Notes:
+ *         CRE if the record cannot be stored
+ *****************************************************************************/
+static inline void Latency_wait(struct Latency_T *lat)
+{
+        if (!lat->open) {
+                return;
+        }
+        lat->current.in_instructions = lat->instructions - lat->start;
+        lat->current.in_seconds = latency_now() - lat->started;
+        if (lat->waiting_out) {
+                lat->current.out_instructions = UINT64_MAX;
+        }
+
+        if (lat->n == lat->capacity) {
+                lat->capacity = lat->capacity == 0 ? 64 : lat->capacity * 2;
+                lat->records = realloc(lat->records, lat->capacity *
+                                       sizeof(struct latency_record));
+                assert(lat->records);
+        }
+        lat->records[lat->n++] = lat->current;
+
+        lat->open = false;
+        lat->current.line++;
+        lat->current.text[0] = '\0';
+        lat->text_length = 0;
+}
+
+/*******************************Latency_read***********************************
+ *
+ * Notes a character delivered by IN, opening an interaction at a newline
+ * Inputs:
+ *         struct Latency_T *lat: The machine's interactions
+ *         uint32_t c:            The character, ~0 at end of input
+ * Return: none
+ * Expects:
+ *         Called after getchar returns
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline void Latency_read(struct Latency_T *lat, uint32_t c)
+{
+        if (c != '\n' && c != ~(uint32_t)0) {
+                if (lat->text_length < LATENCY_TEXT) {
+                        bool printable = c >= ' ' && c < 127;
+                        lat->current.text[lat->text_length++] =
+                                printable ? (char) c : '?';
+                        lat->current.text[lat->text_length] = '\0';
+                }
+                return;
+        }
+        if (c == ~(uint32_t)0 && lat->text_length == 0) {
+                strcpy(lat->current.text, "(end of input)");
+        }
+        lat->open = true;
+        lat->waiting_out = true;
+        lat->start = lat->instructions;
+        lat->started = latency_now();
+}
+
+/******************************Latency_output**********************************
+ *
+ * Notes an OUT, which answers the open interaction if it is the first
+ *
+ *****************************************************************************/
+static inline void Latency_output(struct Latency_T *lat)
+{
+        if (lat->open && lat->waiting_out) {
+                lat->current.out_instructions = lat->instructions -
+                                                lat->start;
+                lat->current.out_seconds = latency_now() - lat->started;
+                lat->waiting_out = false;
+        }
+}
+
+static int latency_compare_u64(const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+        return (x > y) - (x < y);
+}
+
+static int latency_compare_double(const void *a, const void *b)
+{
+        double x = *(const double *) a, y = *(const double *) b;
+        return (x > y) - (x < y);
+}
+
+static int latency_compare_slowest(const void *a, const void *b)
+{
+        double x = ((const struct latency_record *) a)->in_seconds;
+        double y = ((const struct latency_record *) b)->in_seconds;
+        return (x < y) - (x > y);
+}
+
+/*****************************latency_percentiles******************************
+ *
+ * Prints one row of the report: p50, p90, p99 and maximum of a measurement
+ * Inputs:
+ *         const char *name:         Name of the measurement
+ *         uint64_t *instructions:   Instruction counts, sorted in place
+ *         double *seconds:          Times, sorted in place
+ *         size_t n:                 Number of each
+ * Return: none
+ * Expects:
+ *         n > 0
+ * Notes:
+ *         none
+ *****************************************************************************/
+static void latency_percentiles(const char *name, uint64_t *instructions,
+                                double *seconds, size_t n)
+{
+        static const double points[] = { 0.50, 0.90, 0.99, 1.0 };
+
+        qsort(instructions, n, sizeof(uint64_t), latency_compare_u64);
+        qsort(seconds, n, sizeof(double), latency_compare_double);
+
+        fprintf(stderr, "  %-14s", name);
+        for (int i = 0; i < 4; i++) {
+                size_t at = (size_t) ((n - 1) * points[i]);
+                fprintf(stderr, " %12" PRIu64 " %9.3f", instructions[at],
+                        seconds[at] * 1e3);
+        }
+        fprintf(stderr, "\n");
+}
+
+/******************************Latency_report**********************************
+ *
+ * Prints the percentiles of every interaction and the slowest ones
+ * Inputs:
+ *         struct Latency_T *lat: The machine's interactions
+ * Return: none
+ * Expects:
+ *         Called when the machine halts
+ * Notes:
+ *         An interaction still open at the halt is closed by it. Frees the
+ *         records.
+ *****************************************************************************/
+static void Latency_report(struct Latency_T *lat)
+{
+        Latency_wait(lat);
+
+        fprintf(stderr, "um: %zu interactions, %" PRIu64 " instructions\n",
+                lat->n, lat->instructions);
+        if (lat->n == 0) {
+                free(lat->records);
+                return;
+        }
+
+        uint64_t *instructions = malloc(lat->n * sizeof(uint64_t));
+        double *seconds = malloc(lat->n * sizeof(double));
+        assert(instructions && seconds);
+
+        fprintf(stderr, "  %-14s %22s %22s %22s %22s\n", "(instr, ms)",
+                "p50", "p90", "p99", "max");
+        size_t answered = 0;
+        for (size_t i = 0; i < lat->n; i++) {
+                if (lat->records[i].out_instructions != UINT64_MAX) {
+                        instructions[answered] =
+                                lat->records[i].out_instructions;
+                        seconds[answered++] = lat->records[i].out_seconds;
+                }
+        }
+        if (answered > 0) {
+                latency_percentiles("to next OUT", instructions, seconds,
+                                    answered);
+        }
+        for (size_t i = 0; i < lat->n; i++) {
+                instructions[i] = lat->records[i].in_instructions;
+                seconds[i] = lat->records[i].in_seconds;
+        }
+        latency_percentiles("to next IN", instructions, seconds, lat->n);
+
+        qsort(lat->records, lat->n, sizeof(struct latency_record),
+              latency_compare_slowest);
+        fprintf(stderr, "  slowest:\n");
+        for (size_t i = 0; i < lat->n && i < LATENCY_WORST; i++) {
+                fprintf(stderr, "  line %6u %12" PRIu64 " instr %9.3f ms  "
+                        "\"%s\"\n", lat->records[i].line,
+                        lat->records[i].in_instructions,
+                        lat->records[i].in_seconds * 1e3,
+                        lat->records[i].text);
+        }
+
+        free(instructions);
+        free(seconds);
+        free(lat->records);
+        lat->records = NULL;
+        lat->n = lat->capacity = 0;
+}
+
+#endif
@@ -0,0 +1,152 @@
+/******************************************************************************
+ *
+ *                                 mapbench.c
+ *
+ *     Assignment: um
+ *     Authors:    Marten Tropp and Matthew Carey
+ *     Date:       11/20/2023
+ *
+ *     The purpose of this file is to measure the latency of individual map
+ *     and unmap operations of a segment memory backend, not just their
+ *     average. It maps N segments of WORDS words and keeps them all live,
+ *     unmaps them all, then maps N again (reusing every ID), timing each
+ *     operation, and finally times freeing the whole memory as the halt
+ *     does. Every page of a segment is written to between the timed
+ *     operations, as a program would. For each phase it prints the total
+ *     time and the median, 99.9th and 99.99th percentile and maximum
+ *     latency. A backend whose table is copied as it grows shows it in the
+ *     maximum; freeing large segments on the spot shows in the unmap and
+ *     free times.
+ *
+ *     It is compiled once per backend, with the same flags as the engine.
+ *
+ *     Usage: mapbench [N [WORDS]]  (default 4000000 segments of 1 word)
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "um.h"
+
+static inline uint64_t now_ns(void)
+{
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (uint64_t) t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+/* Words apart that stores are made to touch every page of a segment */
+#define PAGE_WORDS 1024
+
+/***********************************touch**************************************
+ *
+ * Writes to every page of the given segments
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding them
+ *         uint32_t *ids:         Their IDs
+ *         uint32_t n:            Number of segments
+ *         uint32_t words:        Length of each
+ * Return: none
+ * Expects:
+ *         every ID to be mapped with the given length
+ * Notes:
+ *         none
+ *****************************************************************************/
+static void touch(struct Segment_T *seg, uint32_t *ids, uint32_t n,
+                  uint32_t words)
+{
+        for (uint32_t i = 0; i < n; i++) {
+                for (uint32_t w = 0; w < words; w += PAGE_WORDS) {
+                        Segment_load_word(seg, ids[i], w, w + 1);
+                }
+        }
+}
+
+static int compare(const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+        return (x > y) - (x < y);
+}
+
+/**********************************report**************************************
+ *
+ * Prints the total and the latency percentiles of one phase
+ * Inputs:
+ *         const char *phase:  Name of the phase
+ *         uint64_t *latency:  Nanoseconds taken by each operation, sorted
+ *                             in place
+ *         uint32_t n:         Number of operations
+ * Return: none
+ * Expects:
+ *         n > 0
+ * Notes:
+ *         none
+ *****************************************************************************/
+static void report(const char *phase, uint64_t *latency, uint32_t n)
+{
+        uint64_t total = 0;
+        for (uint32_t i = 0; i < n; i++) {
+                total += latency[i];
+        }
+        qsort(latency, n, sizeof(uint64_t), compare);
+
+        printf("%-8s %9.1f %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %11.3f\n",
+               phase, total / 1e6, latency[n / 2],
+               latency[(uint32_t) (n * 0.999)],
+               latency[(uint32_t) (n * 0.9999)], latency[n - 1] / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+        uint32_t n = argc > 1 ? (uint32_t) strtoul(argv[1], NULL, 10) :
+                                4000000;
+        uint32_t words = argc > 2 ? (uint32_t) strtoul(argv[2], NULL, 10) :
+                                    1;
+        if (n == 0 || words == 0 || argc > 3) {
+                fprintf(stderr, "Usage: ./mapbench [N [WORDS]]\n");
+                return EXIT_FAILURE;
+        }
+
+        uint64_t *latency = malloc(n * sizeof(uint64_t));
+        uint32_t *ids = malloc(n * sizeof(uint32_t));
+        assert(latency && ids);
+
+        struct Segment_T seg = Segment_new(1);
+
+        printf("%-8s %9s %9s %9s %9s %11s\n", "phase", "total ms",
+               "p50 ns", "p99.9 ns", "p99.99 ns", "max ms");
+
+        for (uint32_t i = 0; i < n; i++) {
+                uint64_t start = now_ns();
+                ids[i] = Segment_map(&seg, words);
+                latency[i] = now_ns() - start;
+        }
+        report("map", latency, n);
+        touch(&seg, ids, n, words);
+
+        for (uint32_t i = 0; i < n; i++) {
+                uint64_t start = now_ns();
+                Segment_unmap(&seg, ids[i]);
+                latency[i] = now_ns() - start;
+        }
+        report("unmap", latency, n);
+
+        for (uint32_t i = 0; i < n; i++) {
+                uint64_t start = now_ns();
+                ids[i] = Segment_map(&seg, words);
+                latency[i] = now_ns() - start;
+        }
+        report("remap", latency, n);
+        touch(&seg, ids, n, words);
+
+        uint64_t start = now_ns();
+        Segment_free(&seg);
+        latency[0] = now_ns() - start;
+        report("free", latency, 1);
+
+        free(latency);
+        free(ids);
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,345 @@
+/******************************************************************************
+ *
+ *                                 profile.h
+ *
+ *     Assignment: um
+ *     Authors:    Marten Tropp and Matthew Carey
+ *     Date:       11/20/2023
+ *
+ *     The purpose of this file is to profile a UM program by where in
+ *     segment zero its time goes. It is used by um.h when compiled with
+ *     -DUM_PROFILE.
+ *
+ *     Every instruction is counted at its PC, and the time stamp counter
+ *     (or, off x86, the monotonic clock in nanoseconds) is read before each
+ *     one, so the cycles since the previous reading are charged to the
+ *     previous instruction. Reading the counter costs about as much as a
+ *     simple instruction, so cycles are best compared with each other, not
+ *     with an unprofiled run.
+ *
+ *     Calls are recognized by the calling convention of asmcoding: a call
+ *     is a LOADP made while r1 holds the address of the next instruction
+ *     (`goto f linking r1`), and it returns when a later LOADP jumps to that
+ *     address, by whatever register. A return may skip frames, as when a
+ *     procedure unwinds through several callers at once, and a procedure
+ *     that jumps back into its caller ahead of the call instead of
+ *     returning is taken to have returned. The instructions and cycles
+ *     between a call and its return are charged to the called address
+ *     once, even when the procedure is recursive.
+ *
+ *     When the machine halts the counts are written to um.prof in the
+ *     current directory, one line per PC, for umprof to read together with
+ *     the program's symbol map (see asmcoding/umsyms).
+ *
+ *****************************************************************************/
+#ifndef PROFILE_INCLUDED
+#define PROFILE_INCLUDED
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <assert.h>
+
+/* Open calls searched for the target of a jump, newest first */
+#define PROFILE_UNWIND 16
+
+/*******************************profile_frame**********************************
+ *
+ * One call that has not returned.
+ * Stores:
+ *         uint32_t return_pc:    Address the call returns to
+ *         uint32_t entry:        Address that was called
+ *         uint64_t instructions: Instructions executed before the call
+ *         uint64_t cycles:       Counter reading at the call
+ *
+ *****************************************************************************/
+struct profile_frame {
+        uint32_t return_pc;
+        uint32_t entry;
+        uint64_t instructions;
+        uint64_t cycles;
+};
+
+/*******************************Profile_T**************************************
+ *
+ * The profile of one machine.
+ * Stores:
+ *         uint32_t length:           PCs counted, the length of segment zero
+ *         uint64_t *instructions:    Times each PC was executed
+ *         uint64_t *cycles:          Cycles spent in each PC
+ *         uint64_t *calls:           Calls made to each PC
+ *         uint64_t *inclusive_instructions, *inclusive_cycles:
+ *                                    Instructions and cycles between the
+ *                                    calls to each PC and their returns
+ *         uint32_t *active:          Open calls to each PC
+ *         struct profile_frame *frames: The open calls, oldest first
+ *         size_t depth, capacity:    Number of open calls and room for them
+ *         uint64_t total:            Instructions executed so far
+ *         uint64_t last:             Counter reading at the last instruction
+ *         uint32_t last_pc:          PC of the last instruction
+ *         unsigned loads:            Times segment zero was replaced
+ *
+ *****************************************************************************/
+struct Profile_T {
+        uint32_t length;
+        uint64_t *instructions;
+        uint64_t *cycles;
+        uint64_t *calls;
+        uint64_t *inclusive_instructions;
+        uint64_t *inclusive_cycles;
+        uint32_t *active;
+        struct profile_frame *frames;
+        size_t depth;
+        size_t capacity;
+        uint64_t total;
+        uint64_t last;
+        uint32_t last_pc;
+        unsigned loads;
+};
+
+static inline struct Profile_T Profile_new(uint32_t length);
+static inline void Profile_step(struct Profile_T *prof, uint32_t pc);
+static inline void Profile_jump(struct Profile_T *prof, uint32_t pc,
+                                uint32_t target, uint32_t link);
+static void Profile_load(struct Profile_T *prof, uint32_t length);
+static void Profile_write(struct Profile_T *prof, const char *path);
+
+static inline uint64_t profile_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+        return __builtin_ia32_rdtsc();
+#else
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (uint64_t) t.tv_sec * 1000000000u + t.tv_nsec;
+#endif
+}
+
+/********************************profile_grow**********************************
+ *
+ * Makes room for counts of the PCs below length, zeroing the new ones
+ * Inputs:
+ *         struct Profile_T *prof: The profile
+ *         uint32_t length:        The number of PCs to count
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         CRE if the counts cannot be allocated
+ *****************************************************************************/
+static void profile_grow(struct Profile_T *prof, uint32_t length)
+{
+        if (length <= prof->length) {
+                return;
+        }
+        uint64_t **counts[] = { &prof->instructions, &prof->cycles,
+                                &prof->calls, &prof->inclusive_instructions,
+                                &prof->inclusive_cycles };
+        for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+                *counts[i] = realloc(*counts[i], length * sizeof(uint64_t));
+                assert(*counts[i]);
+                memset(*counts[i] + prof->length, 0,
+                       (length - prof->length) * sizeof(uint64_t));
+        }
+        prof->active = realloc(prof->active, length * sizeof(uint32_t));
+        assert(prof->active);
+        memset(prof->active + prof->length, 0,
+               (length - prof->length) * sizeof(uint32_t));
+        prof->length = length;
+}
+
+static inline struct Profile_T Profile_new(uint32_t length)
+{
+        struct Profile_T prof;
+        memset(&prof, 0, sizeof(prof));
+        profile_grow(&prof, length);
+        return prof;
+}
+
+/********************************Profile_step**********************************
+ *
+ * Counts the instruction about to be executed
+ * Inputs:
+ *         struct Profile_T *prof: The machine's profile
+ *         uint32_t pc:            Its PC
+ * Return: none
+ * Expects:
+ *         pc to be in segment zero
+ * Notes:
+ *         Charges the cycles since the last call to the last instruction;
+ *         loading the program before the first is not charged
+ *****************************************************************************/
+static inline void Profile_step(struct Profile_T *prof, uint32_t pc)
+{
+        uint64_t now = profile_clock();
+        if (prof->total > 0) {
+                prof->cycles[prof->last_pc] += now - prof->last;
+        }
+        prof->last = now;
+        prof->last_pc = pc;
+        prof->instructions[pc]++;
+        prof->total++;
+}
+
+/*******************************profile_return*********************************
+ *
+ * Closes the newest open call
+ * Inputs:
+ *         struct Profile_T *prof: The machine's profile
+ * Return: none
+ * Expects:
+ *         an open call
+ * Notes:
+ *         Only the outermost of recursive calls to a PC is charged, so that
+ *         its inclusive counts are not counted more than once
+ *****************************************************************************/
+static inline void profile_return(struct Profile_T *prof)
+{
+        struct profile_frame *frame = &prof->frames[--prof->depth];
+        if (--prof->active[frame->entry] == 0) {
+                prof->inclusive_instructions[frame->entry] +=
+                        prof->total - frame->instructions;
+                prof->inclusive_cycles[frame->entry] +=
+                        prof->last - frame->cycles;
+        }
+}
+
+/********************************Profile_jump**********************************
+ *
+ * Notes a LOADP, which may be a call, a return or neither
+ * Inputs:
+ *         struct Profile_T *prof: The machine's profile
+ *         uint32_t pc:            PC of the LOADP
+ *         uint32_t target:        PC it jumps to
+ *         uint32_t link:          The value of r1
+ * Return: none
+ * Expects:
+ *         Called after Profile_step for the LOADP, and after Profile_load
+ *         if the LOADP replaced segment zero
+ * Notes:
+ *         A jump to the next instruction is never a call. A jump into a
+ *         caller's code between its start and the call leaves every call
+ *         made since, as calc40's commands do with `goto waiting`. CRE if
+ *         the open calls cannot be stored.
+ *****************************************************************************/
+static inline void Profile_jump(struct Profile_T *prof, uint32_t pc,
+                                uint32_t target, uint32_t link)
+{
+        size_t stop = prof->depth > PROFILE_UNWIND ?
+                      prof->depth - PROFILE_UNWIND : 0;
+        for (size_t i = prof->depth; i > stop; i--) {
+                if (prof->frames[i - 1].return_pc == target) {
+                        while (prof->depth >= i) {
+                                profile_return(prof);
+                        }
+                        return;
+                }
+        }
+
+        if (link == pc + 1 && target != link && target < prof->length) {
+                if (prof->depth == prof->capacity) {
+                        prof->capacity = prof->capacity == 0 ? 64 :
+                                         prof->capacity * 2;
+                        prof->frames = realloc(prof->frames, prof->capacity *
+                                               sizeof(struct profile_frame));
+                        assert(prof->frames);
+                }
+                struct profile_frame frame = { link, target, prof->total,
+                                               prof->last };
+                prof->frames[prof->depth++] = frame;
+                prof->active[target]++;
+                prof->calls[target]++;
+                return;
+        }
+
+        for (size_t i = prof->depth; i > stop + 1; i--) {
+                struct profile_frame *callee = &prof->frames[i - 1];
+                if (target >= prof->frames[i - 2].entry &&
+                    target < callee->return_pc && target < callee->entry) {
+                        while (prof->depth >= i) {
+                                profile_return(prof);
+                        }
+                        return;
+                }
+        }
+}
+
+/********************************Profile_load**********************************
+ *
+ * Notes that segment zero was replaced
+ * Inputs:
+ *         struct Profile_T *prof: The machine's profile
+ *         uint32_t length:        The length of the new segment zero
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         Counts for the old and new programs are kept at the same PCs, so
+ *         the report warns that they are mixed
+ *****************************************************************************/
+static void Profile_load(struct Profile_T *prof, uint32_t length)
+{
+        profile_grow(prof, length);
+        prof->loads++;
+}
+
+/********************************Profile_write*********************************
+ *
+ * Writes the profile and frees it
+ * Inputs:
+ *         struct Profile_T *prof: The machine's profile
+ *         const char *path:       File to write
+ * Return: none
+ * Expects:
+ *         Called when the machine halts
+ * Notes:
+ *         Calls still open at the halt are closed by it. Only PCs that were
+ *         executed or called are written. Reports to stderr, and writes
+ *         nothing, if the file cannot be opened.
+ *****************************************************************************/
+static void Profile_write(struct Profile_T *prof, const char *path)
+{
+        uint64_t now = profile_clock();
+        prof->cycles[prof->last_pc] += now - prof->last;
+        prof->last = now;
+        while (prof->depth > 0) {
+                profile_return(prof);
+        }
+
+        FILE *fp = fopen(path, "w");
+        if (fp == NULL) {
+                fprintf(stderr, "um: cannot write profile to %s\n", path);
+        } else {
+                fprintf(fp, "# um profile: %" PRIu64 " instructions, %u "
+                        "program loads\n", prof->total, prof->loads);
+                fprintf(fp, "# pc instructions cycles calls "
+                        "inclusive_instructions inclusive_cycles\n");
+                for (uint32_t pc = 0; pc < prof->length; pc++) {
+                        if (prof->instructions[pc] == 0 &&
+                            prof->calls[pc] == 0) {
+                                continue;
+                        }
+                        fprintf(fp, "%" PRIu32 " %" PRIu64 " %" PRIu64 " %"
+                                PRIu64 " %" PRIu64 " %" PRIu64 "\n", pc,
+                                prof->instructions[pc], prof->cycles[pc],
+                                prof->calls[pc],
+                                prof->inclusive_instructions[pc],
+                                prof->inclusive_cycles[pc]);
+                }
+                fclose(fp);
+        }
+
+        free(prof->instructions);
+        free(prof->cycles);
+        free(prof->calls);
+        free(prof->inclusive_instructions);
+        free(prof->inclusive_cycles);
+        free(prof->active);
+        free(prof->frames);
+        memset(prof, 0, sizeof(*prof));
+}
+
+#endif
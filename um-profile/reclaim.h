@@ -0,0 +1,209 @@
+/******************************************************************************
+ *
+ *                                 reclaim.h
+ *
+ *     Assignment: um
+ *     Authors:    Marten Tropp and Matthew Carey
+ *     Date:       11/20/2023
+ *
+ *     The purpose of this file is to take freeing memory off the critical
+ *     path of the engine. It is used by the flat and chunked segment
+ *     backends when compiled with -DUM_RECLAIM.
+ *
+ *     Memory to be released is pushed onto a lock-free stack, and a
+ *     background thread started by the first push takes the whole stack at
+ *     once and releases it. A push is a compare-and-swap, plus a sem_post
+ *     when the stack was empty, so unmapping a segment of any size and
+ *     freeing a machine with any number of segments take the same short
+ *     time. Several threads may push at once (umserver's workers do).
+ *
+ *     Blocks smaller than RECLAIM_MIN_BYTES are cheaper to free in place
+ *     than to queue and are freed at once. A large block carries its own
+ *     queue entry in its first bytes, so queueing it allocates nothing.
+ *
+ *     The thread runs as SCHED_BATCH where it is available, so that waking
+ *     it never preempts the engine on the same CPU; it still gets its fair
+ *     share, so memory does not pile up behind a busy engine. Memory still
+ *     queued when the process exits is returned to the operating system
+ *     with the rest of it.
+ *
+ *****************************************************************************/
+#ifndef RECLAIM_INCLUDED
+#define RECLAIM_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+
+/* Blocks at least this large are released by the background thread */
+#define RECLAIM_MIN_BYTES (64 * 1024)
+
+/*******************************Reclaim_node***********************************
+ *
+ * One piece of memory waiting to be released.
+ * Stores:
+ *         struct Reclaim_node *next: The entry pushed before it
+ *         void (*release)(void *):   Releases the memory
+ *         void *arg:                 What release is called with
+ *         bool allocated:            The entry was allocated for the queue
+ *                                    and is freed after release
+ *
+ *****************************************************************************/
+struct Reclaim_node {
+        struct Reclaim_node *next;
+        void (*release)(void *);
+        void *arg;
+        bool allocated;
+};
+
+static inline void Reclaim_block(void *block, size_t bytes);
+static inline void Reclaim_call(void (*release)(void *), void *arg);
+
+/* The stack of queued entries, the semaphore the thread sleeps on while
+   it is empty and the guard that starts the thread once */
+static struct Reclaim_node *reclaim_head = NULL;
+static sem_t reclaim_ready;
+static pthread_once_t reclaim_once = PTHREAD_ONCE_INIT;
+
+/*******************************reclaim_thread*********************************
+ *
+ * Releases queued memory until the process exits
+ * Inputs:
+ *         void *arg: unused
+ * Return: never returns
+ * Expects:
+ *         reclaim_ready to be initialized
+ * Notes:
+ *         Entries are released oldest first. An entry is copied before it
+ *         is released, since a large block holds its own entry.
+ *****************************************************************************/
+static void *reclaim_thread(void *arg)
+{
+        (void) arg;
+#ifdef SCHED_BATCH
+        struct sched_param param = { 0 };
+        pthread_setschedparam(pthread_self(), SCHED_BATCH, &param);
+#endif
+        for (;;) {
+                while (sem_wait(&reclaim_ready) != 0) {
+                        /* interrupted by a signal */
+                }
+                struct Reclaim_node *node =
+                        __atomic_exchange_n(&reclaim_head, NULL,
+                                            __ATOMIC_ACQUIRE);
+
+                struct Reclaim_node *oldest = NULL;
+                while (node != NULL) {
+                        struct Reclaim_node *next = node->next;
+                        node->next = oldest;
+                        oldest = node;
+                        node = next;
+                }
+
+                while (oldest != NULL) {
+                        struct Reclaim_node entry = *oldest;
+                        entry.release(entry.arg);
+                        if (entry.allocated) {
+                                free(oldest);
+                        }
+                        oldest = entry.next;
+                }
+        }
+        return NULL;
+}
+
+static void reclaim_start(void)
+{
+        pthread_t thread;
+        pthread_attr_t attr;
+
+        int failed = sem_init(&reclaim_ready, 0, 0);
+        failed |= pthread_attr_init(&attr);
+        failed |= pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        failed |= pthread_create(&thread, &attr, reclaim_thread, NULL);
+        assert(failed == 0);
+        (void) failed;
+        pthread_attr_destroy(&attr);
+}
+
+/*******************************reclaim_push***********************************
+ *
+ * Queues an entry for the background thread
+ * Inputs:
+ *         struct Reclaim_node *node: The entry, with everything but next
+ *                                    set
+ * Return: none
+ * Expects:
+ *         node not to be queued already
+ * Notes:
+ *         Starts the thread on the first call. Wakes it only when the
+ *         stack was empty, since otherwise it has a wake-up pending.
+ *****************************************************************************/
+static inline void reclaim_push(struct Reclaim_node *node)
+{
+        pthread_once(&reclaim_once, reclaim_start);
+
+        struct Reclaim_node *head = __atomic_load_n(&reclaim_head,
+                                                    __ATOMIC_RELAXED);
+        do {
+                node->next = head;
+        } while (!__atomic_compare_exchange_n(&reclaim_head, &head, node,
+                                              true, __ATOMIC_RELEASE,
+                                              __ATOMIC_RELAXED));
+        if (head == NULL) {
+                sem_post(&reclaim_ready);
+        }
+}
+
+/*******************************Reclaim_block**********************************
+ *
+ * Frees a block from malloc, in the background if it is large
+ * Inputs:
+ *         void *block:  The block
+ *         size_t bytes: Its size
+ * Return: none
+ * Expects:
+ *         block to come from malloc or calloc, and not to be used again
+ * Notes:
+ *         A large block's queue entry is written over its first bytes
+ *****************************************************************************/
+static inline void Reclaim_block(void *block, size_t bytes)
+{
+        if (bytes < RECLAIM_MIN_BYTES) {
+                free(block);
+                return;
+        }
+        struct Reclaim_node *node = block;
+        node->release = free;
+        node->arg = block;
+        node->allocated = false;
+        reclaim_push(node);
+}
+
+/*******************************Reclaim_call***********************************
+ *
+ * Has the background thread call a function to release memory
+ * Inputs:
+ *         void (*release)(void *): The function
+ *         void *arg:               What it is called with
+ * Return: none
+ * Expects:
+ *         release to be safe to call from another thread
+ * Notes:
+ *         CRE if the queue entry cannot be allocated
+ *****************************************************************************/
+static inline void Reclaim_call(void (*release)(void *), void *arg)
+{
+        struct Reclaim_node *node = malloc(sizeof(struct Reclaim_node));
+        assert(node);
+        node->release = release;
+        node->arg = arg;
+        node->allocated = true;
+        reclaim_push(node);
+}
+
+#endif
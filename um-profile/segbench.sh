@@ -0,0 +1,67 @@
+#!/bin/sh
+#
+# Runs every segment memory backend over the same workloads and prints the
+# best wall-clock time of each in milliseconds. Every backend's output must
+# match the flat backend's (and sandmark.out for sandmark), or the run is
+# reported as wrong instead of timed.
+#
+# Usage: ./segbench.sh [runs]     (default 3 runs per engine and workload)
+
+runs=${1:-3}
+engines="um um-slab um-seq um-chunked"
+workloads="midmark sandmark advent"
+
+make $engines > /dev/null || exit 1
+
+# run_workload engine workload: runs one workload, output on stdout
+run_workload() {
+    case "$2" in
+        midmark)  ./"$1" umbin/midmark.um ;;
+        sandmark) ./"$1" umbin/sandmark.umz ;;
+        advent)   ./"$1" umbin/advent.umz < adventure_input.txt ;;
+    esac
+}
+
+now_ms() {
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+ref=$(mktemp)
+out=$(mktemp)
+trap 'rm -f "$ref" "$out"' EXIT
+
+printf "%-10s" "workload"
+for engine in $engines; do
+    printf "%12s" "$engine"
+done
+printf "\n"
+
+for workload in $workloads; do
+    if [ "$workload" = sandmark ]; then
+        cp umbin/sandmark.out "$ref"
+    else
+        run_workload um "$workload" > "$ref"
+    fi
+
+    printf "%-10s" "$workload"
+    for engine in $engines; do
+        best=""
+        i=0
+        while [ $i -lt "$runs" ]; do
+            start=$(now_ms)
+            run_workload "$engine" "$workload" > "$out"
+            end=$(now_ms)
+            if ! cmp -s "$ref" "$out"; then
+                best="wrong"
+                break
+            fi
+            t=$((end - start))
+            if [ -z "$best" ] || [ $t -lt "$best" ]; then
+                best=$t
+            fi
+            i=$((i + 1))
+        done
+        printf "%12s" "$best"
+    done
+    printf "\n"
+done
@@ -0,0 +1,453 @@
+/******************************************************************************
+ *
+ *                              segment_chunked.h
+ *
+ *     Assignment: um
+ *     Authors:    Marten Tropp and Matthew Carey
+ *     Date:       11/20/2023
+ *
+ *     The purpose of this file is to implement the chunked segment memory
+ *     backend (see um.h). It is the flat backend with a two-level table in
+ *     place of the realloc'd one: an ID's high bits pick a chunk of
+ *     CHUNK_SLOTS segments from a directory of fixed size, and its low bits
+ *     pick the segment within the chunk. The stack of unmapped IDs is kept
+ *     the same way. A new chunk is allocated when the table or the stack
+ *     grows into it, and nothing that exists is ever copied or moved, so no
+ *     map or unmap pays for the ones before it. Looking a segment up is two
+ *     dependent loads with no bounds test.
+ *
+ *****************************************************************************/
+#ifndef SEGMENT_CHUNKED_INCLUDED
+#define SEGMENT_CHUNKED_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#ifdef UM_GUARD_PAGES
+#include "guard.h"
+#endif
+
+#ifdef UM_RECLAIM
+#include "reclaim.h"
+#endif
+
+/* An ID is DIRECTORY_BITS of chunk number followed by CHUNK_BITS of slot */
+#define CHUNK_BITS 14
+#define CHUNK_SLOTS (1u << CHUNK_BITS)
+#define CHUNK_MASK (CHUNK_SLOTS - 1)
+#define DIRECTORY_SLOTS (1u << (32 - CHUNK_BITS))
+
+/**********************************line_T**************************************
+ *
+ * A single segment of memory.
+ * Stores:
+ *         uint32_t *words: The words of the segment, NULL when unmapped
+ *         unsigned length: The number of words in the segment
+ *
+ *****************************************************************************/
+struct line_T {
+        uint32_t *words;
+        unsigned length;
+};
+
+/********************************Segment_T*************************************
+ *
+ * A UM's entire segmented memory.
+ * Stores:
+ *         struct line_T **chunks: Directory of chunks of segments, indexed
+ *                                 by the high bits of an ID; a chunk is
+ *                                 NULL until an ID in it is handed out
+ *         uint32_t numSegs:       Number of IDs handed out so far
+ *         uint32_t **IDs:         Directory of chunks of the stack of
+ *                                 unmapped IDs to be reused
+ *         uint32_t numIDs:        Number of IDs on the stack
+ *
+ *****************************************************************************/
+struct Segment_T {
+        struct line_T **chunks;
+        uint32_t numSegs;
+
+        uint32_t **IDs;
+        uint32_t numIDs;
+};
+
+static inline struct Segment_T Segment_new(uint32_t size);
+static inline void Segment_free(struct Segment_T *seg);
+static inline uint32_t Segment_map(struct Segment_T *seg, uint32_t size);
+static inline void Segment_unmap(struct Segment_T *seg, uint32_t id);
+static inline uint32_t Segment_word_at(struct Segment_T *seg, uint32_t id,
+                                       uint32_t offset);
+static inline void Segment_load_program(struct Segment_T *seg, uint32_t id);
+static inline void Segment_load_word(struct Segment_T *seg, uint32_t id,
+                                     uint32_t offset, uint32_t word);
+static inline bool Segment_is_mapped(struct Segment_T *seg, uint32_t id);
+static inline uint32_t Segment_length(struct Segment_T *seg, uint32_t id);
+static inline uint32_t *Segment_words(struct Segment_T *seg, uint32_t id);
+static inline uint32_t Segment_ids_issued(struct Segment_T *seg);
+static inline uint32_t Segment_ids_free(struct Segment_T *seg);
+static inline struct line_T *line_at(struct Segment_T *seg, uint32_t id);
+static inline uint32_t *words_new(uint32_t size);
+static inline void words_free(uint32_t *words, uint32_t size);
+static void segment_release(void *memory);
+
+/********************************Segment_new***********************************
+ *
+ * Creates a segmented memory with segment zero of the given size
+ * Inputs:
+ *         uint32_t size: The number of 32-bit words in segment zero
+ * Return: A new Segment_T with only segment zero mapped
+ * Expects:
+ *         none
+ * Notes:
+ *         CRE if memory cannot be allocated
+ *         The directories are allocated whole; the operating system only
+ *         backs the pages of them that are used
+ *****************************************************************************/
+static inline struct Segment_T Segment_new(uint32_t size)
+{
+        struct Segment_T seg;
+
+        seg.chunks = calloc(DIRECTORY_SLOTS, sizeof(struct line_T *));
+        seg.IDs = calloc(DIRECTORY_SLOTS, sizeof(uint32_t *));
+        assert(seg.chunks && seg.IDs);
+        seg.numSegs = 0;
+        seg.numIDs = 0;
+
+        Segment_map(&seg, size);
+        return seg;
+}
+
+/********************************Segment_free**********************************
+ *
+ * Frees every mapped segment, every chunk and the directories
+ * Inputs:
+ *         struct Segment_T *seg: The memory to free
+ * Return: none
+ * Expects:
+ *         seg to be non-null
+ * Notes:
+ *         With -DUM_RECLAIM the memory is handed to the background thread
+ *         whole; CRE if it cannot be handed over
+ *****************************************************************************/
+static inline void Segment_free(struct Segment_T *seg)
+{
+#ifdef UM_RECLAIM
+        struct Segment_T *old = malloc(sizeof(struct Segment_T));
+        assert(old);
+        *old = *seg;
+        Reclaim_call(segment_release, old);
+#else
+        segment_release(seg);
+#endif
+}
+
+/******************************segment_release*********************************
+ *
+ * Does the work of Segment_free
+ * Inputs:
+ *         void *memory: The struct Segment_T to free
+ * Return: none
+ * Expects:
+ *         memory to be non-null
+ * Notes:
+ *         With -DUM_RECLAIM it runs on the background thread, frees the
+ *         segments directly rather than queueing them again, and frees
+ *         the copy of the Segment_T made by Segment_free
+ *****************************************************************************/
+static void segment_release(void *memory)
+{
+        struct Segment_T *seg = memory;
+        for (uint32_t id = 0; id < seg->numSegs; id++) {
+                struct line_T *line = line_at(seg, id);
+                if (line->words != NULL) {
+#ifdef UM_RECLAIM
+                        free(line->words);
+#else
+                        words_free(line->words, line->length);
+#endif
+                }
+        }
+
+        for (uint32_t i = 0; i < DIRECTORY_SLOTS; i++) {
+                if (seg->chunks[i] == NULL && seg->IDs[i] == NULL) {
+                        break;
+                }
+                free(seg->chunks[i]);
+                free(seg->IDs[i]);
+        }
+        free(seg->chunks);
+        free(seg->IDs);
+#ifdef UM_RECLAIM
+        free(seg);
+#endif
+}
+
+/********************************Segment_map***********************************
+ *
+ * Maps a new zero-filled segment, reusing an unmapped ID if there is one
+ * Inputs:
+ *         struct Segment_T *seg: The memory to map the segment in
+ *         uint32_t size:         The number of words in the segment
+ * Return: The ID of the new segment
+ * Expects:
+ *         seg to be non-null
+ * Notes:
+ *         CRE if memory cannot be allocated
+ *         The first ID of a chunk allocates the chunk; nothing is copied
+ *****************************************************************************/
+static inline uint32_t Segment_map(struct Segment_T *seg, uint32_t size)
+{
+        struct line_T new_seg = { words_new(size), size };
+        uint32_t id;
+
+        if (seg->numIDs > 0) {
+                seg->numIDs--;
+                id = seg->IDs[seg->numIDs >> CHUNK_BITS]
+                             [seg->numIDs & CHUNK_MASK];
+        }
+        else {
+                id = seg->numSegs++;
+                if ((id & CHUNK_MASK) == 0 &&
+                    seg->chunks[id >> CHUNK_BITS] == NULL) {
+                        seg->chunks[id >> CHUNK_BITS] =
+                                calloc(CHUNK_SLOTS, sizeof(struct line_T));
+                        assert(seg->chunks[id >> CHUNK_BITS]);
+                }
+        }
+
+        *line_at(seg, id) = new_seg;
+        return id;
+}
+
+/********************************Segment_unmap*********************************
+ *
+ * Unmaps a segment and makes its ID available for reuse
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment to unmap
+ * Return: none
+ * Expects:
+ *         id to be a mapped segment other than zero
+ * Notes:
+ *         CRE if memory cannot be allocated
+ *****************************************************************************/
+static inline void Segment_unmap(struct Segment_T *seg, uint32_t id)
+{
+        struct line_T *line = line_at(seg, id);
+        words_free(line->words, line->length);
+        line->words = NULL;
+        line->length = 0;
+
+        uint32_t top = seg->numIDs++;
+        if (seg->IDs[top >> CHUNK_BITS] == NULL) {
+                seg->IDs[top >> CHUNK_BITS] = malloc(CHUNK_SLOTS *
+                                                     sizeof(uint32_t));
+                assert(seg->IDs[top >> CHUNK_BITS]);
+        }
+        seg->IDs[top >> CHUNK_BITS][top & CHUNK_MASK] = id;
+}
+
+/**********************************line_at*************************************
+ *
+ * Returns the slot of an ID in the two-level table
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID
+ * Return: A pointer to the ID's line_T
+ * Expects:
+ *         id to be less than Segment_ids_issued(seg)
+ * Notes:
+ *         No bounds are checked, so the lookup has no branches
+ *****************************************************************************/
+static inline struct line_T *line_at(struct Segment_T *seg, uint32_t id)
+{
+        return &seg->chunks[id >> CHUNK_BITS][id & CHUNK_MASK];
+}
+
+/******************************Segment_word_at*********************************
+ *
+ * Returns the word at an offset of a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment
+ *         uint32_t offset:       The offset of the word
+ * Return: The word at the offset
+ * Expects:
+ *         id to be mapped and offset to be within its length
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline uint32_t Segment_word_at(struct Segment_T *seg, uint32_t id,
+                                       uint32_t offset)
+{
+        return line_at(seg, id)->words[offset];
+}
+
+/****************************Segment_load_program******************************
+ *
+ * Replaces segment zero with a copy of another segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segments
+ *         uint32_t id:           The ID of the segment to duplicate
+ * Return: none
+ * Expects:
+ *         id to be mapped and non-zero
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline void Segment_load_program(struct Segment_T *seg, uint32_t id)
+{
+        struct line_T *zero = line_at(seg, 0);
+        struct line_T *source = line_at(seg, id);
+
+        words_free(zero->words, zero->length);
+        zero->length = source->length;
+        zero->words = words_new(source->length);
+        for (uint32_t i = 0; i < source->length; i++) {
+                zero->words[i] = source->words[i];
+        }
+}
+
+/*****************************Segment_load_word********************************
+ *
+ * Stores a word at an offset of a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment
+ *         uint32_t offset:       The offset to store at
+ *         uint32_t word:         The word to store
+ * Return: none
+ * Expects:
+ *         id to be mapped and offset to be within its length
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline void Segment_load_word(struct Segment_T *seg, uint32_t id,
+                                     uint32_t offset, uint32_t word)
+{
+        line_at(seg, id)->words[offset] = word;
+}
+
+/*****************************Segment_is_mapped********************************
+ *
+ * Determines whether an ID names a mapped segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory to look in
+ *         uint32_t id:           The ID to look up
+ * Return: true if id is mapped, false otherwise
+ * Expects:
+ *         seg to be non-null
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline bool Segment_is_mapped(struct Segment_T *seg, uint32_t id)
+{
+        return id < seg->numSegs && line_at(seg, id)->words != NULL;
+}
+
+/*******************************Segment_length*********************************
+ *
+ * Returns the number of words in a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment
+ * Return: The length of the segment
+ * Expects:
+ *         id to be mapped
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline uint32_t Segment_length(struct Segment_T *seg, uint32_t id)
+{
+        return line_at(seg, id)->length;
+}
+
+/********************************Segment_words*********************************
+ *
+ * Returns the storage of a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment
+ * Return: A pointer to the first word of the segment, NULL if unmapped
+ * Expects:
+ *         id to be less than Segment_ids_issued(seg)
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline uint32_t *Segment_words(struct Segment_T *seg, uint32_t id)
+{
+        return line_at(seg, id)->words;
+}
+
+/*****************************Segment_ids_issued*******************************
+ *
+ * Returns the number of IDs ever handed out, including segment zero
+ *
+ *****************************************************************************/
+static inline uint32_t Segment_ids_issued(struct Segment_T *seg)
+{
+        return seg->numSegs;
+}
+
+/******************************Segment_ids_free********************************
+ *
+ * Returns the number of unmapped IDs waiting to be reused
+ *
+ *****************************************************************************/
+static inline uint32_t Segment_ids_free(struct Segment_T *seg)
+{
+        return seg->numIDs;
+}
+
+/**********************************words_new***********************************
+ *
+ * Allocates zero-filled storage for a segment
+ * Inputs:
+ *         uint32_t size: The number of words in the segment
+ * Return: A pointer to the storage, never NULL
+ * Expects:
+ *         none
+ * Notes:
+ *         CRE if memory cannot be allocated
+ *         A segment of length zero still gets storage so that words is
+ *         non-NULL exactly when the segment is mapped
+ *****************************************************************************/
+static inline uint32_t *words_new(uint32_t size)
+{
+#ifdef UM_GUARD_PAGES
+        return Guard_words_new(size);
+#else
+        uint32_t *words = calloc(size == 0 ? 1 : size, sizeof(uint32_t));
+        assert(words);
+        return words;
+#endif
+}
+
+/*********************************words_free***********************************
+ *
+ * Releases storage allocated by words_new
+ * Inputs:
+ *         uint32_t *words: The storage to release
+ *         uint32_t size:   The number of words it was allocated with
+ * Return: none
+ * Expects:
+ *         words to come from words_new(size)
+ * Notes:
+ *         With -DUM_RECLAIM a large segment is freed in the background
+ *****************************************************************************/
+static inline void words_free(uint32_t *words, uint32_t size)
+{
+#if defined(UM_GUARD_PAGES)
+        Guard_words_free(words, size);
+#elif defined(UM_RECLAIM)
+        Reclaim_block(words, (size == 0 ? 1 : (size_t) size) *
+                             sizeof(uint32_t));
+#else
+        (void) size;
+        free(words);
+#endif
+}
+
+#endif
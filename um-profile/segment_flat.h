@@ -0,0 +1,703 @@
+/******************************************************************************
+ *
+ *                               segment_flat.h
+ *
+ *     Assignment: um
+ *     Authors:    Marten Tropp and Matthew Carey
+ *     Date:       11/20/2023
+ *
+ *     The purpose of this file is to implement the default segment memory
+ *     backend (see um.h): a flat table of segments indexed by ID, with a
+ *     stack of unmapped IDs for reuse. Every segment is a separate calloc,
+ *     or a separate guard-page mapping when compiled with -DUM_GUARD_PAGES.
+ *
+ *     Compiled with -DUM_RELOCATE, the backend counts the loads and stores
+ *     made to each segment but zero. Every RELOCATE_INTERVAL accesses it
+ *     copies the most used small segments, hottest first, into one
+ *     cache-line aligned arena and points their table entries at the
+ *     copies, so that segments used together share cache lines and pages.
+ *     Segments that have gone
+ *     cold are copied back out to their own allocation and the previous
+ *     arena is freed. A segment unmapped while in the arena leaves a hole
+ *     until the next relocation.
+ *
+ *****************************************************************************/
+#ifndef SEGMENT_FLAT_INCLUDED
+#define SEGMENT_FLAT_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#ifdef UM_GUARD_PAGES
+#include "guard.h"
+#endif
+
+#ifdef UM_RECLAIM
+#include "reclaim.h"
+#endif
+
+#ifdef UM_RELOCATE
+#include <string.h>
+
+/* Accesses between relocations */
+#define RELOCATE_INTERVAL (1u << 22)
+
+/* Largest segment, in words, that is moved into the arena */
+#define RELOCATE_MAX_WORDS 64
+
+/* Fewest accesses since the last relocation that make a segment hot */
+#define RELOCATE_MIN_HITS 16
+
+/* Most words in the arena */
+#define RELOCATE_ARENA_WORDS (1u << 18)
+
+/* Bytes in a cache line, to which the arena is aligned */
+#define RELOCATE_LINE 64
+#endif
+
+/**********************************line_T**************************************
+ *
+ * A single segment of memory.
+ * Stores:
+ *         uint32_t *words: The words of the segment, NULL when unmapped
+ *         unsigned length: The number of words in the segment
+ *         uint32_t hits:   (UM_RELOCATE) Loads and stores since the last
+ *                          relocation, halved at each relocation
+ *
+ *****************************************************************************/
+struct line_T {
+        uint32_t *words;
+        unsigned length;
+#ifdef UM_RELOCATE
+        uint32_t hits;
+#endif
+};
+
+/********************************Segment_T*************************************
+ *
+ * A UM's entire segmented memory.
+ * Stores:
+ *         struct line_T *segments: Table of segments indexed by ID
+ *         int numSegs:             Number of IDs handed out so far
+ *         int capacity:            Number of slots in segments
+ *         uint32_t *IDs:           Stack of unmapped IDs to be reused
+ *         int64_t rightMost:       Index of the top of IDs, -1 when empty
+ *         unsigned size:           Number of slots in IDs
+ *         uint32_t *arena:         (UM_RELOCATE) Storage of the relocated
+ *                                  segments, NULL before the first
+ *                                  relocation
+ *         size_t arenaWords:       (UM_RELOCATE) Words used in arena
+ *         uint32_t countdown:      (UM_RELOCATE) Accesses left until the
+ *                                  next relocation
+ *
+ *****************************************************************************/
+struct Segment_T {
+        struct line_T *segments;
+        int numSegs;
+        int capacity;
+
+        uint32_t *IDs;
+        int64_t rightMost;
+        unsigned size;
+
+#ifdef UM_RELOCATE
+        uint32_t *arena;
+        size_t arenaWords;
+        uint32_t countdown;
+#endif
+};
+
+static inline struct Segment_T Segment_new(uint32_t size);
+static inline void Segment_free(struct Segment_T *seg);
+static inline uint32_t Segment_map(struct Segment_T *seg, uint32_t size);
+static inline void Segment_unmap(struct Segment_T *seg, uint32_t id);
+static inline uint32_t Segment_word_at(struct Segment_T *seg, uint32_t id,
+                                       uint32_t offset);
+static inline void Segment_load_program(struct Segment_T *seg, uint32_t id);
+static inline void Segment_load_word(struct Segment_T *seg, uint32_t id,
+                                     uint32_t offset, uint32_t word);
+static inline bool Segment_is_mapped(struct Segment_T *seg, uint32_t id);
+static inline uint32_t Segment_length(struct Segment_T *seg, uint32_t id);
+static inline uint32_t *Segment_words(struct Segment_T *seg, uint32_t id);
+static inline uint32_t Segment_ids_issued(struct Segment_T *seg);
+static inline uint32_t Segment_ids_free(struct Segment_T *seg);
+static inline uint32_t *words_new(uint32_t size);
+static inline void words_free(uint32_t *words, uint32_t size);
+static inline void line_free(struct Segment_T *seg, struct line_T line);
+static void segment_release(void *memory);
+#ifdef UM_RELOCATE
+static inline void relocate_touch(struct Segment_T *seg, uint32_t id);
+static inline bool relocate_owns(struct Segment_T *seg, uint32_t *words);
+static void Segment_relocate(struct Segment_T *seg);
+#endif
+
+/********************************Segment_new***********************************
+ *
+ * Creates a segmented memory with segment zero of the given size
+ * Inputs:
+ *         uint32_t size: The number of 32-bit words in segment zero
+ * Return: A new Segment_T with only segment zero mapped
+ * Expects:
+ *         none
+ * Notes:
+ *         CRE if memory cannot be allocated
+ *         Memory is released by Segment_free
+ *****************************************************************************/
+static inline struct Segment_T Segment_new(uint32_t size)
+{
+        /* Allocating memory for the Segment_T variable */
+        struct Segment_T seg;
+
+        /* Making sequence for unmapped IDs */
+        seg.IDs = calloc(1000, sizeof(uint32_t));
+        assert(seg.IDs);
+        seg.size = 1000;
+        seg.rightMost = -1;
+
+        /* Assigning values to the Segment_T variable */
+        seg.segments = (struct line_T *)malloc(1000 * sizeof(struct line_T));
+        assert(seg.segments);
+
+        struct line_T bot = { 0 };
+        for (size_t i = 0; i < 1000; i++) {
+                seg.segments[i] = bot;
+        }
+
+        seg.numSegs = 0;
+        seg.capacity = 1000;
+#ifdef UM_RELOCATE
+        seg.arena = NULL;
+        seg.arenaWords = 0;
+        seg.countdown = RELOCATE_INTERVAL;
+#endif
+        /* Adding segment zero to the segments */
+        Segment_map(&seg, size);
+
+        return seg;
+}
+
+/********************************Segment_free**********************************
+ *
+ * Frees every mapped segment and the tables of a segmented memory
+ * Inputs:
+ *         struct Segment_T *seg: The memory to free
+ * Return: none
+ * Expects:
+ *         seg to be non-null
+ * Notes:
+ *         With -DUM_RECLAIM the memory is handed to the background thread
+ *         whole, so freeing takes the same time however many segments
+ *         are mapped; CRE if it cannot be handed over
+ *****************************************************************************/
+static inline void Segment_free(struct Segment_T *seg)
+{
+#ifdef UM_RECLAIM
+        struct Segment_T *old = malloc(sizeof(struct Segment_T));
+        assert(old);
+        *old = *seg;
+        Reclaim_call(segment_release, old);
+#else
+        segment_release(seg);
+#endif
+}
+
+/******************************segment_release*********************************
+ *
+ * Does the work of Segment_free
+ * Inputs:
+ *         void *memory: The struct Segment_T to free
+ * Return: none
+ * Expects:
+ *         memory to be non-null
+ * Notes:
+ *         With -DUM_RECLAIM it runs on the background thread, frees the
+ *         segments directly rather than queueing them again, and frees
+ *         the copy of the Segment_T made by Segment_free
+ *****************************************************************************/
+static void segment_release(void *memory)
+{
+        struct Segment_T *seg = memory;
+        int numItems = seg->numSegs - 1;
+        while (numItems >= 0) {
+                struct line_T line = seg->segments[numItems];
+                if (line.words != NULL) {
+#ifdef UM_RECLAIM
+                        free(line.words);
+#else
+                        line_free(seg, line);
+#endif
+                }
+
+                numItems--;
+        }
+
+        free(seg->segments);
+        free(seg->IDs);
+#ifdef UM_RELOCATE
+        free(seg->arena);
+#endif
+#ifdef UM_RECLAIM
+        free(seg);
+#endif
+}
+
+/********************************Segment_map***********************************
+ *
+ * Maps a new zero-filled segment, reusing an unmapped ID if there is one
+ * Inputs:
+ *         struct Segment_T *seg: The memory to map the segment in
+ *         uint32_t size:         The number of words in the segment
+ * Return: The ID of the new segment
+ * Expects:
+ *         seg to be non-null
+ * Notes:
+ *         A segment of length zero still gets storage so that words is
+ *         non-NULL exactly when the segment is mapped
+ *****************************************************************************/
+static inline uint32_t Segment_map(struct Segment_T *seg, uint32_t size)
+{
+        /* Allocating memory for a segment of provided length */
+        struct line_T new_seg = { 0 };
+        new_seg.length = size;
+        new_seg.words = words_new(size);
+
+        if (seg->rightMost >= 0) {
+                /* Freeing memory associated with the line at id */
+                uint32_t id = seg->IDs[seg->rightMost];
+                seg->rightMost--;
+
+                /* Storging the new segment */
+                seg->segments[id] = new_seg;
+
+                return id;
+        }
+
+        if (seg->numSegs >= seg->capacity) {
+                seg->capacity = seg->capacity * 2;
+                struct line_T *temp = (struct line_T *)realloc(seg->segments, seg->capacity * sizeof(struct line_T));
+                assert(temp);
+
+                struct line_T bot = { 0 };
+                for (int i = seg->numSegs; i < seg->capacity; i++) {
+                        temp[i] = bot;
+                }
+
+                seg->segments = temp;
+        }
+
+        /* Storing the new segment */
+        seg->segments[seg->numSegs] = new_seg;
+        seg->numSegs++;
+        return (uint32_t) seg->numSegs - 1;
+}
+
+/********************************Segment_unmap*********************************
+ *
+ * Unmaps a segment and makes its ID available for reuse
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment to unmap
+ * Return: none
+ * Expects:
+ *         id to be a mapped segment other than zero
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline void Segment_unmap(struct Segment_T *seg, uint32_t id)
+{
+        /* Access the segment */
+        struct line_T line = seg->segments[id];
+        line_free(seg, line);
+
+        struct line_T bot = { 0 };
+        seg->segments[id] = bot;
+
+        /* Adding id to unmapped IDs sequence */
+        if (seg->size - 1 <= seg->rightMost) {
+                seg->size = seg->size * 2;
+                uint32_t *temp = realloc(seg->IDs, seg->size * sizeof(uint32_t));
+                assert(temp);
+
+                unsigned cap = seg->size;
+                for (unsigned i = seg->rightMost + 1; i < cap; i++) {
+                        temp[i] = 0;
+                }
+
+                seg->IDs = temp;
+        }
+
+        seg->rightMost++;
+        seg->IDs[seg->rightMost] = id;
+}
+
+/******************************Segment_word_at*********************************
+ *
+ * Returns the word at an offset of a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment
+ *         uint32_t offset:       The offset of the word
+ * Return: The word at the offset
+ * Expects:
+ *         id to be mapped and offset to be within its length
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline uint32_t Segment_word_at(struct Segment_T *seg, uint32_t id,
+                                       uint32_t offset)
+{
+#ifdef UM_RELOCATE
+        relocate_touch(seg, id);
+#endif
+        /* Accessing desired segment */
+        struct line_T line = seg->segments[id];
+
+        return line.words[offset];
+}
+
+/****************************Segment_load_program******************************
+ *
+ * Replaces segment zero with a copy of another segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segments
+ *         uint32_t id:           The ID of the segment to duplicate
+ * Return: none
+ * Expects:
+ *         id to be mapped and non-zero
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline void Segment_load_program(struct Segment_T *seg, uint32_t id)
+{
+        /* Freeing segment currently at zero */
+        struct line_T zero = seg->segments[0];
+        words_free(zero.words, zero.length);
+
+        /* Getting length of line that is duplicated */
+        struct line_T segment_zero = seg->segments[id];
+        int length = segment_zero.length;
+
+        /* Making copy of the segment */
+        struct line_T copy_zero = { 0 };
+        copy_zero.length = length;
+        copy_zero.words = words_new(length);
+
+        for (int i = 0; i < length; i++) {
+                copy_zero.words[i] = segment_zero.words[i];
+        }
+
+        /* Overwriting segment zero */
+        seg->segments[0] = copy_zero;
+}
+
+/*****************************Segment_load_word********************************
+ *
+ * Stores a word at an offset of a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment
+ *         uint32_t offset:       The offset to store at
+ *         uint32_t word:         The word to store
+ * Return: none
+ * Expects:
+ *         id to be mapped and offset to be within its length
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline void Segment_load_word(struct Segment_T *seg, uint32_t id,
+                       uint32_t offset, uint32_t word)
+{
+#ifdef UM_RELOCATE
+        relocate_touch(seg, id);
+#endif
+        seg->segments[id].words[offset] = word;
+}
+
+/*****************************Segment_is_mapped********************************
+ *
+ * Determines whether an ID names a mapped segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory to look in
+ *         uint32_t id:           The ID to look up
+ * Return: true if id is mapped, false otherwise
+ * Expects:
+ *         seg to be non-null
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline bool Segment_is_mapped(struct Segment_T *seg, uint32_t id)
+{
+        return id < (uint32_t) seg->numSegs &&
+               seg->segments[id].words != NULL;
+}
+
+/*******************************Segment_length*********************************
+ *
+ * Returns the number of words in a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment
+ * Return: The length of the segment
+ * Expects:
+ *         id to be mapped
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline uint32_t Segment_length(struct Segment_T *seg, uint32_t id)
+{
+        return seg->segments[id].length;
+}
+
+/********************************Segment_words*********************************
+ *
+ * Returns the storage of a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment
+ * Return: A pointer to the first word of the segment, NULL if unmapped
+ * Expects:
+ *         id to be less than Segment_ids_issued(seg)
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline uint32_t *Segment_words(struct Segment_T *seg, uint32_t id)
+{
+        return seg->segments[id].words;
+}
+
+/*****************************Segment_ids_issued*******************************
+ *
+ * Returns the number of IDs ever handed out, including segment zero
+ *
+ *****************************************************************************/
+static inline uint32_t Segment_ids_issued(struct Segment_T *seg)
+{
+        return seg->numSegs;
+}
+
+/******************************Segment_ids_free********************************
+ *
+ * Returns the number of unmapped IDs waiting to be reused
+ *
+ *****************************************************************************/
+static inline uint32_t Segment_ids_free(struct Segment_T *seg)
+{
+        return seg->rightMost + 1;
+}
+
+/**********************************words_new***********************************
+ *
+ * Allocates zero-filled storage for a segment
+ * Inputs:
+ *         uint32_t size: The number of words in the segment
+ * Return: A pointer to the storage, never NULL
+ * Expects:
+ *         none
+ * Notes:
+ *         CRE if memory cannot be allocated
+ *         A segment of length zero still gets storage so that words is
+ *         non-NULL exactly when the segment is mapped
+ *****************************************************************************/
+static inline uint32_t *words_new(uint32_t size)
+{
+#ifdef UM_GUARD_PAGES
+        return Guard_words_new(size);
+#else
+        uint32_t *words = calloc(size == 0 ? 1 : size, sizeof(uint32_t));
+        assert(words);
+        return words;
+#endif
+}
+
+/*********************************words_free***********************************
+ *
+ * Releases storage allocated by words_new
+ * Inputs:
+ *         uint32_t *words: The storage to release
+ *         uint32_t size:   The number of words it was allocated with
+ * Return: none
+ * Expects:
+ *         words to come from words_new(size)
+ * Notes:
+ *         With -DUM_RECLAIM a large segment is freed in the background
+ *****************************************************************************/
+static inline void words_free(uint32_t *words, uint32_t size)
+{
+#if defined(UM_GUARD_PAGES)
+        Guard_words_free(words, size);
+#elif defined(UM_RECLAIM)
+        Reclaim_block(words, (size == 0 ? 1 : (size_t) size) *
+                             sizeof(uint32_t));
+#else
+        (void) size;
+        free(words);
+#endif
+}
+
+/**********************************line_free***********************************
+ *
+ * Releases the storage of a segment that is being unmapped or freed
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         struct line_T line:    The segment
+ * Return: none
+ * Expects:
+ *         line.words to be non-NULL
+ * Notes:
+ *         A segment in the relocation arena is left for the next
+ *         relocation, or Segment_free, to reclaim
+ *****************************************************************************/
+static inline void line_free(struct Segment_T *seg, struct line_T line)
+{
+#ifdef UM_RELOCATE
+        if (relocate_owns(seg, line.words)) {
+                return;
+        }
+#else
+        (void) seg;
+#endif
+        words_free(line.words, line.length);
+}
+
+#ifdef UM_RELOCATE
+/*******************************relocate_touch*********************************
+ *
+ * Counts an access to a segment, relocating when the interval is up.
+ * Segment zero, read by every instruction fetch and never moved, is not
+ * counted.
+ *
+ *****************************************************************************/
+static inline void relocate_touch(struct Segment_T *seg, uint32_t id)
+{
+        if (id == 0) {
+                return;
+        }
+        seg->segments[id].hits++;
+        if (--seg->countdown == 0) {
+                Segment_relocate(seg);
+        }
+}
+
+/*******************************relocate_owns**********************************
+ *
+ * Determines whether a segment's words are in the relocation arena
+ *
+ *****************************************************************************/
+static inline bool relocate_owns(struct Segment_T *seg, uint32_t *words)
+{
+        return seg->arena != NULL && words >= seg->arena &&
+               words < seg->arena + seg->arenaWords;
+}
+
+/* A segment chosen for the arena: its ID and how much it was used */
+struct relocate_candidate {
+        uint32_t id;
+        uint32_t hits;
+};
+
+static int relocate_compare(const void *a, const void *b)
+{
+        const struct relocate_candidate *x = a, *y = b;
+        if (x->hits != y->hits) {
+                return x->hits < y->hits ? 1 : -1;
+        }
+        return (x->id > y->id) - (x->id < y->id);
+}
+
+/*****************************Segment_relocate*********************************
+ *
+ * Moves the hottest small segments into a new arena
+ * Inputs:
+ *         struct Segment_T *seg: The memory to reorganize
+ * Return: none
+ * Expects:
+ *         seg to be non-null
+ * Notes:
+ *         CRE if memory cannot be allocated
+ *         Segment zero is never moved. Segments of the old arena that are
+ *         not hot any more move back to storage of their own, then the old
+ *         arena is freed. Every segment's count is halved, so a segment
+ *         stays hot only while it is still being used. IDs, lengths and
+ *         contents are unchanged; only where the words live changes.
+ *****************************************************************************/
+static void Segment_relocate(struct Segment_T *seg)
+{
+        seg->countdown = RELOCATE_INTERVAL;
+
+        uint32_t n = 0;
+        struct relocate_candidate *hot =
+                malloc(seg->numSegs * sizeof(struct relocate_candidate));
+        assert(hot);
+        for (int id = 1; id < seg->numSegs; id++) {
+                struct line_T *line = &seg->segments[id];
+                if (line->words != NULL &&
+                    line->length <= RELOCATE_MAX_WORDS &&
+                    line->hits >= RELOCATE_MIN_HITS) {
+                        hot[n].id = id;
+                        hot[n].hits = line->hits;
+                        n++;
+                }
+        }
+        qsort(hot, n, sizeof(struct relocate_candidate), relocate_compare);
+
+        uint32_t *old = seg->arena;
+        size_t oldWords = seg->arenaWords;
+
+        size_t words = 0;
+        uint32_t chosen = 0;
+        while (chosen < n) {
+                uint32_t length = seg->segments[hot[chosen].id].length;
+                size_t need = length == 0 ? 1 : length;
+                if (words + need > RELOCATE_ARENA_WORDS) {
+                        break;
+                }
+                words += need;
+                chosen++;
+        }
+
+        uint32_t *arena = NULL;
+        if (chosen > 0) {
+                size_t bytes = words * sizeof(uint32_t);
+                bytes = (bytes + RELOCATE_LINE - 1) / RELOCATE_LINE *
+                        RELOCATE_LINE;
+                int failed = posix_memalign((void **) &arena, RELOCATE_LINE,
+                                            bytes);
+                assert(failed == 0);
+                (void) failed;
+
+                uint32_t *next = arena;
+                for (uint32_t i = 0; i < chosen; i++) {
+                        struct line_T *line = &seg->segments[hot[i].id];
+                        size_t need = line->length == 0 ? 1 : line->length;
+                        memcpy(next, line->words, need * sizeof(uint32_t));
+                        if (!relocate_owns(seg, line->words)) {
+                                words_free(line->words, line->length);
+                        }
+                        line->words = next;
+                        next += need;
+                }
+        }
+        free(hot);
+
+        /* Whatever is left in the old arena went cold */
+        for (int id = 1; id < seg->numSegs; id++) {
+                struct line_T *line = &seg->segments[id];
+                if (old != NULL && line->words >= old &&
+                    line->words < old + oldWords) {
+                        uint32_t *copy = words_new(line->length);
+                        memcpy(copy, line->words, (line->length == 0 ? 1 :
+                               line->length) * sizeof(uint32_t));
+                        line->words = copy;
+                }
+                line->hits /= 2;
+        }
+        free(old);
+
+        seg->arena = arena;
+        seg->arenaWords = words;
+}
+#endif
+
+#endif
@@ -0,0 +1,355 @@
+/******************************************************************************
+ *
+ *                                segment_seq.h
+ *
+ *     Assignment: um
+ *     Authors:    Marten Tropp and Matthew Carey
+ *     Date:       11/20/2023
+ *
+ *     The purpose of this file is to implement the Hanson Seq_T segment
+ *     memory backend (see um.h). It is the representation the first version
+ *     of the engine used: one Seq_T of pointers to line_T records indexed by
+ *     ID, and a Seq_T of unmapped IDs used as a stack. It is kept so that the
+ *     cost of the Hanson interfaces can be measured against the other
+ *     backends.
+ *
+ *****************************************************************************/
+#ifndef SEGMENT_SEQ_INCLUDED
+#define SEGMENT_SEQ_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "seq.h"
+#include "mem.h"
+
+/******************************line_T******************************************
+ *
+ * Structure that stores information related to a segment or line.
+ * Stores:
+ *         uint32_t *words: A pointer to an array of 32-bit unsigned values
+ *                          that store the contents of a line
+ *         unsigned length: Unsigned value that contains the length of the
+ *                          array containing words
+ *
+ *****************************************************************************/
+typedef struct line_T {
+        uint32_t *words;
+        unsigned length;
+} *line_T;
+
+/******************************Segment_T***************************************
+ *
+ * Structure that contains two sequences to keep track of mapped segments and
+ * identifiers that were in use at some point, but have been unmapped.
+ * Stores:
+ *         Seq_T segments:    Sequence of line_T indexed by ID, NULL when
+ *                            unmapped
+ *         Seq_T unmappedIDs: Sequence that stores unsigned 32-bit values that
+ *                            were used as identifiers
+ *
+ *****************************************************************************/
+struct Segment_T {
+        Seq_T segments;
+        Seq_T unmappedIDs;
+};
+
+static inline struct Segment_T Segment_new(uint32_t size);
+static inline void Segment_free(struct Segment_T *seg);
+static inline uint32_t Segment_map(struct Segment_T *seg, uint32_t size);
+static inline void Segment_unmap(struct Segment_T *seg, uint32_t id);
+static inline uint32_t Segment_word_at(struct Segment_T *seg, uint32_t id,
+                                       uint32_t offset);
+static inline void Segment_load_program(struct Segment_T *seg, uint32_t id);
+static inline void Segment_load_word(struct Segment_T *seg, uint32_t id,
+                                     uint32_t offset, uint32_t word);
+static inline bool Segment_is_mapped(struct Segment_T *seg, uint32_t id);
+static inline uint32_t Segment_length(struct Segment_T *seg, uint32_t id);
+static inline uint32_t *Segment_words(struct Segment_T *seg, uint32_t id);
+static inline uint32_t Segment_ids_issued(struct Segment_T *seg);
+static inline uint32_t Segment_ids_free(struct Segment_T *seg);
+static inline line_T line_new(uint32_t size);
+static inline void line_free(line_T *line);
+
+/********************************line_new**************************************
+ *
+ * Creates a new zero-filled line_T with the given size
+ * Inputs:
+ *         uint32_t size: The number of 32-bit words in the line
+ * Return: A new line_T with the given length
+ * Expects:
+ *         none
+ * Notes:
+ *         CRE if unable to allocate memory of provided size
+ *         Allocated memory is supposed to be deallocated using line_free
+ *****************************************************************************/
+static inline line_T line_new(uint32_t size)
+{
+        line_T line;
+        NEW(line);
+
+        line->length = size;
+        line->words = calloc(size == 0 ? 1 : size, sizeof(uint32_t));
+        assert(line->words);
+
+        return line;
+}
+
+/********************************line_free*************************************
+ *
+ * Free the memory associated with a line_T
+ * Inputs:
+ *         line_T *line: The line_T that will be freed
+ * Return: none
+ * Expects:
+ *         line and *line to be non-null
+ * Notes:
+ *         Frees memory allocated in line_new
+ *****************************************************************************/
+static inline void line_free(line_T *line)
+{
+        free((*line)->words);
+        FREE(*line);
+}
+
+/********************************Segment_new***********************************
+ *
+ * Creates a segmented memory with segment zero of the given size
+ * Inputs:
+ *         uint32_t size: The number of 32-bit words in segment zero
+ * Return: A new Segment_T with only segment zero mapped
+ * Expects:
+ *         none
+ * Notes:
+ *         Memory is released by Segment_free
+ *****************************************************************************/
+static inline struct Segment_T Segment_new(uint32_t size)
+{
+        struct Segment_T seg;
+        seg.segments = Seq_new(1000);
+        seg.unmappedIDs = Seq_new(1000);
+
+        Segment_map(&seg, size);
+        return seg;
+}
+
+/********************************Segment_free**********************************
+ *
+ * Frees every mapped segment and the sequences of a segmented memory
+ * Inputs:
+ *         struct Segment_T *seg: The memory to free
+ * Return: none
+ * Expects:
+ *         seg to be non-null
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline void Segment_free(struct Segment_T *seg)
+{
+        int numItems = Seq_length(seg->segments);
+        while (numItems > 0) {
+                line_T line = Seq_remhi(seg->segments);
+                if (line != NULL) {
+                        line_free(&line);
+                }
+
+                numItems--;
+        }
+
+        Seq_free(&seg->segments);
+        Seq_free(&seg->unmappedIDs);
+}
+
+/********************************Segment_map***********************************
+ *
+ * Maps a new zero-filled segment, reusing an unmapped ID if there is one
+ * Inputs:
+ *         struct Segment_T *seg: The memory to map the segment in
+ *         uint32_t size:         The number of words in the segment
+ * Return: The ID of the new segment
+ * Expects:
+ *         seg to be non-null
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline uint32_t Segment_map(struct Segment_T *seg, uint32_t size)
+{
+        line_T new_seg = line_new(size);
+
+        if (Seq_length(seg->unmappedIDs) != 0) {
+                uint32_t id = (uint32_t) (uintptr_t)
+                              Seq_remhi(seg->unmappedIDs);
+                Seq_put(seg->segments, id, new_seg);
+                return id;
+        }
+
+        Seq_addhi(seg->segments, new_seg);
+        return (uint32_t) Seq_length(seg->segments) - 1;
+}
+
+/********************************Segment_unmap*********************************
+ *
+ * Unmaps a segment and makes its ID available for reuse
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment to unmap
+ * Return: none
+ * Expects:
+ *         id to be a mapped segment other than zero
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline void Segment_unmap(struct Segment_T *seg, uint32_t id)
+{
+        line_T line = Seq_get(seg->segments, id);
+        line_free(&line);
+        Seq_put(seg->segments, id, NULL);
+
+        Seq_addhi(seg->unmappedIDs, (void *) (uintptr_t) id);
+}
+
+/******************************Segment_word_at*********************************
+ *
+ * Returns the word at an offset of a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment
+ *         uint32_t offset:       The offset of the word
+ * Return: The word at the offset
+ * Expects:
+ *         id to be mapped and offset to be within its length
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline uint32_t Segment_word_at(struct Segment_T *seg, uint32_t id,
+                                       uint32_t offset)
+{
+        line_T line = Seq_get(seg->segments, id);
+        return line->words[offset];
+}
+
+/****************************Segment_load_program******************************
+ *
+ * Replaces segment zero with a copy of another segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segments
+ *         uint32_t id:           The ID of the segment to duplicate
+ * Return: none
+ * Expects:
+ *         id to be mapped and non-zero
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline void Segment_load_program(struct Segment_T *seg, uint32_t id)
+{
+        line_T zero = Seq_get(seg->segments, 0);
+        line_free(&zero);
+
+        line_T segment_zero = Seq_get(seg->segments, id);
+        int length = segment_zero->length;
+
+        line_T copy_zero = line_new(length);
+        for (int i = 0; i < length; i++) {
+                copy_zero->words[i] = segment_zero->words[i];
+        }
+
+        Seq_put(seg->segments, 0, copy_zero);
+}
+
+/*****************************Segment_load_word********************************
+ *
+ * Stores a word at an offset of a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment
+ *         uint32_t offset:       The offset to store at
+ *         uint32_t word:         The word to store
+ * Return: none
+ * Expects:
+ *         id to be mapped and offset to be within its length
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline void Segment_load_word(struct Segment_T *seg, uint32_t id,
+                                     uint32_t offset, uint32_t word)
+{
+        line_T line = Seq_get(seg->segments, id);
+        line->words[offset] = word;
+}
+
+/*****************************Segment_is_mapped********************************
+ *
+ * Determines whether an ID names a mapped segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory to look in
+ *         uint32_t id:           The ID to look up
+ * Return: true if id is mapped, false otherwise
+ * Expects:
+ *         seg to be non-null
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline bool Segment_is_mapped(struct Segment_T *seg, uint32_t id)
+{
+        return id < (uint32_t) Seq_length(seg->segments) &&
+               Seq_get(seg->segments, id) != NULL;
+}
+
+/*******************************Segment_length*********************************
+ *
+ * Returns the number of words in a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment
+ * Return: The length of the segment
+ * Expects:
+ *         id to be mapped
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline uint32_t Segment_length(struct Segment_T *seg, uint32_t id)
+{
+        line_T line = Seq_get(seg->segments, id);
+        return line->length;
+}
+
+/********************************Segment_words*********************************
+ *
+ * Returns the storage of a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment
+ * Return: A pointer to the first word of the segment, NULL if unmapped
+ * Expects:
+ *         id to be less than Segment_ids_issued(seg)
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline uint32_t *Segment_words(struct Segment_T *seg, uint32_t id)
+{
+        line_T line = Seq_get(seg->segments, id);
+        return line == NULL ? NULL : line->words;
+}
+
+/*****************************Segment_ids_issued*******************************
+ *
+ * Returns the number of IDs ever handed out, including segment zero
+ *
+ *****************************************************************************/
+static inline uint32_t Segment_ids_issued(struct Segment_T *seg)
+{
+        return Seq_length(seg->segments);
+}
+
+/******************************Segment_ids_free********************************
+ *
+ * Returns the number of unmapped IDs waiting to be reused
+ *
+ *****************************************************************************/
+static inline uint32_t Segment_ids_free(struct Segment_T *seg)
+{
+        return Seq_length(seg->unmappedIDs);
+}
+
+#endif
@@ -0,0 +1,449 @@
+/******************************************************************************
+ *
+ *                               segment_slab.h
+ *
+ *     Assignment: um
+ *     Authors:    Marten Tropp and Matthew Carey
+ *     Date:       11/20/2023
+ *
+ *     The purpose of this file is to implement the slab segment memory
+ *     backend (see um.h). Segments of up to SLAB_MAX_WORDS words are carved
+ *     from large chunks, one free list per power-of-two size class, so map
+ *     and unmap of small segments never reach malloc. Each segment's length
+ *     sits in the two words in front of its first word, which keeps the ID
+ *     table down to one pointer per segment. Larger segments are allocated
+ *     individually with the same header.
+ *
+ *****************************************************************************/
+#ifndef SEGMENT_SLAB_INCLUDED
+#define SEGMENT_SLAB_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+/* Size classes hold 1, 2, 4, ... SLAB_MAX_WORDS words */
+#define SLAB_CLASSES 13
+#define SLAB_MAX_WORDS (1u << (SLAB_CLASSES - 1))
+#define SLAB_LARGE SLAB_CLASSES
+
+/* Bytes carved from malloc at a time */
+#define SLAB_CHUNK_BYTES (1u << 18)
+
+/* Words in front of a segment: its length and its size class */
+#define SLAB_HEADER 2
+
+/********************************Segment_T*************************************
+ *
+ * A UM's entire segmented memory.
+ * Stores:
+ *         uint32_t **segments:  First word of each segment indexed by ID,
+ *                               NULL when unmapped
+ *         uint32_t numSegs:     Number of IDs handed out so far
+ *         uint32_t capacity:    Number of slots in segments
+ *         uint32_t *IDs:        Stack of unmapped IDs to be reused
+ *         uint32_t numIDs:      Number of IDs on the stack
+ *         uint32_t sizeIDs:     Number of slots in IDs
+ *         void *free_blocks[]:  Free blocks of each size class, linked
+ *                               through their first bytes
+ *         char *chunk:          Most recent chunk, linked to the previous
+ *                               one through its first bytes
+ *         size_t used:          Bytes of chunk already carved
+ *
+ *****************************************************************************/
+struct Segment_T {
+        uint32_t **segments;
+        uint32_t numSegs;
+        uint32_t capacity;
+
+        uint32_t *IDs;
+        uint32_t numIDs;
+        uint32_t sizeIDs;
+
+        void *free_blocks[SLAB_CLASSES];
+        char *chunk;
+        size_t used;
+};
+
+static inline struct Segment_T Segment_new(uint32_t size);
+static inline void Segment_free(struct Segment_T *seg);
+static inline uint32_t Segment_map(struct Segment_T *seg, uint32_t size);
+static inline void Segment_unmap(struct Segment_T *seg, uint32_t id);
+static inline uint32_t Segment_word_at(struct Segment_T *seg, uint32_t id,
+                                       uint32_t offset);
+static inline void Segment_load_program(struct Segment_T *seg, uint32_t id);
+static inline void Segment_load_word(struct Segment_T *seg, uint32_t id,
+                                     uint32_t offset, uint32_t word);
+static inline bool Segment_is_mapped(struct Segment_T *seg, uint32_t id);
+static inline uint32_t Segment_length(struct Segment_T *seg, uint32_t id);
+static inline uint32_t *Segment_words(struct Segment_T *seg, uint32_t id);
+static inline uint32_t Segment_ids_issued(struct Segment_T *seg);
+static inline uint32_t Segment_ids_free(struct Segment_T *seg);
+static inline uint32_t *slab_alloc(struct Segment_T *seg, uint32_t size);
+static inline void slab_release(struct Segment_T *seg, uint32_t *words);
+
+/********************************slab_class************************************
+ *
+ * Returns the size class that holds a segment of the given size
+ * Inputs:
+ *         uint32_t size: The number of words in the segment
+ * Return: The smallest c with size <= 2^c, or SLAB_LARGE
+ * Expects:
+ *         none
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline unsigned slab_class(uint32_t size)
+{
+        if (size > SLAB_MAX_WORDS) {
+                return SLAB_LARGE;
+        }
+        unsigned c = 0;
+        while ((1u << c) < size) {
+                c++;
+        }
+        return c;
+}
+
+/*******************************slab_block_bytes*******************************
+ *
+ * Returns the bytes in a block of a size class, header included
+ *
+ *****************************************************************************/
+static inline size_t slab_block_bytes(unsigned c)
+{
+        size_t bytes = (SLAB_HEADER + ((size_t) 1 << c)) * sizeof(uint32_t);
+        size_t align = sizeof(void *);
+        return (bytes + align - 1) / align * align;
+}
+
+/*********************************slab_alloc***********************************
+ *
+ * Allocates zero-filled storage for a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory the segment belongs to
+ *         uint32_t size:         The number of words in the segment
+ * Return: A pointer to the first word of the segment, never NULL
+ * Expects:
+ *         seg to be non-null
+ * Notes:
+ *         CRE if memory cannot be allocated
+ *         Blocks come from the class free list, then from the current chunk;
+ *         the unused tail of a chunk that is too small is abandoned
+ *         Only the words of the segment are cleared, not the whole block
+ *****************************************************************************/
+static inline uint32_t *slab_alloc(struct Segment_T *seg, uint32_t size)
+{
+        unsigned c = slab_class(size);
+        uint32_t *block;
+
+        if (c == SLAB_LARGE) {
+                block = calloc(SLAB_HEADER + (size_t) size, sizeof(uint32_t));
+                assert(block);
+        }
+        else if (seg->free_blocks[c] != NULL) {
+                block = seg->free_blocks[c];
+                seg->free_blocks[c] = *(void **) block;
+                memset(block + SLAB_HEADER, 0, size * sizeof(uint32_t));
+        }
+        else {
+                size_t bytes = slab_block_bytes(c);
+                if (seg->chunk == NULL ||
+                    seg->used + bytes > SLAB_CHUNK_BYTES) {
+                        char *chunk = malloc(SLAB_CHUNK_BYTES);
+                        assert(chunk);
+                        *(char **) chunk = seg->chunk;
+                        seg->chunk = chunk;
+                        seg->used = sizeof(void *);
+                }
+                block = (uint32_t *) (seg->chunk + seg->used);
+                seg->used += bytes;
+                memset(block + SLAB_HEADER, 0, size * sizeof(uint32_t));
+        }
+
+        block[0] = size;
+        block[1] = c;
+        return block + SLAB_HEADER;
+}
+
+/********************************slab_release**********************************
+ *
+ * Returns storage allocated by slab_alloc to its size class
+ * Inputs:
+ *         struct Segment_T *seg: The memory the segment belongs to
+ *         uint32_t *words:       The first word of the segment
+ * Return: none
+ * Expects:
+ *         words to come from slab_alloc on seg
+ * Notes:
+ *         Large blocks go straight back to free
+ *****************************************************************************/
+static inline void slab_release(struct Segment_T *seg, uint32_t *words)
+{
+        uint32_t *block = words - SLAB_HEADER;
+        unsigned c = block[1];
+
+        if (c == SLAB_LARGE) {
+                free(block);
+                return;
+        }
+        *(void **) block = seg->free_blocks[c];
+        seg->free_blocks[c] = block;
+}
+
+/********************************Segment_new***********************************
+ *
+ * Creates a segmented memory with segment zero of the given size
+ * Inputs:
+ *         uint32_t size: The number of 32-bit words in segment zero
+ * Return: A new Segment_T with only segment zero mapped
+ * Expects:
+ *         none
+ * Notes:
+ *         CRE if memory cannot be allocated
+ *         Memory is released by Segment_free
+ *****************************************************************************/
+static inline struct Segment_T Segment_new(uint32_t size)
+{
+        struct Segment_T seg;
+        memset(&seg, 0, sizeof(seg));
+
+        seg.capacity = 1000;
+        seg.segments = calloc(seg.capacity, sizeof(uint32_t *));
+        assert(seg.segments);
+
+        seg.sizeIDs = 1000;
+        seg.IDs = malloc(seg.sizeIDs * sizeof(uint32_t));
+        assert(seg.IDs);
+
+        Segment_map(&seg, size);
+        return seg;
+}
+
+/********************************Segment_free**********************************
+ *
+ * Frees every segment, every chunk and the tables of a segmented memory
+ * Inputs:
+ *         struct Segment_T *seg: The memory to free
+ * Return: none
+ * Expects:
+ *         seg to be non-null
+ * Notes:
+ *         Small segments live in chunks, so only large ones are freed one by
+ *         one
+ *****************************************************************************/
+static inline void Segment_free(struct Segment_T *seg)
+{
+        for (uint32_t id = 0; id < seg->numSegs; id++) {
+                uint32_t *words = seg->segments[id];
+                if (words != NULL && words[-1] == SLAB_LARGE) {
+                        free(words - SLAB_HEADER);
+                }
+        }
+
+        while (seg->chunk != NULL) {
+                char *previous = *(char **) seg->chunk;
+                free(seg->chunk);
+                seg->chunk = previous;
+        }
+
+        free(seg->segments);
+        free(seg->IDs);
+}
+
+/********************************Segment_map***********************************
+ *
+ * Maps a new zero-filled segment, reusing an unmapped ID if there is one
+ * Inputs:
+ *         struct Segment_T *seg: The memory to map the segment in
+ *         uint32_t size:         The number of words in the segment
+ * Return: The ID of the new segment
+ * Expects:
+ *         seg to be non-null
+ * Notes:
+ *         CRE if memory cannot be allocated
+ *****************************************************************************/
+static inline uint32_t Segment_map(struct Segment_T *seg, uint32_t size)
+{
+        uint32_t *words = slab_alloc(seg, size);
+
+        if (seg->numIDs > 0) {
+                uint32_t id = seg->IDs[--seg->numIDs];
+                seg->segments[id] = words;
+                return id;
+        }
+
+        if (seg->numSegs == seg->capacity) {
+                seg->capacity *= 2;
+                uint32_t **temp = realloc(seg->segments, seg->capacity *
+                                          sizeof(uint32_t *));
+                assert(temp);
+                seg->segments = temp;
+        }
+
+        seg->segments[seg->numSegs] = words;
+        return seg->numSegs++;
+}
+
+/********************************Segment_unmap*********************************
+ *
+ * Unmaps a segment and makes its ID available for reuse
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment to unmap
+ * Return: none
+ * Expects:
+ *         id to be a mapped segment other than zero
+ * Notes:
+ *         CRE if memory cannot be allocated
+ *****************************************************************************/
+static inline void Segment_unmap(struct Segment_T *seg, uint32_t id)
+{
+        slab_release(seg, seg->segments[id]);
+        seg->segments[id] = NULL;
+
+        if (seg->numIDs == seg->sizeIDs) {
+                seg->sizeIDs *= 2;
+                uint32_t *temp = realloc(seg->IDs, seg->sizeIDs *
+                                         sizeof(uint32_t));
+                assert(temp);
+                seg->IDs = temp;
+        }
+        seg->IDs[seg->numIDs++] = id;
+}
+
+/******************************Segment_word_at*********************************
+ *
+ * Returns the word at an offset of a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment
+ *         uint32_t offset:       The offset of the word
+ * Return: The word at the offset
+ * Expects:
+ *         id to be mapped and offset to be within its length
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline uint32_t Segment_word_at(struct Segment_T *seg, uint32_t id,
+                                       uint32_t offset)
+{
+        return seg->segments[id][offset];
+}
+
+/****************************Segment_load_program******************************
+ *
+ * Replaces segment zero with a copy of another segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segments
+ *         uint32_t id:           The ID of the segment to duplicate
+ * Return: none
+ * Expects:
+ *         id to be mapped and non-zero
+ * Notes:
+ *         CRE if memory cannot be allocated
+ *****************************************************************************/
+static inline void Segment_load_program(struct Segment_T *seg, uint32_t id)
+{
+        uint32_t length = Segment_length(seg, id);
+        uint32_t *copy = slab_alloc(seg, length);
+
+        memcpy(copy, seg->segments[id], length * sizeof(uint32_t));
+        slab_release(seg, seg->segments[0]);
+        seg->segments[0] = copy;
+}
+
+/*****************************Segment_load_word********************************
+ *
+ * Stores a word at an offset of a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment
+ *         uint32_t offset:       The offset to store at
+ *         uint32_t word:         The word to store
+ * Return: none
+ * Expects:
+ *         id to be mapped and offset to be within its length
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline void Segment_load_word(struct Segment_T *seg, uint32_t id,
+                                     uint32_t offset, uint32_t word)
+{
+        seg->segments[id][offset] = word;
+}
+
+/*****************************Segment_is_mapped********************************
+ *
+ * Determines whether an ID names a mapped segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory to look in
+ *         uint32_t id:           The ID to look up
+ * Return: true if id is mapped, false otherwise
+ * Expects:
+ *         seg to be non-null
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline bool Segment_is_mapped(struct Segment_T *seg, uint32_t id)
+{
+        return id < seg->numSegs && seg->segments[id] != NULL;
+}
+
+/*******************************Segment_length*********************************
+ *
+ * Returns the number of words in a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment
+ * Return: The length of the segment, read from its header
+ * Expects:
+ *         id to be mapped
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline uint32_t Segment_length(struct Segment_T *seg, uint32_t id)
+{
+        return seg->segments[id][-SLAB_HEADER];
+}
+
+/********************************Segment_words*********************************
+ *
+ * Returns the storage of a segment
+ * Inputs:
+ *         struct Segment_T *seg: The memory holding the segment
+ *         uint32_t id:           The ID of the segment
+ * Return: A pointer to the first word of the segment, NULL if unmapped
+ * Expects:
+ *         id to be less than Segment_ids_issued(seg)
+ * Notes:
+ *         none
+ *****************************************************************************/
+static inline uint32_t *Segment_words(struct Segment_T *seg, uint32_t id)
+{
+        return seg->segments[id];
+}
+
+/*****************************Segment_ids_issued*******************************
+ *
+ * Returns the number of IDs ever handed out, including segment zero
+ *
+ *****************************************************************************/
+static inline uint32_t Segment_ids_issued(struct Segment_T *seg)
+{
+        return seg->numSegs;
+}
+
+/******************************Segment_ids_free********************************
+ *
+ * Returns the number of unmapped IDs waiting to be reused
+ *
+ *****************************************************************************/
+static inline uint32_t Segment_ids_free(struct Segment_T *seg)
+{
+        return seg->numIDs;
+}
+
+#endif
@@ -24,7 +24,8 @@
 typedef uint32_t Um_instruction;
 typedef enum Um_opcode {
         CMOV = 0, SLOAD, SSTORE, ADD, MUL, DIV,
-        NAND, HALT, ACTIVATE, INACTIVATE, OUT, IN, LOADP, LV
+        NAND, HALT, ACTIVATE, INACTIVATE, OUT, IN, LOADP, LV,
+        COPY, FILL /* extended: only run by um -DUM_EXTENDED_OPS */
 } Um_opcode;
 
 
@@ -125,6 +126,29 @@ static inline Um_instruction loadp(Um_register b, Um_register c)
         return three_register(LOADP, 0, b, c);
 }
 
+/* Extended opcodes (see um.h): the extra registers rD and rE are packed
+   into bits 9-11 and 12-14 */
+
+/* m[a][b + i] := m[c][d + i] for i < e */
+static inline Um_instruction bulk_copy(Um_register a, Um_register b,
+                                       Um_register c, Um_register d,
+                                       Um_register e)
+{
+        Um_instruction instruction = three_register(COPY, a, b, c);
+        instruction = Bitpack_newu(instruction, 3, 9, d);
+        instruction = Bitpack_newu(instruction, 3, 12, e);
+        return instruction;
+}
+
+/* m[a][b + i] := c for i < d */
+static inline Um_instruction bulk_fill(Um_register a, Um_register b,
+                                       Um_register c, Um_register d)
+{
+        Um_instruction instruction = three_register(FILL, a, b, c);
+        instruction = Bitpack_newu(instruction, 3, 9, d);
+        return instruction;
+}
+
 
 /* Functions for working with streams */
 
@@ -434,4 +458,180 @@ void build_load_prog_from_unmapped(Seq_T stream)
         append(stream, unmap(r2));
         append(stream, loadp(r1, r2));
         append(stream, halt());
-}
\ No newline at end of file
+}
+/* Ends a loop the way umasm compiles "if (counter <=s limit) goto head using
+   r5", with r6 and r7 as temporaries; r0 must hold 0 */
+static void append_loop_end(Seq_T stream, Um_register counter, unsigned limit,
+                            unsigned head)
+{
+        append(stream, loadval(r6, limit));
+        append(stream, nand(r7, counter, counter));
+        append(stream, add(r5, r6, r7));
+        append(stream, loadval(r7, 1));
+        append(stream, add(r5, r5, r7));
+        append(stream, loadval(r6, 32768));
+        append(stream, divide(r5, r5, r6));
+        append(stream, loadval(r6, 65536));
+        append(stream, divide(r5, r5, r6));
+        append(stream, loadval(r6, head));
+        append(stream, loadval(r7, Seq_length(stream) + 3));
+        append(stream, conditional_move(r6, r7, r5));
+        append(stream, loadp(r0, r6));
+}
+
+void build_fill_loop_test(Seq_T stream)
+{
+        append(stream, loadval(r0, 0));
+        append(stream, loadval(r3, 12));
+        append(stream, map(r1, r3));
+        append(stream, loadval(r3, 0));
+        append(stream, loadval(r4, 'f'));
+
+        /* m[r1][r3] := 'f' for r3 = 0 .. 9 */
+        unsigned head = Seq_length(stream);
+        append(stream, segment_store(r1, r3, r4));
+        append(stream, loadval(r6, 1));
+        append(stream, add(r3, r3, r6));
+        append_loop_end(stream, r3, 9, head);
+
+        append(stream, loadval(r2, 0));
+        append(stream, segment_load(r4, r1, r2));
+        append(stream, output(r4)); // expect f
+        append(stream, loadval(r2, 9));
+        append(stream, segment_load(r4, r1, r2));
+        append(stream, output(r4)); // expect f
+        append(stream, loadval(r2, 10));
+        append(stream, segment_load(r4, r1, r2));
+        append(stream, loadval(r6, '0'));
+        append(stream, add(r4, r4, r6));
+        append(stream, output(r4)); // expect 0, one past the fill
+        append(stream, add(r4, r3, r6));
+        append(stream, output(r4)); // expect :, the counter is 10
+        append(stream, halt());
+}
+
+void build_copy_loop_test(Seq_T stream)
+{
+        append(stream, loadval(r0, 0));
+        append(stream, loadval(r3, 8));
+        append(stream, map(r1, r3));
+        append(stream, map(r2, r3));
+        for (unsigned i = 0; i < 5; i++) {
+                append(stream, loadval(r3, i));
+                append(stream, loadval(r4, 'a' + i));
+                append(stream, segment_store(r1, r3, r4));
+        }
+
+        /* m[r2][r3 + 1] := m[r1][r3] for r3 = 0 .. 4 */
+        append(stream, loadval(r3, 0));
+        unsigned head = Seq_length(stream);
+        append(stream, segment_load(r4, r1, r3));
+        append(stream, loadval(r6, 1));
+        append(stream, add(r6, r3, r6));
+        append(stream, segment_store(r2, r6, r4));
+        append(stream, loadval(r6, 1));
+        append(stream, add(r3, r3, r6));
+        append_loop_end(stream, r3, 4, head);
+
+        append(stream, loadval(r3, 0));
+        append(stream, segment_load(r4, r2, r3));
+        append(stream, loadval(r6, '0'));
+        append(stream, add(r4, r4, r6));
+        append(stream, output(r4)); // expect 0, before the copy
+        for (unsigned i = 1; i <= 5; i++) {
+                append(stream, loadval(r3, i));
+                append(stream, segment_load(r4, r2, r3));
+                append(stream, output(r4)); // expect abcde
+        }
+
+        /* m[r1][r3 + 1] := m[r1][r3] for r3 = 0 .. 3 repeats m[r1][0] */
+        append(stream, loadval(r3, 0));
+        head = Seq_length(stream);
+        append(stream, segment_load(r4, r1, r3));
+        append(stream, loadval(r6, 1));
+        append(stream, add(r6, r3, r6));
+        append(stream, segment_store(r1, r6, r4));
+        append(stream, loadval(r6, 1));
+        append(stream, add(r3, r3, r6));
+        append_loop_end(stream, r3, 3, head);
+
+        append(stream, loadval(r3, 4));
+        append(stream, segment_load(r4, r1, r3));
+        append(stream, output(r4)); // expect a
+        append(stream, halt());
+}
+
+void build_bulk_fill_test(Seq_T stream)
+{
+        append(stream, loadval(r3, 12));
+        append(stream, map(r1, r3));
+
+        /* m[r1][1 .. 10] := 'f' */
+        append(stream, loadval(r2, 1));
+        append(stream, loadval(r3, 'f'));
+        append(stream, loadval(r4, 10));
+        append(stream, bulk_fill(r1, r2, r3, r4));
+
+        /* Filling no words at the end of the segment is allowed */
+        append(stream, loadval(r2, 12));
+        append(stream, loadval(r4, 0));
+        append(stream, bulk_fill(r1, r2, r3, r4));
+
+        append(stream, loadval(r5, '0'));
+        append(stream, loadval(r2, 0));
+        append(stream, segment_load(r4, r1, r2));
+        append(stream, add(r4, r4, r5));
+        append(stream, output(r4)); // expect 0, before the fill
+        append(stream, loadval(r2, 1));
+        append(stream, segment_load(r4, r1, r2));
+        append(stream, output(r4)); // expect f
+        append(stream, loadval(r2, 10));
+        append(stream, segment_load(r4, r1, r2));
+        append(stream, output(r4)); // expect f
+        append(stream, loadval(r2, 11));
+        append(stream, segment_load(r4, r1, r2));
+        append(stream, add(r4, r4, r5));
+        append(stream, output(r4)); // expect 0, after the fill
+        append(stream, halt());
+}
+
+void build_bulk_copy_test(Seq_T stream)
+{
+        append(stream, loadval(r3, 8));
+        append(stream, map(r1, r3));
+        append(stream, map(r2, r3));
+        for (unsigned i = 0; i < 5; i++) {
+                append(stream, loadval(r3, i));
+                append(stream, loadval(r4, 'a' + i));
+                append(stream, segment_store(r1, r3, r4));
+        }
+
+        /* m[r2][1 .. 5] := m[r1][0 .. 4] */
+        append(stream, loadval(r3, 1));
+        append(stream, loadval(r4, 0));
+        append(stream, loadval(r5, 5));
+        append(stream, bulk_copy(r2, r3, r1, r4, r5));
+
+        append(stream, loadval(r3, 0));
+        append(stream, segment_load(r4, r2, r3));
+        append(stream, loadval(r6, '0'));
+        append(stream, add(r4, r4, r6));
+        append(stream, output(r4)); // expect 0, before the copy
+        for (unsigned i = 1; i <= 5; i++) {
+                append(stream, loadval(r3, i));
+                append(stream, segment_load(r4, r2, r3));
+                append(stream, output(r4)); // expect abcde
+        }
+
+        /* m[r1][1 .. 4] := m[r1][0 .. 3] overlaps, and copies abcd */
+        append(stream, loadval(r3, 1));
+        append(stream, loadval(r4, 0));
+        append(stream, loadval(r5, 4));
+        append(stream, bulk_copy(r1, r3, r1, r4, r5));
+        for (unsigned i = 1; i <= 4; i++) {
+                append(stream, loadval(r3, i));
+                append(stream, segment_load(r4, r1, r3));
+                append(stream, output(r4)); // expect abcd
+        }
+        append(stream, halt());
+}
@@ -41,6 +41,10 @@ extern void build_unmap_unmapped_seg(Seq_T stream);
 extern void build_load_prog_from_not_mapped(Seq_T stream);
 extern void build_load_prog_from_unmapped(Seq_T stream);
 extern void build_exec_500k(Seq_T stream);
+extern void build_fill_loop_test(Seq_T stream);
+extern void build_copy_loop_test(Seq_T stream);
+extern void build_bulk_fill_test(Seq_T stream);  // needs -DUM_EXTENDED_OPS
+extern void build_bulk_copy_test(Seq_T stream);  // needs -DUM_EXTENDED_OPS
 
 /* The array `tests` contains all unit tests for the lab. */
 
@@ -80,7 +84,11 @@ static struct test_info {
         // { "FFload-prog-from-not-mapped",  NULL, "", build_load_prog_from_not_mapped },
         // { "FFload-prog-from-unmapped",  NULL, "", build_load_prog_from_unmapped },
         { "halt-twice", NULL, "", build_halt_twice_test },
-        { "500k-instr", NULL, "", build_exec_500k }
+        { "500k-instr", NULL, "", build_exec_500k },
+        { "fill-loop",    NULL, "ff0:",    build_fill_loop_test },
+        { "copy-loop",    NULL, "0abcdea", build_copy_loop_test },
+        { "bulk-fill",    NULL, "0ff0",    build_bulk_fill_test },
+        { "bulk-copy",    NULL, "0abcdeabcd", build_bulk_copy_test }
 };
 
   
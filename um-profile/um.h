@@ -5,523 +5,893 @@
  *     Assignment: um
  *     Authors:    Marten Tropp and Matthew Carey
  *     Date:       11/20/2023
- *      
- *     The purpose of this file is to define the struct and functions 
- *     associated with the um data structure. These functions perform the 
- *     main operations of the um as well as any helper functions they need.
  *
- *    
+ *     The purpose of this file is to define the um engine: the struct that
+ *     represents a UM and the functions that fetch, decode and execute
+ *     instructions. It is the only copy of the engine. Segmented memory is
+ *     provided by one of the segment_*.h backends, described below.
+ *
+ *     The engine is specialized at compile time. By default every check is
+ *     compiled out and the engine trusts the program it runs. Compiling with
+ *     -DUM_CHECKED produces the diagnostic build, in which every UM failure
+ *     (bad segment, bad offset, bad opcode, division by zero, ...) stops the
+ *     machine with a report of the faulting PC, opcode and segment state.
+ *
+ *     Compiling with -DUM_GUARD_PAGES places every segment so that its end
+ *     abuts a guard page (see guard.h). Out-of-bounds SLOAD/SSTORE then fault
+ *     in hardware and are reported the same way, at no cost on the hot path.
+ *
+ *     Compiling with -DUM_SESSION builds an engine for embedding in a server:
+ *     input and output go through um_session_input and um_session_output,
+ *     which the including file defines, and um_run_slice runs a machine for
+ *     a bounded number of instructions. A machine whose input is not ready
+ *     stops before its IN instruction and is resumed by the next slice.
+ *
+ *     Compiling with -DUM_LATENCY makes the driver measure, for every line of
+ *     input, the instructions and time until the program's next output and
+ *     its next input, and report their percentiles at the halt (see
+ *     latency.h).
+ *
+ *     Compiling with -DUM_PROFILE makes the driver count the instructions
+ *     and cycles spent at every PC of segment zero, and in every call made
+ *     by the asmcoding calling convention, and write them to um.prof at the
+ *     halt (see profile.h). umprof reports them by label and procedure.
+ *
+ *     Compiling with -DUM_LOOP_IDIOMS makes the engine run word-copy and
+ *     word-fill loops in segment zero as native bulk operations when it can
+ *     show that doing so is exact (see idiom.h).
+ *
+ *     Compiling with -DUM_EXTENDED_OPS defines two opcodes that the UM
+ *     specification leaves invalid, for programs written to use them (see
+ *     "Extended opcodes" below). Without it they fault as before.
+ *
+ *     Compiling with -DUM_RELOCATE makes the flat backend move the most used
+ *     small segments together into one arena from time to time, for cache
+ *     and TLB locality (see segment_flat.h).
+ *
+ *     Compiling with -DUM_RECLAIM makes unmapping a large segment and
+ *     freeing a halted machine hand the memory to a background thread
+ *     instead of freeing it on the spot (see reclaim.h).
  *
  *****************************************************************************/
 #ifndef UM_INCLUDED
 #define UM_INCLUDED
 
-#include <stdint.h>
-#include "segment.h"
-#include "mem.h"
-#include "bitpack.h"
-#include <stdint.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
 #include <inttypes.h>
 #include <assert.h>
 
+/****************************Segment memory backends**************************
+ *
+ * The engine reaches segmented memory only through the functions below, so
+ * the representation is chosen at compile time by including one backend:
+ *
+ *         segment_flat.h  flat table of separately allocated segments with
+ *                         a stack of IDs for reuse (default)
+ *         segment_slab.h  segments carved from per-size-class slabs with
+ *                         their length stored in front of the words
+ *                         (-DUM_SEGMENT_SLAB)
+ *         segment_seq.h   Hanson Seq_T table and ID stack, as in the
+ *                         first version of the engine (-DUM_SEGMENT_SEQ)
+ *         segment_chunked.h
+ *                         the flat backend with a two-level table and ID
+ *                         stack that grow by whole chunks and never move
+ *                         (-DUM_SEGMENT_CHUNKED)
+ *
+ * Every backend defines struct Segment_T and:
+ *
+ *         Segment_new(size)               segment zero of size words mapped
+ *         Segment_free(seg)               release everything
+ *         Segment_map(seg, size)          new zeroed segment, returns its ID
+ *         Segment_unmap(seg, id)          release a segment and its ID
+ *         Segment_word_at(seg, id, off)   load a word
+ *         Segment_load_word(seg, id, off, word)
+ *                                         store a word
+ *         Segment_load_program(seg, id)   replace segment zero with a copy
+ *         Segment_is_mapped(seg, id)      whether id names a segment
+ *         Segment_length(seg, id)         words in a mapped segment
+ *         Segment_words(seg, id)          first word of a segment, or NULL
+ *         Segment_ids_issued(seg)         IDs handed out so far
+ *         Segment_ids_free(seg)           unmapped IDs awaiting reuse
+ *
+ * Guard pages (-DUM_GUARD_PAGES) and background reclamation (-DUM_RECLAIM)
+ * are properties of how the flat and chunked backends allocate and free
+ * segments, so they require one of them, and not each other.
+ *
+ *****************************************************************************/
+#if defined(UM_SEGMENT_SLAB)
+#include "segment_slab.h"
+#elif defined(UM_SEGMENT_SEQ)
+#include "segment_seq.h"
+#elif defined(UM_SEGMENT_CHUNKED)
+#include "segment_chunked.h"
+#else
+#include "segment_flat.h"
+#endif
+
+#if defined(UM_GUARD_PAGES) && \
+    (defined(UM_SEGMENT_SLAB) || defined(UM_SEGMENT_SEQ))
+#error "UM_GUARD_PAGES requires the flat or chunked segment backend"
+#endif
+
+#if defined(UM_RELOCATE) && \
+    (defined(UM_SEGMENT_SLAB) || defined(UM_SEGMENT_SEQ) || \
+     defined(UM_SEGMENT_CHUNKED) || defined(UM_GUARD_PAGES) || \
+     defined(UM_RECLAIM))
+#error "UM_RELOCATE requires the flat backend without guard pages or reclaim"
+#endif
+
+#if defined(UM_RECLAIM) && \
+    (defined(UM_SEGMENT_SLAB) || defined(UM_SEGMENT_SEQ) || \
+     defined(UM_GUARD_PAGES))
+#error "UM_RECLAIM requires the flat or chunked backend without guard pages"
+#endif
+
+#ifdef UM_LOOP_IDIOMS
+#include "idiom.h"
+#endif
+
+#ifdef UM_LATENCY
+#include "latency.h"
+#if defined(UM_SESSION)
+#error "UM_LATENCY measures the um driver and cannot be used with UM_SESSION"
+#endif
+#endif
+
+#ifdef UM_PROFILE
+#include "profile.h"
+#if defined(UM_SESSION) || defined(UM_LOOP_IDIOMS)
+#error "UM_PROFILE cannot be used with UM_SESSION or UM_LOOP_IDIOMS"
+#endif
+#endif
+
+/******************************Extended opcodes*******************************
+ *
+ * With -DUM_EXTENDED_OPS, opcodes 14 and 15 copy and fill a run of words in
+ * one instruction. Both use the three-register format with two more
+ * registers in the otherwise unused bits: rD in bits 9-11 and rE in bits
+ * 12-14.
+ *
+ *         14  COPY  m[r[A]][r[B] + i] := m[r[C]][r[D] + i]  for i < r[E]
+ *         15  FILL  m[r[A]][r[B] + i] := r[C]               for i < r[D]
+ *
+ * COPY behaves as if the source words were read before any is written, so
+ * the two runs may overlap. Either is a failure if a segment is unmapped
+ * or a run does not fit in its segment; a count of zero does nothing. They
+ * may write to segment 0. um-lab/umlab.c builds them with bulk_copy and
+ * bulk_fill.
+ *
+ *****************************************************************************/
+#ifdef UM_EXTENDED_OPS
+#include <string.h>
+#endif
+
+/**********************************UM_CHECK************************************
+ *
+ * Checks a condition that a well-behaved UM program guarantees. In the
+ * diagnostic build a failed check calls um_fault with the instruction being
+ * executed and a printf-style description; in the fast build the check and
+ * its arguments are compiled out entirely.
+ *
+ *****************************************************************************/
+#ifdef UM_CHECKED
+#define UM_CHECK(cond, um, instruction, ...) do {                       \
+        if (!(cond)) {                                                  \
+                um_fault((um), (instruction), __VA_ARGS__);             \
+        }                                                               \
+} while (false)
+#else
+#define UM_CHECK(cond, um, instruction, ...) ((void) 0)
+#endif
+
+
 /**********************************um_T****************************************
  *
- * Structure that contains an array of registers, a Segment_T of memory and a 
- * program counter as an int.
+ * A universal machine.
  * Stores:
- *         uint32_t registers[8]: array of 8 32-bit integers representing 
- *                                registers 
- *         Segment_T segments:    Segment_T object that represents the um's  
- *                                segmented memory
- *         int program_count:     Integer to track where the execution is in  
- *                                the program
- *                      
+ *         uint32_t registers[8]:     The eight general purpose registers
+ *         struct Segment_T segments: The segmented memory
+ *         int program_count:         Offset in segment zero of the current
+ *                                    instruction
+ *         bool halt:                 Whether the machine has halted
+ *         void *session:             (UM_SESSION) The embedder's state for
+ *                                    this machine
+ *         bool blocked:              (UM_SESSION) Whether the last slice
+ *                                    stopped for lack of input
+ *         struct Idiom_T idioms:     (UM_LOOP_IDIOMS) The loops recognized
+ *                                    in segment zero
+ *         struct Latency_T latency:  (UM_LATENCY) Instructions executed and
+ *                                    the interactions measured so far
+ *         struct Profile_T profile:  (UM_PROFILE) Counts by PC and call
+ *
  *****************************************************************************/
-typedef struct um_T {
+struct um_T {
         uint32_t registers[8];
-        Segment_T segments;
+        struct Segment_T segments;
         int program_count;
-} *um_T;
-
-static um_T um_new(uint32_t size);
-static void um_free(um_T *um);
-static void um_conditional(um_T um, int rA, int rB, int rC);
-static void um_seg_load(um_T um, int rA, int rB, int rC);
-static void um_seg_store(um_T um, int rA, int rB, int rC);
-static void um_addition(um_T um, int rA, int rB, int rC);
-static void um_multi(um_T um, int rA, int rB, int rC);
-static void um_division(um_T um, int rA, int rB, int rC);
-static void um_nand(um_T um, int rA, int rB, int rC);
-static void um_halt(um_T um);
-static void um_map_seg(um_T um, int rB, int rC);
-static void um_unmap_seg(um_T um, int rC);
-static void um_output(um_T um, int rC);
-static void um_input(um_T um, int rC);
-static void um_load_prog(um_T um, int rB, int rC);
-static void um_load_val(um_T um, int rA, uint32_t val);
-static bool um_is_valid_inst(um_T um);
+        bool halt;
+#ifdef UM_SESSION
+        void *session;
+        bool blocked;
+#endif
+#ifdef UM_LOOP_IDIOMS
+        struct Idiom_T idioms;
+#endif
+#ifdef UM_LATENCY
+        struct Latency_T latency;
+#endif
+#ifdef UM_PROFILE
+        struct Profile_T profile;
+#endif
+};
+
+static inline struct um_T um_new(uint32_t size);
+static inline void initialize_seg_zero(struct um_T *um, FILE *fp, int length);
+static inline void run_um(struct um_T *um, FILE *fp, int length);
+static inline void handle_instruction(struct um_T *um, uint32_t instruction);
+static inline uint64_t Bitpack_getu(uint64_t word, unsigned width,
+                                    unsigned lsb);
+#if defined(UM_CHECKED) || defined(UM_GUARD_PAGES)
+#include <unistd.h>
+
+/* A fault report built on the stack; text that does not fit is dropped */
+struct um_report {
+        char text[1024];
+        size_t length;
+};
+
+static void um_report_text(struct um_report *report, const char *text);
+static void um_report_number(struct um_report *report, uint64_t n,
+                             unsigned base, int digits);
+static void um_fault_report(struct um_T *um, uint32_t instruction,
+                            const char *what);
+#endif
+#ifdef UM_CHECKED
+static void um_fault(struct um_T *um, uint32_t instruction,
+                     const char *fmt, ...);
+#endif
+#ifdef UM_SESSION
+static inline uint64_t um_run_slice(struct um_T *um, uint64_t budget);
+
+/* Defined by the file that includes um.h. um_session_input returns false
+   if no input is available yet; at end of input it stores ~0. */
+static bool um_session_input(struct um_T *um, uint32_t *word);
+static void um_session_output(struct um_T *um, uint32_t c);
+#endif
+#ifdef UM_GUARD_PAGES
+static void um_guard_fault(void *addr);
+
+/* The machine that a hardware fault is reported against */
+static struct um_T *um_running;
+#endif
 
 /***********************************um_new*************************************
  *
- * Creates a new um_T structure
+ * Creates a new UM whose segment zero has the given size
  * Inputs:
  *         uint32_t size: The number of 32-bit words in segment zero of the um
- * Return: A new um_T with its segment zero having the provided size
+ * Return: A new um_T with zeroed registers and program counter
  * Expects:
  *         none
  * Notes:
- *         none
- *         Allocated memory is supposed to be deallocated using um_free
+ *         Memory is released by the halt instruction
  *****************************************************************************/
-static um_T um_new(uint32_t size)
+static inline struct um_T um_new(uint32_t size)
 {
         /* Allocating memory for the um_T variable */
-        um_T um;
-        NEW(um);
+        struct um_T um;
 
         /* Initialize Segment_T variable */
-        Segment_T segments = Segment_new(size);
+        struct Segment_T segments = Segment_new(size);
 
         /* Assigning values to the um_T variable */
-        um->segments = segments;
-        um->program_count = 0;
+        um.segments = segments;
+        um.program_count = 0;
+        um.halt = false;
+#ifdef UM_SESSION
+        um.session = NULL;
+        um.blocked = false;
+#endif
+#ifdef UM_LOOP_IDIOMS
+        um.idioms = Idiom_new();
+#endif
+#ifdef UM_LATENCY
+        um.latency = Latency_new();
+#endif
+#ifdef UM_PROFILE
+        um.profile = Profile_new(size);
+#endif
 
         /* Giving registers default values */
         for (int i = 0; i < 8; i ++) {
-                um->registers[i] = 0;
+                um.registers[i] = 0;
         }
-        
+
         return um;
 }
 
-/********************************um_free***************************************
+/***************************initialize_seg_zero********************************
  *
- * Free the memory associated with a um_T
+ * Reads the big-endian words of a .um file into segment zero
  * Inputs:
- *         um_T *um: The um_T that will be freed
+ *         struct um_T *um: The um whose segment zero is filled
+ *         FILE *fp:        The open .um file
+ *         int length:      The number of words in the file
  * Return: none
  * Expects:
- *         um and *um to be non-null
+ *         Segment zero to have at least length words
  * Notes:
- *         CRE if um or *um is null
- *         Frees memory allocated in um_new
+ *         none
  *****************************************************************************/
-static void um_free(um_T *um)
+static inline void initialize_seg_zero(struct um_T *um, FILE *fp, int length)
 {
-        /* Ensuring non-null value was passed in */
-        assert(um && *um);
-
-        /* Freeing segments if not freed already */
-        if ((*um)->segments != NULL) {
-                Segment_free(&(*um)->segments);
+        /* Get first charater from file */
+        int word1 = fgetc(fp);
+        int word2 = fgetc(fp);
+        int word3 = fgetc(fp);
+        int word4 = fgetc(fp);
+
+        /* Store contents of file in segment zero */
+        for (int offset = 0; offset < length; offset++) {
+                uint32_t word = 0;
+                word = ((word << (8)) >> (8)) | (word1 << 24);
+                word = ((word >> 24) << 24) | ((word << (16)) >> (16)) | (word2 << 16);
+                word = ((word >> 16) << 16) | ((word << (24)) >> (24)) | (word3 << 8);
+                word = ((word >> 8) << 8) | (word4);
+                Segment_load_word(&(um->segments), 0, offset, word);
+
+                /* Get bit values from next chars for next instruction */
+                word1 = fgetc(fp);
+                word2 = fgetc(fp);
+                word3 = fgetc(fp);
+                word4 = fgetc(fp);
         }
-
-        FREE(*um);
 }
 
-/********************************um_conditional********************************
+/**********************************run_um**************************************
  *
- * Executes conditional operation of the um
+ * Loads a program into segment zero and runs it until it halts
  * Inputs:
- *         um_T um:  The um that is in use
- *         int rA:   The number of register A, which is the potential 
-                     destination
- *         int rB:   The number of register B, which contains the value to 
-                     potentially be copied
- *         int rC:   The number of register C, which is the conditional
+ *         struct um_T *um: The um to run
+ *         FILE *fp:        The open .um file
+ *         int length:      The number of words in the file
  * Return: none
  * Expects:
- *         um to be non-null
- *         rA, rB, and rC to be in range [0, 7]
+ *         none
  * Notes:
- *         CRE if um is null
- *         CRE if rA, rB, or rC is not in range [0, 7]
+ *         In the diagnostic build, running off the end of segment zero is a
+ *         fault
  *****************************************************************************/
-static void um_conditional(um_T um, int rA, int rB, int rC)
+static inline void run_um(struct um_T *um, FILE *fp, int length)
 {
-        /* Ensuring non-null value was passed in */
-        assert(um && rA >= 0 && rA < 8 && 
-               rB >= 0 && rB < 8 && rC >= 0 && rC < 8);
-        
-        if (um->registers[rC] != 0) {
-                um->registers[rA] = um->registers[rB];
+        /* Reading in values from files to segment zero */
+        initialize_seg_zero(um, fp, length);
+
+#ifdef UM_GUARD_PAGES
+        um_running = um;
+        Guard_install(um_guard_fault);
+#endif
+
+        /* Running program until end of segment zero */
+        while (!(um->halt)) {
+                UM_CHECK((unsigned) um->program_count <
+                         Segment_length(&(um->segments), 0), um, ~(uint32_t)0,
+                         "program counter outside segment 0 (length %"
+                         PRIu32 ")",
+                         Segment_length(&(um->segments), 0));
+                uint32_t instruction = Segment_word_at(&(um->segments), 0,
+                                   um->program_count);
+#ifdef UM_PROFILE
+                Profile_step(&(um->profile), um->program_count);
+#endif
+                handle_instruction(um, instruction);
+                um->program_count++;
+#ifdef UM_LATENCY
+                um->latency.instructions++;
+#endif
         }
 }
 
-/********************************um_seg_load***********************************
- *
- * Executes segmented load operation of the um
- * Inputs:
- *         um_T um:  The um that is in use
- *         int rA:   The number of register A, where the value will be stored
- *         int rB:   The number of register B, the id of the segment to access
- *         int rC:   The number of register C, the offset of the word to load
- * Return: none
- * Expects:
- *         um to be non-null
- *         rA, rB, and rC to be in range [0, 7]
- * Notes:
- *         CRE if um is null
- *         CRE if rA, rB, or rC is not in range [0, 7]
- *****************************************************************************/
-static void um_seg_load(um_T um, int rA, int rB, int rC)
-{
-        /* Ensuring non-null value was passed in */
-        assert(um && rA >= 0 && rA < 8 && 
-               rB >= 0 && rB < 8 && rC >= 0 && rC < 8);
-
-        um->registers[rA] = Segment_word_at(um->segments, um->registers[rB], 
-                                            um->registers[rC]);
-}
-
-/********************************um_seg_store**********************************
+#ifdef UM_SESSION
+/*******************************um_run_slice***********************************
  *
- * Executes segmented store operation of the um
+ * Runs a loaded machine for at most a given number of instructions
  * Inputs:
- *         um_T um:  The um that is in use
- *         int rA:   The number of register A, containing the id of the segment
- *                   to store in
- *         int rB:   The number of register B, which contains the offset to  
- *                   store the value at
- *         int rC:   The number of register C, containing the value to store
- * Return: none
+ *         struct um_T *um:  The um to run, with segment zero already filled
+ *         uint64_t budget:  The most instructions to execute
+ * Return: The number of instructions executed
  * Expects:
- *         um to be non-null
- *         rA, rB, and rC to be in range [0, 7]
+ *         um not to have halted
  * Notes:
- *         CRE if um is null
- *         CRE if rA, rB, or rC is not in range [0, 7]
+ *         Stops early when the machine halts or blocks for input; an IN that
+ *         blocks is not counted, since it runs again on the next slice
  *****************************************************************************/
-static void um_seg_store(um_T um, int rA, int rB, int rC)
+static inline uint64_t um_run_slice(struct um_T *um, uint64_t budget)
 {
-        /* Ensuring non-null value was passed in */
-        assert(um && rA >= 0 && rA < 8 && 
-               rB >= 0 && rB < 8 && rC >= 0 && rC < 8);
-
-        Segment_load_word(um->segments, um->registers[rA], um->registers[rB], 
-                          um->registers[rC]);
-}
-
-/********************************um_addition***********************************
- *
- * Executes addition operation of the um
- * Inputs:
- *         um_T um:  The um that is in use
- *         int rA:   The number of register A, the destination of the result
- *         int rB:   The number of register B, containing a value to add
- *         int rC:   The number of register C, containing a value to add
- * Return: none
- * Expects:
- *         um to be non-null
- *         rA, rB, and rC to be in range [0, 7]
- * Notes:
- *         CRE if um is null
- *         CRE if rA, rB, or rC is not in range [0, 7]
- *****************************************************************************/
-static void um_addition(um_T um, int rA, int rB, int rC)
-{
-        /* Ensuring non-null value was passed in */
-        assert(um && rA >= 0 && rA < 8 && 
-               rB >= 0 && rB < 8 && rC >= 0 && rC < 8);
-
-        um->registers[rA] = um->registers[rB] + um->registers[rC];
-}
-
-/********************************um_multi**************************************
- *
- * Executes multiplication operation of the um
- * Inputs:
- *         um_T um:  The um that is in use
- *         int rA:   The number of register A, the destination of the result
- *         int rB:   The number of register B, containing a value to multiply
- *         int rC:   The number of register C, containing a value to multiply
- * Return: none
- * Expects:
- *         um to be non-null
- *         rA, rB, and rC to be in range [0, 7]
- * Notes:
- *         CRE if um is null
- *         CRE if rA, rB, or rC is not in range [0, 7]
- *****************************************************************************/
-static void um_multi(um_T um, int rA, int rB, int rC)
-{
-        /* Ensuring non-null value was passed in */
-        assert(um && rA >= 0 && rA < 8 && 
-               rB >= 0 && rB < 8 && rC >= 0 && rC < 8);
-        
-        um->registers[rA] = um->registers[rB] * um->registers[rC];
-}
-
-/********************************um_division***********************************
- *
- * Executes division operation of the um
- * Inputs:
- *         um_T um:  The um that is in use
- *         int rA:   The number of register A, the destination of the result
- *         int rB:   The number of register B, containing a value to divide
- *         int rC:   The number of register C, containing a value to divide
- * Return: none
- * Expects:
- *         um to be non-null
- *         rA, rB, and rC to be in range [0, 7]
- *         The value in registers[rC] to be non-zero
- * Notes:
- *         CRE if um is null
- *         CCRE if rA, rB, or rC is not in range [0, 7]
- *         CRE if value in registers[rC] is zero
- *****************************************************************************/
-static void um_division(um_T um, int rA, int rB, int rC)
-{
-        /* Ensuring non-null value was passed in */
-        assert(um && rA >= 0 && rA < 8 && 
-               rB >= 0 && rB < 8 && rC >= 0 && rC < 8 &&
-               um->registers[rC] != 0);
+        uint64_t count = 0;
+        um->blocked = false;
+
+        while (!(um->halt) && !(um->blocked) && count < budget) {
+                UM_CHECK((unsigned) um->program_count <
+                         Segment_length(&(um->segments), 0), um, ~(uint32_t)0,
+                         "program counter outside segment 0 (length %"
+                         PRIu32 ")",
+                         Segment_length(&(um->segments), 0));
+                uint32_t instruction = Segment_word_at(&(um->segments), 0,
+                                   um->program_count);
+                handle_instruction(um, instruction);
+                um->program_count++;
+                count++;
+        }
 
-        um->registers[rA] = um->registers[rB] / um->registers[rC];
+        return um->blocked ? count - 1 : count;
 }
+#endif
 
-/********************************um_nand***************************************
+/***************************handle_instruction*********************************
  *
- * Executes NAND operation of the um
+ * Decodes and executes a single instruction
  * Inputs:
- *         um_T um:  The um that is in use
- *         int rA:   The number of register A, the destination of the result
- *         int rB:   The number of register B, containing a value to NAND
- *         int rC:   The number of register C, containing a value to NAND
+ *         struct um_T *um:      The um executing the instruction
+ *         uint32_t instruction: The bitpacked instruction word
  * Return: none
  * Expects:
- *         um to be non-null
- *         rA, rB, and rC to be in range [0, 7]
+ *         none
  * Notes:
- *         CRE if um is null
- *         CRE if rA, rB, or rC is not in range [0, 7]
+ *         Every UM failure is a fault in the diagnostic build and undefined
+ *         behavior in the fast build
  *****************************************************************************/
-static void um_nand(um_T um, int rA, int rB, int rC)
+static inline void handle_instruction(struct um_T *um, uint32_t instruction)
 {
-        /* Ensuring non-null value was passed in */
-        assert(um && rA >= 0 && rA < 8 && 
-               rB >= 0 && rB < 8 && rC >= 0 && rC < 8);
-
-        um->registers[rA] = ~(um->registers[rB] & um->registers[rC]);
+        uint32_t op_code = Bitpack_getu(instruction, 4, 28);
+        uint32_t rA = 0;
+        uint32_t rB = 0;
+        uint32_t rC = 0;
+        uint32_t value = 0;
+        uint32_t *r = um->registers;
+
+        /* Unpacking values from instruction */
+        if (op_code == 13) {
+                rA = Bitpack_getu(instruction, 3, 25);
+                value = Bitpack_getu(instruction, 25, 0);
+        }
+        else {
+                rA = Bitpack_getu(instruction, 3, 6);
+                rB = Bitpack_getu(instruction, 3, 3);
+                rC = Bitpack_getu(instruction, 3, 0);
+        }
+#ifdef UM_EXTENDED_OPS
+        uint32_t rD = Bitpack_getu(instruction, 3, 9);
+        uint32_t rE = Bitpack_getu(instruction, 3, 12);
+#endif
+
+        /* Handling command */
+        switch (op_code) {
+        case 0:
+                if (r[rC] != 0) {
+                        r[rA] = r[rB];
+                }
+                break;
+        case 1:
+                UM_CHECK(Segment_is_mapped(&(um->segments), r[rB]), um,
+                         instruction, "load from unmapped segment %" PRIu32,
+                         r[rB]);
+                UM_CHECK(r[rC] < Segment_length(&(um->segments), r[rB]), um,
+                         instruction, "load from segment %" PRIu32
+                         " offset %" PRIu32 " (length %" PRIu32 ")", r[rB], r[rC],
+                         Segment_length(&(um->segments), r[rB]));
+                r[rA] = Segment_word_at(&(um->segments), r[rB], r[rC]);
+                break;
+        case 2:
+                UM_CHECK(Segment_is_mapped(&(um->segments), r[rA]), um,
+                         instruction, "store to unmapped segment %" PRIu32,
+                         r[rA]);
+                UM_CHECK(r[rB] < Segment_length(&(um->segments), r[rA]), um,
+                         instruction, "store to segment %" PRIu32
+                         " offset %" PRIu32 " (length %" PRIu32 ")", r[rA], r[rB],
+                         Segment_length(&(um->segments), r[rA]));
+                Segment_load_word(&(um->segments), r[rA], r[rB], r[rC]);
+#ifdef UM_LOOP_IDIOMS
+                if (r[rA] == 0) {
+                        Idiom_store(&(um->idioms), r[rB]);
+                }
+#endif
+                break;
+        case 3:
+                r[rA] = r[rB] + r[rC];
+                break;
+        case 4:
+                r[rA] = r[rB] * r[rC];
+                break;
+        case 5:
+                UM_CHECK(r[rC] != 0, um, instruction, "division by zero");
+                r[rA] = r[rB] / r[rC];
+                break;
+        case 6:
+                r[rA] = ~(r[rB] & r[rC]);
+                break;
+        case 7:
+#ifdef UM_LATENCY
+                Latency_report(&(um->latency));
+#endif
+#ifdef UM_PROFILE
+                Profile_write(&(um->profile), "um.prof");
+#endif
+#ifdef UM_LOOP_IDIOMS
+                Idiom_free(&(um->idioms));
+#endif
+                Segment_free(&(um->segments));
+                um->halt = true;
+                break;
+        case 8:
+                r[rB] = Segment_map(&(um->segments), r[rC]);
+                break;
+        case 9:
+                UM_CHECK(r[rC] != 0, um, instruction, "unmap of segment 0");
+                UM_CHECK(Segment_is_mapped(&(um->segments), r[rC]), um,
+                         instruction, "unmap of unmapped segment %" PRIu32,
+                         r[rC]);
+                Segment_unmap(&(um->segments), r[rC]);
+                break;
+        case 10:
+                UM_CHECK(r[rC] < 256, um, instruction,
+                         "output of non-character %" PRIu32, r[rC]);
+#ifdef UM_SESSION
+                um_session_output(um, r[rC]);
+#else
+                putchar(r[rC]);
+#endif
+#ifdef UM_LATENCY
+                Latency_output(&(um->latency));
+#endif
+                break;
+        case 11: ;
+#ifdef UM_SESSION
+                /* Not ready: stop here and rerun IN on the next slice */
+                if (!um_session_input(um, &r[rC])) {
+                        um->blocked = true;
+                        um->program_count--;
+                }
+#else
+#ifdef UM_LATENCY
+                fflush(stdout);
+                Latency_wait(&(um->latency));
+#endif
+                int c = getchar();
+                if (c == EOF)
+                        r[rC] = ~(uint32_t)0;
+                else
+                        r[rC] = (uint32_t) c;
+#ifdef UM_LATENCY
+                Latency_read(&(um->latency), r[rC]);
+#endif
+#endif
+                break;
+        case 12:
+                UM_CHECK(Segment_is_mapped(&(um->segments), r[rB]), um,
+                         instruction, "load program from unmapped segment %"
+                         PRIu32, r[rB]);
+                UM_CHECK(r[rC] < Segment_length(&(um->segments), r[rB]), um,
+                         instruction, "jump to offset %" PRIu32
+                         " of segment %" PRIu32 " (length %" PRIu32 ")", r[rC], r[rB],
+                         Segment_length(&(um->segments), r[rB]));
+#ifdef UM_LOOP_IDIOMS
+                if (r[rB] != 0) {
+                        Segment_load_program(&(um->segments), r[rB]);
+                        Idiom_reset(&(um->idioms));
+                }
+                else if (r[rC] <= (uint32_t) um->program_count) {
+                        /* A back edge: run the loop in bulk if it can be */
+                        uint32_t head = r[rC];
+                        Idiom_run(&(um->idioms), &(um->segments), r, head,
+                                  um->program_count);
+                        um->program_count = head - 1;
+                        break;
+                }
+#else
+                if (r[rB] != 0) {
+                        Segment_load_program(&(um->segments), r[rB]);
+#ifdef UM_PROFILE
+                        Profile_load(&(um->profile),
+                                     Segment_length(&(um->segments), 0));
+#endif
+                }
+#endif
+#ifdef UM_PROFILE
+                Profile_jump(&(um->profile), um->program_count, r[rC], r[1]);
+#endif
+                um->program_count = r[rC] - 1;
+                break;
+        case 13:
+                r[rA] = value;
+                break;
+#ifdef UM_EXTENDED_OPS
+        case 14:
+                UM_CHECK(Segment_is_mapped(&(um->segments), r[rA]) &&
+                         Segment_is_mapped(&(um->segments), r[rC]), um,
+                         instruction, "copy between segments %" PRIu32
+                         " and %" PRIu32 ", not both mapped", r[rA], r[rC]);
+                UM_CHECK(r[rB] <= Segment_length(&(um->segments), r[rA]) &&
+                         r[rE] <= Segment_length(&(um->segments), r[rA]) -
+                                  r[rB], um, instruction, "copy of %" PRIu32
+                         " words to segment %" PRIu32 " offset %" PRIu32
+                         " (length %" PRIu32 ")", r[rE], r[rA], r[rB],
+                         Segment_length(&(um->segments), r[rA]));
+                UM_CHECK(r[rD] <= Segment_length(&(um->segments), r[rC]) &&
+                         r[rE] <= Segment_length(&(um->segments), r[rC]) -
+                                  r[rD], um, instruction, "copy of %" PRIu32
+                         " words from segment %" PRIu32 " offset %" PRIu32
+                         " (length %" PRIu32 ")", r[rE], r[rC], r[rD],
+                         Segment_length(&(um->segments), r[rC]));
+                memmove(Segment_words(&(um->segments), r[rA]) + r[rB],
+                        Segment_words(&(um->segments), r[rC]) + r[rD],
+                        (size_t) r[rE] * sizeof(uint32_t));
+#ifdef UM_LOOP_IDIOMS
+                if (r[rA] == 0) {
+                        Idiom_reset(&(um->idioms));
+                }
+#endif
+                break;
+        case 15:
+                UM_CHECK(Segment_is_mapped(&(um->segments), r[rA]), um,
+                         instruction, "fill of unmapped segment %" PRIu32,
+                         r[rA]);
+                UM_CHECK(r[rB] <= Segment_length(&(um->segments), r[rA]) &&
+                         r[rD] <= Segment_length(&(um->segments), r[rA]) -
+                                  r[rB], um, instruction, "fill of %" PRIu32
+                         " words at segment %" PRIu32 " offset %" PRIu32
+                         " (length %" PRIu32 ")", r[rD], r[rA], r[rB],
+                         Segment_length(&(um->segments), r[rA]));
+                {
+                        uint32_t *words = Segment_words(&(um->segments),
+                                                        r[rA]) + r[rB];
+                        uint32_t fill = r[rC];
+                        for (uint32_t i = r[rD]; i > 0; i--) {
+                                *words++ = fill;
+                        }
+                }
+#ifdef UM_LOOP_IDIOMS
+                if (r[rA] == 0) {
+                        Idiom_reset(&(um->idioms));
+                }
+#endif
+                break;
+#endif
+        default:
+                UM_CHECK(false, um, instruction, "invalid opcode");
+                break;
+        }
 }
 
-/********************************um_halt***************************************
+/********************************Bitpack_getu**********************************
  *
- * Executes halt operation of the um that stops the um from running
+ * Extracts an unsigned field from a word
  * Inputs:
- *         um_T um: The um that is in use
- * Return: none
+ *         uint64_t word: The word to extract from
+ *         unsigned width: The width of the field in bits
+ *         unsigned lsb:   The least significant bit of the field
+ * Return: The value of the field
  * Expects:
- *         um to be non-null
+ *         0 < width and lsb + width <= 64
  * Notes:
- *         CRE if um is null
+ *         none
  *****************************************************************************/
-static void um_halt(um_T um)
+static inline uint64_t Bitpack_getu(uint64_t word, unsigned width,
+                                    unsigned lsb)
 {
-        /* Ensuring non-null value was passed in */
-        assert(um);
-
-        Segment_free(&um->segments);
-        um->segments = NULL;
+        unsigned hi = lsb + width;
+        return (word << (64 - hi)) >> (64 - width);
 }
 
-/********************************um_map_seg************************************
- *
- * Executes map segment operation of the um that allows the user to allocate
- * memory for a segment
- * Inputs:
- *         um_T um:  The um that is in use
- *         int rB:   The number of register B, where the id of the mapped 
- *                   segment will be stored
- *         int rC:   The number of register C, which contains the length of the
- *                   new segment
- * Return: none
- * Expects:
- *         um to be non-null
- *         rB and rC to be in range [0, 7]
- * Notes:
- *         CRE if um is null
- *         CRE if rB or rC is not in range [0, 7]
- *****************************************************************************/
-static void um_map_seg(um_T um, int rB, int rC)
-{
-        /* Ensuring non-null value was passed in */
-        assert(um && rB >= 0 && rB < 8 && rC >= 0 && rC < 8);
-
-        um->registers[rB] = Segment_map(um->segments, um->registers[rC]);
-}
 
-/********************************um_unmap_seg**********************************
+#if defined(UM_CHECKED) || defined(UM_GUARD_PAGES)
+/*******************************um_report_text*********************************
  *
- * Executes unmap segment operation of the um that allows the user to
- * deallocate memory associated with a segment
+ * Appends text to a fault report
  * Inputs:
- *         um_T um:  The um that is in use
- *         int rC:   The number of register C, which contatins the id of the 
- *                   segment to unmap
+ *         struct um_report *report: The report
+ *         const char *text:         The text to append
  * Return: none
  * Expects:
- *         um to be non-null
- *         rC to be in range [0, 7]
- *         registers[rC] to be non-zero
+ *         report->text to hold a string report->length long
  * Notes:
- *         CRE if um is null
- *         CRE if rC is not in range [0, 7]
- *         CRE if registers[rC] is zero
+ *         Whatever does not fit is dropped; the text stays a string
  *****************************************************************************/
-static void um_unmap_seg(um_T um, int rC)
+static void um_report_text(struct um_report *report, const char *text)
 {
-        /* Ensuring non-null value was passed in */
-        assert(um && rC >= 0 && rC < 8 && um->registers[rC] != 0);
-
-        Segment_unmap(um->segments,  um->registers[rC]);
+        while (*text != '\0' && report->length + 1 < sizeof(report->text)) {
+                report->text[report->length++] = *text++;
+        }
+        report->text[report->length] = '\0';
 }
 
-/********************************um_output*************************************
+/******************************um_report_number********************************
  *
- * Executes output operation of the um that allows the user to print out a
- * value from a register
+ * Appends a number to a fault report
  * Inputs:
- *         um_T um:  The um that is in use
- *         int rC:   The number of register C which contains the value that
- *                   will be printed out
+ *         struct um_report *report: The report
+ *         uint64_t n:               The number
+ *         unsigned base:            10 or 16 (lower case digits)
+ *         int digits:               The fewest digits written, padded
+ *                                   with zeros on the left
  * Return: none
  * Expects:
- *         um to be non-null
- *         rC to be in range [0, 7]
+ *         digits to be at most 64
  * Notes:
- *         CRE if um is null
- *         CRE if rC is not in range [0, 7]
+ *         none
  *****************************************************************************/
-static void um_output(um_T um, int rC)
+static void um_report_number(struct um_report *report, uint64_t n,
+                             unsigned base, int digits)
 {
-        /* Ensuring non-null value was passed in */
-        assert(um && rC >= 0 && rC < 8);
-        assert(um->registers[rC] < 256);
-
-        putchar(um->registers[rC]);
+        char text[65];
+        int i = sizeof(text) - 1;
+        text[i] = '\0';
+        do {
+                text[--i] = "0123456789abcdef"[n % base];
+                n /= base;
+                digits--;
+        } while (n != 0 || digits > 0);
+        um_report_text(report, &text[i]);
 }
 
-/********************************um_input**************************************
+/*******************************um_fault_report********************************
  *
- * Executes input operation of the um that allows the user to provide input
- * that gets stored in a register
+ * Writes a UM failure report to standard error and stops the program
  * Inputs:
- *         um_T um:  The um that is in use
- *         int rC:   The number of register C which will store the value that
- *                   the user provides
- * Return: none
+ *         struct um_T *um:      The um that failed
+ *         uint32_t instruction: The instruction being executed
+ *         const char *what:     What went wrong
+ * Return: none, exits with EXIT_FAILURE
  * Expects:
- *         um to be non-null
- *         rC to be in range [0, 7]
+ *         none
  * Notes:
- *         CRE if um is null
- *         CRE if rC is not in range [0, 7]
+ *         Safe to call from a signal handler: the report is built on the
+ *         stack without stdio or malloc, written with write(2), and the
+ *         program ends with _exit. Nothing is flushed here
  *****************************************************************************/
-static void um_input(um_T um, int rC)
+static void um_fault_report(struct um_T *um, uint32_t instruction,
+                            const char *what)
 {
-        int c = getchar();
-
-        if (c == EOF) {
-                um->registers[rC] = ~(uint32_t)0;
+        static const char *const names[16] = {
+                "CMOV", "SLOAD", "SSTORE", "ADD", "MUL", "DIV", "NAND",
+                "HALT", "MAP", "UNMAP", "OUT", "IN", "LOADP", "LV",
+#ifdef UM_EXTENDED_OPS
+                "COPY", "FILL"
+#else
+                "?", "?"
+#endif
+        };
+        uint32_t op_code = Bitpack_getu(instruction, 4, 28);
+        struct Segment_T *seg = &(um->segments);
+        struct um_report report;
+        report.length = 0;
+
+        um_report_text(&report, "um: fault at pc ");
+        um_report_number(&report, (uint32_t) um->program_count, 10, 1);
+        um_report_text(&report, ": opcode ");
+        um_report_number(&report, op_code, 10, 1);
+        um_report_text(&report, " (");
+        um_report_text(&report, names[op_code]);
+        um_report_text(&report, "), instruction 0x");
+        um_report_number(&report, instruction, 16, 8);
+        um_report_text(&report, ": ");
+        um_report_text(&report, what);
+        um_report_text(&report, "\n");
+
+        for (int i = 0; i < 8; i++) {
+                um_report_text(&report, "  r");
+                um_report_number(&report, i, 10, 1);
+                um_report_text(&report, " = 0x");
+                um_report_number(&report, um->registers[i], 16, 8);
+                if (i % 4 == 3) {
+                        um_report_text(&report, "\n");
+                }
         }
-        else {
-                assert(c < 256);
-                um->registers[rC] = (uint32_t) c;
-        }
-}
-
-/********************************um_load_prog**********************************
- *
- * Executes load program operation of the um that duplicates a segment and
- * replaces it with the current segment at segment zero
- * Inputs:
- *         um_T um:  The um that is in use
- *         int rB:   The number of register B which contains the id of the 
- *                   segment that will be duplicated
- *         int rC:   The number of register C which contains the value that
- *                   program counter will be set to
- * Return: none
- * Expects:
- *         um to be non-null
- *         rB and rC to be in range [0, 7]
- *         registers[rC] to be less than the length of the segment whose id is
- *         in register[rB]
- *         Program counter to point to a valid instruction in segment zero
- * Notes:
- *         CRE if um is null
- *         CRE if rC is not in range [0, 7]
- *         CRE if registers[rC] is greater than or equal to the length of the
- *         segment whose id is in register[rB]
- *         CRE if program counter points to an invalid instruction in segment
- *         zero
- *****************************************************************************/
-static void um_load_prog(um_T um, int rB, int rC)
-{
-        /* Ensuring non-null value was passed in */
-        assert(um && rB >= 0 && rB < 8 && rC >= 0 && rC < 8);
-
-        /* Loading segment zero to segment zero */
-        if (um->registers[rB] != 0) {
-                Segment_load_program(um->segments, um->registers[rB]);
+        um_report_text(&report, "  segment 0 length ");
+        um_report_number(&report, Segment_length(seg, 0), 10, 1);
+        um_report_text(&report, ", ");
+        um_report_number(&report, Segment_ids_issued(seg), 10, 1);
+        um_report_text(&report, " IDs issued, ");
+        um_report_number(&report, Segment_ids_free(seg), 10, 1);
+        um_report_text(&report, " awaiting reuse\n");
+
+        size_t written = 0;
+        while (written < report.length) {
+                ssize_t n = write(STDERR_FILENO, report.text + written,
+                                  report.length - written);
+                if (n <= 0) {
+                        break;
+                }
+                written += n;
         }
-
-        /* Assert program counters new placement is in bounds of seg 0 */
-        assert((int) um->registers[rC] < Segment_line_length(um->segments, 0));
-
-        /* Minus one because we increment program counter every time in run */
-        um->program_count = um->registers[rC];
-        assert(um_is_valid_inst(um));
+        _exit(EXIT_FAILURE);
 }
+#endif
 
-/********************************um_load_val***********************************
+#ifdef UM_CHECKED
+/**********************************um_fault************************************
  *
- * Executes load value operation of the um that loads a value into a register
+ * Reports a failed UM_CHECK and stops the program
  * Inputs:
- *         um_T um:      The um that is in use
- *         int rA:       The number of register A which will store the value
- *                       provided
- *         uint32_t val: The value that will be stored in the register
- * Return: none
+ *         struct um_T *um:      The um that failed
+ *         uint32_t instruction: The instruction being executed
+ *         const char *fmt, ...: printf-style description of the failure
+ * Return: none, exits with EXIT_FAILURE
  * Expects:
- *         um to be non-null
- *         rA to be in range [0, 7]
+ *         not to be called from a signal handler
  * Notes:
- *         CRE if um is null
- *         CRE if rA is not in range [0, 7]
+ *         Standard output is flushed first so the report follows whatever the
+ *         program printed
  *****************************************************************************/
-static void um_load_val(um_T um, int rA, uint32_t val)
+static void um_fault(struct um_T *um, uint32_t instruction,
+                     const char *fmt, ...)
 {
-        /* Ensuring non-null value was passed in */
-        assert(um && rA >= 0 && rA < 8);
-
-        um->registers[rA] = val;
+        char what[256];
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(what, sizeof(what), fmt, args);
+        va_end(args);
+
+        fflush(stdout);
+        um_fault_report(um, instruction, what);
 }
+#endif
 
-/***************************um_is_valid_inst***********************************
+#ifdef UM_GUARD_PAGES
+/********************************um_guard_fault********************************
  *
- * Determines whether the word at program counter contains a valid instruction
+ * Turns a hardware fault into a UM fault report
  * Inputs:
- *         um_T um: The um that is in use
- * Return: Boolean indicating whether the word at program counter contains a 
- *         valid instruction
+ *         void *addr: The address whose access faulted
+ * Return: none, exits with EXIT_FAILURE
  * Expects:
- *         um to be non-null
+ *         um_running to be the machine that was executing
  * Notes:
- *         CRE if um is null
+ *         Called from the SIGSEGV handler. An address in the guard page after
+ *         a segment is reported as an out-of-bounds access to that segment;
+ *         anything else (usually a NULL-based access to an unmapped segment)
+ *         is reported by address. Only async-signal-safe calls are made, so
+ *         standard output is not flushed, and what the program had buffered
+ *         there is lost.
  *****************************************************************************/
-static bool um_is_valid_inst(um_T um)
+static void um_guard_fault(void *addr)
 {
-        /* Ensuring non-null value was passed in */
-        assert(um);
-
-        /* Access the instruction from segment zero */
-        uint32_t word = Segment_word_at(um->segments, 0, um->program_count);
-        uint32_t op_code = Bitpack_getu(word, 4, 28);
+        struct um_T *um = um_running;
+        struct Segment_T *seg = &(um->segments);
+        uint32_t instruction = Segment_word_at(seg, 0, um->program_count);
+        char *fault = addr;
+        struct um_report what;
+        what.length = 0;
+
+        for (uint32_t id = 0; id < Segment_ids_issued(seg); id++) {
+                uint32_t *words = Segment_words(seg, id);
+                if (words == NULL) {
+                        continue;
+                }
+                uint32_t length = Segment_length(seg, id);
+                char *end = (char *) (words + length);
+                if (fault >= end && fault < end + GUARD_BYTES) {
+                        um_report_text(&what, "segment ");
+                        um_report_number(&what, id, 10, 1);
+                        um_report_text(&what, " offset ");
+                        um_report_number(&what, (fault - (char *) words)
+                                                / sizeof(uint32_t), 10, 1);
+                        um_report_text(&what, " is past its end (length ");
+                        um_report_number(&what, length, 10, 1);
+                        um_report_text(&what, ")");
+                        um_fault_report(um, instruction, what.text);
+                }
+        }
 
-        return op_code <= 13;
+        um_report_text(&what, "access to unmapped segment or wild "
+                       "address 0x");
+        um_report_number(&what, (uintptr_t) addr, 16, 1);
+        um_fault_report(um, instruction, what.text);
 }
+#endif
 
-#endif
\ No newline at end of file
+#endif
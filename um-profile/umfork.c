@@ -0,0 +1,375 @@
+/******************************************************************************
+ *
+ *                                  umfork.c
+ *
+ *     Assignment: um
+ *     Authors:    Marten Tropp and Matthew Carey
+ *     Date:       11/20/2023
+ *
+ *     The purpose of this file is to run one UM program against many inputs
+ *     without paying for loading it each time. The program is loaded once;
+ *     with -warm it is also run up to the first IN instruction, which for a
+ *     self-decompressing program like advent.umz or sandmark.umz is past the
+ *     decompression. Then, for every line read from the control pipe on
+ *     standard input, the server forks a child that shares the loaded
+ *     machine copy-on-write and finishes running it against one input.
+ *
+ *     A control line names an input file and, optionally, the file the
+ *     output goes to (by default the input's name with .out appended). For
+ *     each child one result line is printed on standard output:
+ *
+ *         input status=STATUS instructions=N output=BYTES ms=TIME
+ *
+ *     where STATUS is halt, limit (the -limit budget ran out), exit N or
+ *     signal N, and N counts the instructions of the warm-up as well. N is
+ *     "-" when the child did not halt, since it never got to report it.
+ *
+ *     Usage: umfork [-warm] [-jobs N] [-limit INSTRUCTIONS] program.um
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "um.h"
+
+/* Instructions a child runs between checks of its -limit */
+#define SLICE (1u << 24)
+
+/* Exit status of a child that ran out of instructions */
+#define LIMIT_STATUS 3
+
+/*********************************child_T**************************************
+ *
+ * A running child.
+ * Stores:
+ *         pid_t pid:       Its process ID, 0 for a free slot
+ *         int result:      Read end of the pipe it reports its count on
+ *         char *input:     The input file it was given
+ *         char *output:    The file its output goes to
+ *         double started:  When it was forked
+ *
+ *****************************************************************************/
+typedef struct child_T {
+        pid_t pid;
+        int result;
+        char *input;
+        char *output;
+        double started;
+} child_T;
+
+/* While warming, IN finds no input and output is saved to replay in every
+   child; in a child, input and output are the files it was given */
+static bool warming = true;
+static unsigned char *warm_output = NULL;
+static size_t warm_length = 0;
+static size_t warm_capacity = 0;
+static FILE *child_in = NULL;
+static FILE *child_out = NULL;
+
+static double now(void)
+{
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/****************************um_session_input**********************************
+ *
+ * Gives the machine the next byte of input
+ * Inputs:
+ *         struct um_T *um: The machine executing IN
+ *         uint32_t *word:  Where the byte is stored
+ * Return: false while warming, which stops the warm-up at the first IN
+ * Expects:
+ *         child_in to be open outside the warm-up
+ * Notes:
+ *         Stores ~0 at the end of the input file
+ *****************************************************************************/
+static bool um_session_input(struct um_T *um, uint32_t *word)
+{
+        (void) um;
+        if (warming) {
+                return false;
+        }
+        int c = getc(child_in);
+        *word = c == EOF ? ~(uint32_t)0 : (uint32_t) c;
+        return true;
+}
+
+/****************************um_session_output*********************************
+ *
+ * Writes a byte of output, or saves it while warming
+ *
+ *****************************************************************************/
+static void um_session_output(struct um_T *um, uint32_t c)
+{
+        (void) um;
+        if (!warming) {
+                putc(c, child_out);
+                return;
+        }
+        if (warm_length == warm_capacity) {
+                warm_capacity = warm_capacity == 0 ? 256 : warm_capacity * 2;
+                warm_output = realloc(warm_output, warm_capacity);
+                assert(warm_output);
+        }
+        warm_output[warm_length++] = c;
+}
+
+/*********************************load_image***********************************
+ *
+ * Reads a .um file into a new machine
+ * Inputs:
+ *         const char *path: The program
+ * Return: A machine with the program in segment zero
+ * Expects:
+ *         none
+ * Notes:
+ *         Exits with an error message if the file cannot be opened
+ *****************************************************************************/
+static struct um_T load_image(const char *path)
+{
+        FILE *fp = fopen(path, "rb");
+        if (fp == NULL) {
+                fprintf(stderr, "Error opening file.\n");
+                exit(1);
+        }
+        fseek(fp, 0L, SEEK_END);
+        uint32_t length = ftell(fp) / 4;
+        fseek(fp, 0L, SEEK_SET);
+
+        struct um_T um = um_new(length);
+        uint32_t *words = Segment_words(&um.segments, 0);
+        for (uint32_t i = 0; i < length; i++) {
+                uint32_t word = 0;
+                for (int b = 0; b < 4; b++) {
+                        word = (word << 8) | (uint32_t) getc(fp);
+                }
+                words[i] = word;
+        }
+        fclose(fp);
+
+        return um;
+}
+
+/********************************run_child*************************************
+ *
+ * Finishes running the machine against one input, in a forked child
+ * Inputs:
+ *         struct um_T *um:   The (copy-on-write) loaded machine
+ *         uint64_t warmed:   Instructions already run by the warm-up
+ *         uint64_t limit:    Most instructions to run in all, 0 for no limit
+ *         const char *input, *output: The files to read and write
+ *         int result:        Pipe to report the instruction count on
+ * Return: none, exits with 0 when the machine halts, LIMIT_STATUS when it
+ *         runs out of instructions
+ * Expects:
+ *         none
+ * Notes:
+ *         Output saved during the warm-up is written first
+ *****************************************************************************/
+static void run_child(struct um_T *um, uint64_t warmed, uint64_t limit,
+                      const char *input, const char *output, int result)
+{
+        child_in = fopen(input, "rb");
+        child_out = fopen(output, "wb");
+        if (child_in == NULL || child_out == NULL) {
+                perror(child_in == NULL ? input : output);
+                _exit(1);
+        }
+        warming = false;
+        fwrite(warm_output, 1, warm_length, child_out);
+
+        uint64_t count = warmed;
+        while (!um->halt) {
+                uint64_t budget = SLICE;
+                if (limit != 0 && limit - count < budget) {
+                        budget = limit - count;
+                }
+                if (budget == 0) {
+                        fclose(child_out);
+                        _exit(LIMIT_STATUS);
+                }
+                count += um_run_slice(um, budget);
+        }
+
+        fclose(child_out);
+        ssize_t n = write(result, &count, sizeof(count));
+        (void) n;
+        _exit(0);
+}
+
+/*********************************report***************************************
+ *
+ * Waits for any child to finish and prints its result line
+ * Inputs:
+ *         child_T *children: The slots of running children
+ *         int jobs:          Number of slots
+ * Return: none
+ * Expects:
+ *         at least one child to be running
+ * Notes:
+ *         Frees the child's slot
+ *****************************************************************************/
+static void report(child_T *children, int jobs)
+{
+        int status;
+        pid_t pid = wait(&status);
+        assert(pid > 0);
+
+        child_T *c = NULL;
+        for (int i = 0; i < jobs; i++) {
+                if (children[i].pid == pid) {
+                        c = &children[i];
+                }
+        }
+        assert(c != NULL);
+        double elapsed = now() - c->started;
+
+        uint64_t count;
+        bool counted = read(c->result, &count, sizeof(count)) ==
+                       sizeof(count);
+        close(c->result);
+
+        long bytes = -1;
+        FILE *out = fopen(c->output, "rb");
+        if (out != NULL) {
+                fseek(out, 0L, SEEK_END);
+                bytes = ftell(out);
+                fclose(out);
+        }
+
+        printf("%s status=", c->input);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+                printf("halt");
+        }
+        else if (WIFEXITED(status) && WEXITSTATUS(status) == LIMIT_STATUS) {
+                printf("limit");
+        }
+        else if (WIFEXITED(status)) {
+                printf("exit %d", WEXITSTATUS(status));
+        }
+        else {
+                printf("signal %d", WTERMSIG(status));
+        }
+        if (counted) {
+                printf(" instructions=%" PRIu64, count);
+        }
+        else {
+                printf(" instructions=-");
+        }
+        printf(" output=%ld ms=%.3f\n", bytes, elapsed * 1e3);
+        fflush(stdout);
+
+        free(c->input);
+        free(c->output);
+        c->pid = 0;
+}
+
+static void usage(void)
+{
+        fprintf(stderr, "Usage: ./umfork [-warm] [-jobs N] "
+                "[-limit INSTRUCTIONS] [file].um\n");
+        exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+        bool warm = false;
+        int jobs = 1;
+        uint64_t limit = 0;
+        int i;
+
+        for (i = 1; i < argc - 1; i++) {
+                if (strcmp(argv[i], "-warm") == 0) {
+                        warm = true;
+                }
+                else if (strcmp(argv[i], "-jobs") == 0 && i + 2 < argc) {
+                        jobs = atoi(argv[++i]);
+                }
+                else if (strcmp(argv[i], "-limit") == 0 && i + 2 < argc) {
+                        limit = strtoull(argv[++i], NULL, 10);
+                }
+                else {
+                        usage();
+                }
+        }
+        if (i != argc - 1 || jobs < 1) {
+                usage();
+        }
+
+        struct um_T um = load_image(argv[i]);
+        uint64_t warmed = 0;
+        if (warm) {
+                double start = now();
+                warmed = um_run_slice(&um, limit != 0 ? limit : UINT64_MAX);
+                fprintf(stderr, "umfork: warmed up in %" PRIu64
+                        " instructions (%.3fs)\n", warmed, now() - start);
+        }
+
+        child_T *children = calloc(jobs, sizeof(child_T));
+        assert(children);
+        int running = 0;
+
+        char line[4096];
+        while (fgets(line, sizeof(line), stdin) != NULL) {
+                char input[2048], output[2048 + 4];
+                int fields = sscanf(line, "%2047s %2047s", input, output);
+                if (fields < 1) {
+                        continue;
+                }
+                if (fields == 1) {
+                        snprintf(output, sizeof(output), "%s.out", input);
+                }
+
+                if (running == jobs) {
+                        report(children, jobs);
+                        running--;
+                }
+                child_T *c = children;
+                while (c->pid != 0) {
+                        c++;
+                }
+
+                int fds[2];
+                if (pipe(fds) != 0) {
+                        perror("umfork");
+                        exit(1);
+                }
+                fflush(stdout);
+                c->started = now();
+                c->pid = fork();
+                if (c->pid < 0) {
+                        perror("umfork");
+                        exit(1);
+                }
+                if (c->pid == 0) {
+                        close(fds[0]);
+                        run_child(&um, warmed, limit, input, output, fds[1]);
+                }
+                close(fds[1]);
+                c->result = fds[0];
+                c->input = strdup(input);
+                c->output = strdup(output);
+                running++;
+        }
+
+        while (running > 0) {
+                report(children, jobs);
+                running--;
+        }
+
+        free(children);
+        free(warm_output);
+        if (!um.halt) {
+                Segment_free(&um.segments);
+        }
+        return EXIT_SUCCESS;
+}
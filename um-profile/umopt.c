@@ -0,0 +1,1395 @@
+/******************************************************************************
+ *
+ *                                  umopt.c
+ *
+ *     Assignment: profile
+ *     Authors:    Marten Tropp and Matthew Carey
+ *     Date:       11/20/2023
+ *
+ *     The purpose of this file is to optimize an assembled .um program
+ *     offline. It first proves the program is safe to rewrite:
+ *
+ *         - every reachable LOADP provably loads segment 0, so no code is
+ *           ever loaded from another segment;
+ *         - no load or store provably touches an instruction in segment 0
+ *           (accesses whose offsets cannot be computed, such as pushes and
+ *           pops through r2, are only accepted with -trust-data);
+ *         - every indirect jump goes through a register holding a constant
+ *           or a value loaded from memory, never through arithmetic.
+ *
+ *     It then repeats three kinds of rounds until nothing changes:
+ *
+ *         1. jump threading: a jump to a block that only jumps on is
+ *            retargeted to the final destination;
+ *         2. constant propagation: instructions whose result is already in
+ *            their destination are deleted, constant results are rewritten
+ *            as LV, and a load right after a store to the same address is
+ *            forwarded from the stored register;
+ *         3. dead-store elimination: pure instructions whose destination is
+ *            never read are deleted.
+ *
+ *     Finally every basic block is compacted: surviving instructions move
+ *     up to the block's leader, and a block that falls through with at least
+ *     three free slots jumps to its successor instead of running no-ops.
+ *     Only non-leader addresses move, and every address the program can
+ *     jump to is a leader, so no code pointer needs rewriting.
+ *
+ *     Code pointers are assumed to enter registers only through LV (directly
+ *     or after a round trip through memory) or as words of the original
+ *     image; a program that computes jump targets arithmetically is
+ *     rejected.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+/* Largest set of constants a register can hold before it is "computed" */
+#define MAXSET 32
+
+/* Largest value LV can load */
+#define LV_MAX ((1u << 25) - 1)
+
+enum op { CMOV, SLOAD, SSTORE, ADD, MUL, DIV, NAND, HALT, MAP, UNMAP, OUT,
+          IN, LOADP, LV };
+
+/***********************************Value**************************************
+ *
+ * What the analysis knows about a register.
+ *         BOT:      no path reaches here yet
+ *         SET:      one of n constants, in vals[0..n)
+ *         NONZERO:  a segment ID returned by MAP
+ *         LOADED:   a value read from memory
+ *         COMPUTED: anything else (arithmetic on unknowns, input)
+ *
+ *****************************************************************************/
+enum kind { BOT, SET, NONZERO, LOADED, COMPUTED };
+
+struct Value {
+        uint8_t kind;
+        uint8_t n;
+        uint32_t vals[MAXSET];
+};
+
+struct State {
+        struct Value r[8];
+};
+
+/**********************************Program*************************************
+ *
+ * The program being optimized and everything known about it.
+ *         uint32_t *words:     the image, rewritten in place at the end
+ *         uint32_t n:          number of words
+ *         bool *deleted:       instructions removed so far
+ *         bool trust_data:     accesses with unknown offsets are to data
+ *         struct State **in:   state on entry to each leader, NULL elsewhere
+ *         bool *reached:       instructions on some path from 0
+ *         bool *taken:         the address-taken set A: constants stored to
+ *                              memory or present in the image
+ *         bool *data:          words read or written at constant offsets;
+ *                              with -trust-data these are never jumped to
+ *                              through memory
+ *         bool grew:           taken or data grew during a pass
+ *         bool checking:       accesses to reached code are failures
+ *         uint8_t *live_in:    registers live on entry to each leader
+ *         const char *error:   why the proof failed, NULL if it holds
+ *         uint32_t error_pc:   where it failed
+ *
+ *****************************************************************************/
+struct Program {
+        uint32_t *words;
+        uint32_t n;
+        bool *deleted;
+        bool trust_data;
+
+        struct State **in;
+        bool *reached;
+        bool *taken;
+        bool *data;
+        bool grew;
+        bool checking;
+        uint8_t *live_in;
+
+        const char *error;
+        uint32_t error_pc;
+};
+
+struct Stats {
+        unsigned threaded;
+        unsigned redundant;
+        unsigned folded;
+        unsigned forwarded;
+        unsigned dead;
+        unsigned jumps_added;
+};
+
+static bool analyze(struct Program *p);
+static void compute_liveness(struct Program *p);
+static bool thread_jumps(struct Program *p, struct Stats *stats);
+static bool propagate_constants(struct Program *p, struct Stats *stats);
+static bool eliminate_dead(struct Program *p, struct Stats *stats);
+static void compact(struct Program *p, struct Stats *stats);
+
+/*******************************decoding helpers*******************************
+ *
+ * Fields of an instruction word and the instruction words themselves.
+ *
+ *****************************************************************************/
+static inline unsigned op_of(uint32_t w)  { return w >> 28; }
+static inline unsigned ra_of(uint32_t w)
+{
+        return op_of(w) == LV ? (w >> 25) & 7 : (w >> 6) & 7;
+}
+static inline unsigned rb_of(uint32_t w)  { return (w >> 3) & 7; }
+static inline unsigned rc_of(uint32_t w)  { return w & 7; }
+static inline uint32_t lv_of(uint32_t w)  { return w & LV_MAX; }
+
+static inline uint32_t make3(unsigned op, unsigned a, unsigned b, unsigned c)
+{
+        return ((uint32_t) op << 28) | (a << 6) | (b << 3) | c;
+}
+
+static inline uint32_t make_lv(unsigned a, uint32_t value)
+{
+        return ((uint32_t) LV << 28) | (a << 25) | value;
+}
+
+/*********************************Value helpers********************************
+ *
+ * Constructors and queries for abstract values.
+ *
+ *****************************************************************************/
+static inline struct Value val_const(uint32_t c)
+{
+        struct Value v;
+        v.kind = SET;
+        v.n = 1;
+        v.vals[0] = c;
+        return v;
+}
+
+static inline struct Value val_kind(enum kind k)
+{
+        struct Value v;
+        v.kind = k;
+        v.n = 0;
+        return v;
+}
+
+static inline bool val_is(struct Value v, uint32_t c)
+{
+        return v.kind == SET && v.n == 1 && v.vals[0] == c;
+}
+
+static inline bool val_nonzero(struct Value v)
+{
+        if (v.kind == NONZERO) {
+                return true;
+        }
+        if (v.kind != SET) {
+                return false;
+        }
+        for (unsigned i = 0; i < v.n; i++) {
+                if (v.vals[i] == 0) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+static inline bool val_equal(struct Value a, struct Value b)
+{
+        if (a.kind != b.kind || a.n != b.n) {
+                return false;
+        }
+        return memcmp(a.vals, b.vals, a.n * sizeof(uint32_t)) == 0;
+}
+
+/********************************set_add***************************************
+ *
+ * Adds a constant to a SET value, which is kept sorted
+ * Inputs:
+ *         struct Value *v: A SET value
+ *         uint32_t c:      The constant to add
+ * Return: false if the set would grow past MAXSET
+ * Expects:
+ *         v->kind == SET
+ * Notes:
+ *         none
+ *****************************************************************************/
+static bool set_add(struct Value *v, uint32_t c)
+{
+        unsigned i = 0;
+        while (i < v->n && v->vals[i] < c) {
+                i++;
+        }
+        if (i < v->n && v->vals[i] == c) {
+                return true;
+        }
+        if (v->n == MAXSET) {
+                return false;
+        }
+        memmove(&v->vals[i + 1], &v->vals[i], (v->n - i) * sizeof(uint32_t));
+        v->vals[i] = c;
+        v->n++;
+        return true;
+}
+
+/**********************************val_join************************************
+ *
+ * Returns the least value that covers both arguments
+ * Inputs:
+ *         struct Value a, b: The values to join
+ * Return: The join
+ * Expects:
+ *         none
+ * Notes:
+ *         A set that would overflow becomes COMPUTED rather than LOADED,
+ *         so that its constants cannot silently escape the address-taken
+ *         set by reaching an indirect jump
+ *****************************************************************************/
+static struct Value val_join(struct Value a, struct Value b)
+{
+        if (a.kind == BOT) {
+                return b;
+        }
+        if (b.kind == BOT) {
+                return a;
+        }
+        if (a.kind == SET && b.kind == SET) {
+                for (unsigned i = 0; i < b.n; i++) {
+                        if (!set_add(&a, b.vals[i])) {
+                                return val_kind(COMPUTED);
+                        }
+                }
+                return a;
+        }
+        if (a.kind == COMPUTED || b.kind == COMPUTED) {
+                return val_kind(COMPUTED);
+        }
+        if ((a.kind == NONZERO || b.kind == NONZERO) &&
+            val_nonzero(a) && val_nonzero(b)) {
+                return val_kind(NONZERO);
+        }
+        if (a.kind == SET || b.kind == SET) {
+                /* Mixing constants with unknowns loses the constants */
+                return val_kind(COMPUTED);
+        }
+        return val_kind(LOADED);
+}
+
+/*********************************arith****************************************
+ *
+ * Applies an arithmetic opcode to two constants
+ * Inputs:
+ *         unsigned op:    ADD, MUL, DIV or NAND
+ *         uint32_t b, c:  The operands
+ *         uint32_t *out:  Where the result is stored
+ * Return: false if the result is undefined (division by zero)
+ * Expects:
+ *         none
+ * Notes:
+ *         none
+ *****************************************************************************/
+static bool arith(unsigned op, uint32_t b, uint32_t c, uint32_t *out)
+{
+        switch (op) {
+        case ADD:  *out = b + c;       return true;
+        case MUL:  *out = b * c;       return true;
+        case NAND: *out = ~(b & c);    return true;
+        case DIV:
+                if (c == 0) {
+                        return false;
+                }
+                *out = b / c;
+                return true;
+        }
+        return false;
+}
+
+/**********************************result_of***********************************
+ *
+ * Computes the abstract value an instruction writes to its destination
+ * Inputs:
+ *         uint32_t w:        The instruction
+ *         struct State *s:   The state before it
+ * Return: The value written
+ * Expects:
+ *         w to be one of CMOV, SLOAD, ADD, MUL, DIV, NAND, MAP, IN, LV
+ * Notes:
+ *         none
+ *****************************************************************************/
+static struct Value result_of(uint32_t w, struct State *s)
+{
+        unsigned op = op_of(w);
+        struct Value b = s->r[rb_of(w)];
+        struct Value c = s->r[rc_of(w)];
+
+        switch (op) {
+        case CMOV:
+                if (val_nonzero(c)) {
+                        return b;
+                }
+                if (val_is(c, 0)) {
+                        return s->r[ra_of(w)];
+                }
+                return val_join(s->r[ra_of(w)], b);
+        case SLOAD:
+                return val_kind(LOADED);
+        case MAP:
+                return val_kind(NONZERO);
+        case IN:
+                return val_kind(COMPUTED);
+        case LV:
+                return val_const(lv_of(w));
+        }
+
+        /* ADD, MUL, DIV, NAND */
+        if (b.kind == BOT || c.kind == BOT) {
+                return val_kind(BOT);
+        }
+        if (b.kind != SET || c.kind != SET) {
+                return val_kind(COMPUTED);
+        }
+        struct Value v;
+        v.kind = SET;
+        v.n = 0;
+        for (unsigned i = 0; i < b.n; i++) {
+                for (unsigned j = 0; j < c.n; j++) {
+                        uint32_t out;
+                        if (arith(op, b.vals[i], c.vals[j], &out) &&
+                            !set_add(&v, out)) {
+                                return val_kind(COMPUTED);
+                        }
+                }
+        }
+        if (v.n == 0) {
+                return val_kind(BOT);
+        }
+        return v;
+}
+
+/*********************************dest_of**************************************
+ *
+ * Returns the register an instruction writes, or -1 if it writes none
+ *
+ *****************************************************************************/
+static int dest_of(uint32_t w)
+{
+        switch (op_of(w)) {
+        case CMOV: case SLOAD: case ADD: case MUL: case DIV: case NAND:
+        case LV:
+                return ra_of(w);
+        case MAP:
+                return rb_of(w);
+        case IN:
+                return rc_of(w);
+        }
+        return -1;
+}
+
+/*********************************uses_of**************************************
+ *
+ * Returns the set of registers an instruction reads, as a bitmask
+ *
+ *****************************************************************************/
+static uint8_t uses_of(uint32_t w)
+{
+        uint8_t a = 1 << ra_of(w), b = 1 << rb_of(w), c = 1 << rc_of(w);
+
+        switch (op_of(w)) {
+        case CMOV:   return a | b | c;
+        case SLOAD:  return b | c;
+        case SSTORE: return a | b | c;
+        case ADD: case MUL: case DIV: case NAND:
+                     return b | c;
+        case MAP: case UNMAP: case OUT:
+                     return c;
+        case LOADP:  return b | c;
+        }
+        return 0;
+}
+
+/*********************************is_pure**************************************
+ *
+ * Whether deleting an instruction whose result is unused preserves behavior
+ *
+ *****************************************************************************/
+static bool is_pure(uint32_t w)
+{
+        switch (op_of(w)) {
+        case CMOV: case SLOAD: case ADD: case MUL: case DIV: case NAND:
+        case LV:
+                return true;
+        }
+        return false;
+}
+
+/**********************************fail****************************************
+ *
+ * Records the first reason the safety proof does not hold
+ *
+ *****************************************************************************/
+static void fail(struct Program *p, uint32_t pc, const char *why)
+{
+        if (p->error == NULL) {
+                p->error = why;
+                p->error_pc = pc;
+        }
+}
+
+/******************************note_taken**************************************
+ *
+ * Adds a constant to the address-taken set if it is a code address
+ *
+ *****************************************************************************/
+static void note_taken(struct Program *p, uint32_t c)
+{
+        if (c < p->n && !p->taken[c]) {
+                p->taken[c] = true;
+                p->grew = true;
+        }
+}
+
+/*********************************check_access*********************************
+ *
+ * Checks that a load or store cannot touch an instruction
+ * Inputs:
+ *         struct Program *p: The program
+ *         uint32_t pc:       The address of the access
+ *         struct Value seg:  The segment register
+ *         struct Value off:  The offset register
+ * Return: none, records a failure if the access may touch code
+ * Expects:
+ *         none
+ * Notes:
+ *         Constant segment-0 offsets are recorded as data and, once all of
+ *         the code is known, checked against it; unknown ones need
+ *         -trust-data
+ *****************************************************************************/
+static void check_access(struct Program *p, uint32_t pc, struct Value seg,
+                         struct Value off)
+{
+        if (val_nonzero(seg)) {
+                return;
+        }
+        if (off.kind != SET) {
+                if (!p->trust_data) {
+                        fail(p, pc, "segment 0 access at unknown offset "
+                             "(use -trust-data if it only touches data)");
+                }
+                return;
+        }
+        for (unsigned i = 0; i < off.n; i++) {
+                uint32_t a = off.vals[i];
+                if (a >= p->n) {
+                        continue;
+                }
+                if (p->checking && p->reached[a]) {
+                        fail(p, pc, "load or store touches an instruction");
+                }
+                if (!p->data[a]) {
+                        p->data[a] = true;
+                        p->grew = true;
+                }
+        }
+}
+
+/*********************************merge_into***********************************
+ *
+ * Joins a state into the entry state of a leader
+ * Inputs:
+ *         struct Program *p: The program
+ *         uint32_t target:   The leader
+ *         struct State *s:   The incoming state
+ * Return: true if the leader's entry state changed
+ * Expects:
+ *         target < p->n
+ * Notes:
+ *         Creates the leader if it did not exist
+ *****************************************************************************/
+static bool merge_into(struct Program *p, uint32_t target, struct State *s)
+{
+        struct State *in = p->in[target];
+        if (in == NULL) {
+                in = malloc(sizeof(*in));
+                assert(in);
+                *in = *s;
+                p->in[target] = in;
+                return true;
+        }
+
+        bool changed = false;
+        for (int r = 0; r < 8; r++) {
+                struct Value j = val_join(in->r[r], s->r[r]);
+                if (!val_equal(j, in->r[r])) {
+                        in->r[r] = j;
+                        changed = true;
+                }
+        }
+        return changed;
+}
+
+/*********************************step*****************************************
+ *
+ * Applies one instruction to a state
+ * Inputs:
+ *         struct Program *p: The program
+ *         uint32_t pc:       The address of the instruction
+ *         struct State *s:   The state, updated in place
+ * Return: none
+ * Expects:
+ *         The instruction is not a LOADP or HALT
+ * Notes:
+ *         Records proof failures and address-taken constants as it goes
+ *****************************************************************************/
+static void step(struct Program *p, uint32_t pc, struct State *s)
+{
+        uint32_t w = p->words[pc];
+        unsigned op = op_of(w);
+
+        if (op == SLOAD) {
+                check_access(p, pc, s->r[rb_of(w)], s->r[rc_of(w)]);
+        }
+        else if (op == SSTORE) {
+                check_access(p, pc, s->r[ra_of(w)], s->r[rb_of(w)]);
+                struct Value v = s->r[rc_of(w)];
+                if (v.kind == SET) {
+                        for (unsigned i = 0; i < v.n; i++) {
+                                note_taken(p, v.vals[i]);
+                        }
+                }
+        }
+        else if (op > LV) {
+                fail(p, pc, "invalid opcode is reachable");
+        }
+
+        int d = dest_of(w);
+        if (d >= 0) {
+                s->r[d] = result_of(w, s);
+        }
+}
+
+/*******************************jump_targets***********************************
+ *
+ * Calls visit for every address a LOADP can transfer to
+ * Inputs:
+ *         struct Program *p: The program
+ *         uint32_t pc:       The address of the LOADP
+ *         struct State *s:   The state before it
+ *         visit, cl:         Called with each target
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         Records a failure if the LOADP might load another segment or jump
+ *         through a computed value
+ *****************************************************************************/
+static void jump_targets(struct Program *p, uint32_t pc, struct State *s,
+                         void visit(uint32_t target, void *cl), void *cl)
+{
+        uint32_t w = p->words[pc];
+        struct Value b = s->r[rb_of(w)];
+        struct Value c = s->r[rc_of(w)];
+
+        if (!val_is(b, 0)) {
+                fail(p, pc, "LOADP may load a segment other than 0");
+                return;
+        }
+        if (c.kind == SET) {
+                for (unsigned i = 0; i < c.n; i++) {
+                        if (c.vals[i] < p->n) {
+                                visit(c.vals[i], cl);
+                        }
+                }
+        }
+        else if (c.kind == LOADED || c.kind == NONZERO) {
+                for (uint32_t a = 0; a < p->n; a++) {
+                        if (p->taken[a] &&
+                            !(p->trust_data && p->data[a])) {
+                                visit(a, cl);
+                        }
+                }
+        }
+        else if (c.kind == COMPUTED) {
+                fail(p, pc, "jump through a computed address");
+        }
+}
+
+struct Walk {
+        struct Program *p;
+        struct State *s;
+        uint32_t *worklist;
+        uint32_t *count;
+        bool *queued;
+};
+
+static void walk_visit(uint32_t target, void *cl)
+{
+        struct Walk *wk = cl;
+        if (merge_into(wk->p, target, wk->s) && !wk->queued[target]) {
+                wk->queued[target] = true;
+                wk->worklist[(*wk->count)++] = target;
+        }
+}
+
+/**********************************analyze*************************************
+ *
+ * Finds reachable code and the entry state of every leader, and checks the
+ * conditions under which the program may be rewritten
+ * Inputs:
+ *         struct Program *p: The program
+ * Return: true if the proof holds
+ * Expects:
+ *         none
+ * Notes:
+ *         Deleted instructions are skipped. Runs to a fixed point over the
+ *         address-taken set as well as the entry states.
+ *****************************************************************************/
+static bool analyze(struct Program *p)
+{
+        uint32_t n = p->n;
+        uint32_t *worklist = malloc(n * sizeof(uint32_t));
+        bool *queued = calloc(n, sizeof(bool));
+        assert(worklist && queued);
+
+        memset(p->taken, 0, n * sizeof(bool));
+        memset(p->data, 0, n * sizeof(bool));
+        p->checking = false;
+
+        do {
+                p->grew = false;
+                p->error = NULL;
+                for (uint32_t i = 0; i < n; i++) {
+                        free(p->in[i]);
+                        p->in[i] = NULL;
+                }
+                memset(p->reached, 0, n * sizeof(bool));
+                memset(queued, 0, n * sizeof(bool));
+
+                struct State s;
+                for (int r = 0; r < 8; r++) {
+                        s.r[r] = val_const(0);
+                }
+                uint32_t count = 0;
+                struct Walk wk = { p, &s, worklist, &count, queued };
+                walk_visit(0, &wk);
+
+                while (count > 0) {
+                        uint32_t pc = worklist[--count];
+                        queued[pc] = false;
+                        s = *p->in[pc];
+
+                        for (;;) {
+                                if (pc >= n) {
+                                        fail(p, n, "execution runs off the "
+                                             "end of segment 0");
+                                        break;
+                                }
+                                p->reached[pc] = true;
+                                if (p->deleted[pc]) {
+                                        pc++;
+                                        continue;
+                                }
+                                unsigned op = op_of(p->words[pc]);
+                                if (op == HALT) {
+                                        break;
+                                }
+                                if (op == LOADP) {
+                                        jump_targets(p, pc, &s, walk_visit,
+                                                     &wk);
+                                        break;
+                                }
+                                step(p, pc, &s);
+                                pc++;
+                                if (pc < n && p->in[pc] != NULL) {
+                                        walk_visit(pc, &wk);
+                                        break;
+                                }
+                        }
+                }
+
+                /* Any word of the image that is not code may be a code
+                   pointer read from memory */
+                for (uint32_t i = 0; i < n; i++) {
+                        if (!p->reached[i]) {
+                                note_taken(p, p->words[i]);
+                        }
+                }
+        } while (p->grew && p->error == NULL);
+
+        /* Accesses are rechecked now that all of the code is known */
+        p->checking = true;
+        if (p->error == NULL) {
+                for (uint32_t l = 0; l < n; l++) {
+                        if (p->in[l] == NULL) {
+                                continue;
+                        }
+                        struct State s = *p->in[l];
+                        for (uint32_t pc = l; pc < n; pc++) {
+                                if (p->deleted[pc]) {
+                                        continue;
+                                }
+                                unsigned op = op_of(p->words[pc]);
+                                if (op == HALT || op == LOADP) {
+                                        break;
+                                }
+                                step(p, pc, &s);
+                                if (pc + 1 < n && p->in[pc + 1] != NULL) {
+                                        break;
+                                }
+                        }
+                }
+        }
+
+        free(worklist);
+        free(queued);
+        return p->error == NULL;
+}
+
+/********************************block_end*************************************
+ *
+ * Returns one past the last address of the block starting at a leader
+ * Inputs:
+ *         struct Program *p: The program
+ *         uint32_t leader:   The first address of the block
+ * Return: The address of the next leader, or one past the terminator
+ * Expects:
+ *         leader to be a leader
+ * Notes:
+ *         none
+ *****************************************************************************/
+static uint32_t block_end(struct Program *p, uint32_t leader)
+{
+        uint32_t pc = leader;
+        while (pc < p->n) {
+                if (!p->deleted[pc]) {
+                        unsigned op = op_of(p->words[pc]);
+                        if (op == HALT || op == LOADP) {
+                                return pc + 1;
+                        }
+                }
+                pc++;
+                if (pc < p->n && p->in[pc] != NULL) {
+                        return pc;
+                }
+        }
+        return pc;
+}
+
+/******************************state_before************************************
+ *
+ * Simulates a block from its leader up to, but not including, an address
+ *
+ *****************************************************************************/
+static struct State state_before(struct Program *p, uint32_t leader,
+                                 uint32_t at)
+{
+        struct State s = *p->in[leader];
+        for (uint32_t pc = leader; pc < at; pc++) {
+                if (!p->deleted[pc]) {
+                        step(p, pc, &s);
+                }
+        }
+        return s;
+}
+
+struct Live {
+        struct Program *p;
+        uint8_t live;
+};
+
+static void live_visit(uint32_t target, void *cl)
+{
+        struct Live *l = cl;
+        l->live |= l->p->live_in[target];
+}
+
+/*********************************live_out*************************************
+ *
+ * Returns the registers live after the last instruction of a block
+ * Inputs:
+ *         struct Program *p: The program
+ *         uint32_t leader:   The first address of the block
+ *         uint32_t end:      block_end(p, leader)
+ * Return: A bitmask of live registers
+ * Expects:
+ *         live_in to hold the current estimate for every leader
+ * Notes:
+ *         none
+ *****************************************************************************/
+static uint8_t live_out(struct Program *p, uint32_t leader, uint32_t end)
+{
+        uint32_t last = end - 1;
+        while (last > leader && p->deleted[last]) {
+                last--;
+        }
+        unsigned op = p->deleted[last] ? CMOV : op_of(p->words[last]);
+
+        if (op == HALT) {
+                return 0;
+        }
+        if (op == LOADP) {
+                struct State s = state_before(p, leader, last);
+                struct Live l = { p, 0 };
+                jump_targets(p, last, &s, live_visit, &l);
+                return l.live;
+        }
+        return end < p->n && p->in[end] != NULL ? p->live_in[end] : 0;
+}
+
+/*****************************compute_liveness*********************************
+ *
+ * Computes the registers live on entry to every leader
+ * Inputs:
+ *         struct Program *p: An analyzed program
+ * Return: none
+ * Expects:
+ *         analyze(p) to have succeeded
+ * Notes:
+ *         Iterates backward dataflow to a fixed point
+ *****************************************************************************/
+static void compute_liveness(struct Program *p)
+{
+        memset(p->live_in, 0, p->n);
+        bool changed = true;
+
+        while (changed) {
+                changed = false;
+                for (uint32_t l = p->n; l-- > 0; ) {
+                        if (p->in[l] == NULL) {
+                                continue;
+                        }
+                        uint32_t end = block_end(p, l);
+                        uint8_t live = live_out(p, l, end);
+                        for (uint32_t pc = end; pc-- > l; ) {
+                                if (p->deleted[pc]) {
+                                        continue;
+                                }
+                                uint32_t w = p->words[pc];
+                                int d = dest_of(w);
+                                if (d >= 0) {
+                                        live &= ~(1 << d);
+                                }
+                                live |= uses_of(w);
+                        }
+                        if (live != p->live_in[l]) {
+                                p->live_in[l] = live;
+                                changed = true;
+                        }
+                }
+        }
+}
+
+/*****************************live_after_each**********************************
+ *
+ * Fills live[pc - leader] with the registers live after each instruction
+ *
+ *****************************************************************************/
+static void live_after_each(struct Program *p, uint32_t leader, uint32_t end,
+                            uint8_t *live)
+{
+        uint8_t l = live_out(p, leader, end);
+        for (uint32_t pc = end; pc-- > leader; ) {
+                live[pc - leader] = l;
+                if (p->deleted[pc]) {
+                        continue;
+                }
+                uint32_t w = p->words[pc];
+                int d = dest_of(w);
+                if (d >= 0) {
+                        l &= ~(1 << d);
+                }
+                l |= uses_of(w);
+        }
+}
+
+/********************************trampoline************************************
+ *
+ * If the block at an address only jumps on, returns the next address and
+ * the register it writes; otherwise returns false
+ *
+ *****************************************************************************/
+static bool trampoline(struct Program *p, uint32_t at, uint32_t *next,
+                       unsigned *reg)
+{
+        if (at >= p->n || p->in[at] == NULL) {
+                return false;
+        }
+        uint32_t pc = at;
+        while (pc < p->n && p->deleted[pc]) {
+                pc++;
+        }
+        uint32_t pc2 = pc + 1;
+        while (pc2 < p->n && p->deleted[pc2]) {
+                pc2++;
+        }
+        if (pc2 >= p->n) {
+                return false;
+        }
+        for (uint32_t i = at + 1; i <= pc2; i++) {
+                if (p->in[i] != NULL) {
+                        return false;
+                }
+        }
+
+        uint32_t lv = p->words[pc], jump = p->words[pc2];
+        if (op_of(lv) != LV || op_of(jump) != LOADP ||
+            rc_of(jump) != ra_of(lv) ||
+            !val_is(p->in[at]->r[rb_of(jump)], 0)) {
+                return false;
+        }
+        *next = lv_of(lv);
+        *reg = ra_of(lv);
+        return *next < p->n;
+}
+
+/*******************************thread_target**********************************
+ *
+ * Follows trampolines from an address as far as it is safe to skip them
+ * Inputs:
+ *         struct Program *p: The program
+ *         uint32_t target:   The original jump target
+ *         unsigned reg:      The register that holds target at the jump
+ *         uint8_t also_dead: Other registers that must be dead at the end
+ * Return: The final target, or target itself if nothing can be skipped
+ * Expects:
+ *         compute_liveness(p) to be current
+ * Notes:
+ *         Skipping a trampoline leaves reg holding the new target and the
+ *         trampoline's own register unwritten; both must agree with the
+ *         original program or be dead where the jump lands
+ *****************************************************************************/
+static uint32_t thread_target(struct Program *p, uint32_t target,
+                              unsigned reg, uint8_t also_dead)
+{
+        uint32_t best = target, at = target;
+        uint8_t written = 0;
+
+        for (int hops = 0; hops < 64; hops++) {
+                uint32_t next;
+                unsigned treg;
+                if (!trampoline(p, at, &next, &treg) || next == at) {
+                        break;
+                }
+                written |= 1 << treg;
+                uint8_t must_be_dead = (written | also_dead | 1 << reg);
+                if (treg == reg) {
+                        /* reg holds next in both programs */
+                        must_be_dead &= ~(1 << reg);
+                        if (written & ~(1 << reg) & ~also_dead) {
+                                must_be_dead |= written & ~(1 << reg);
+                        }
+                }
+                if ((p->live_in[next] & must_be_dead) == 0) {
+                        best = next;
+                }
+                at = next;
+        }
+        return best;
+}
+
+/*******************************thread_jumps***********************************
+ *
+ * Retargets jumps whose destination is a trampoline
+ * Inputs:
+ *         struct Program *p:    An analyzed program with current liveness
+ *         struct Stats *stats:  Counters to update
+ * Return: true if anything changed
+ * Expects:
+ *         none
+ * Notes:
+ *         Handles the two shapes umasm emits: "LV rX := T; LOADP rZ rX" and
+ *         the conditional "LV r6 := A; LV r7 := B; CMOV r6 r7 rc;
+ *         LOADP rZ r6". The LVs must feed nothing but the jump.
+ *****************************************************************************/
+static bool thread_jumps(struct Program *p, struct Stats *stats)
+{
+        bool changed = false;
+
+        for (uint32_t l = 0; l < p->n; l++) {
+                if (p->in[l] == NULL) {
+                        continue;
+                }
+                uint32_t end = block_end(p, l);
+
+                /* Gather the live instructions of the block, last first */
+                uint32_t tail[4];
+                int k = 0;
+                for (uint32_t pc = end; pc-- > l && k < 4; ) {
+                        if (!p->deleted[pc]) {
+                                tail[k++] = pc;
+                        }
+                }
+                if (k < 2 || op_of(p->words[tail[0]]) != LOADP) {
+                        continue;
+                }
+                uint32_t jump = p->words[tail[0]];
+                unsigned rc = rc_of(jump);
+
+                uint32_t *lv = &p->words[tail[1]];
+                if (op_of(*lv) == LV && ra_of(*lv) == rc) {
+                        uint32_t t = lv_of(*lv);
+                        uint32_t u = thread_target(p, t, rc, 0);
+                        if (u != t) {
+                                *lv = make_lv(rc, u);
+                                stats->threaded++;
+                                changed = true;
+                        }
+                        continue;
+                }
+
+                if (k < 4) {
+                        continue;
+                }
+                uint32_t cmov = p->words[tail[1]];
+                uint32_t *lv_b = &p->words[tail[2]];
+                uint32_t *lv_a = &p->words[tail[3]];
+                unsigned rb = rb_of(cmov);
+                if (op_of(cmov) != CMOV || ra_of(cmov) != rc ||
+                    rb == rc || rc_of(cmov) == rc || rc_of(cmov) == rb ||
+                    op_of(*lv_b) != LV || ra_of(*lv_b) != rb ||
+                    op_of(*lv_a) != LV || ra_of(*lv_a) != rc) {
+                        continue;
+                }
+
+                /* rb keeps holding B whichever way the branch goes */
+                uint32_t a = lv_of(*lv_a), b = lv_of(*lv_b);
+                uint32_t a2 = thread_target(p, a, rc, 1 << rb);
+                uint32_t b2 = thread_target(p, b, rc, 1 << rb);
+                if (a2 != a) {
+                        *lv_a = make_lv(rc, a2);
+                        stats->threaded++;
+                        changed = true;
+                }
+                if (b2 != b && (a2 >= p->n ||
+                                (p->live_in[a2] & (1 << rb)) == 0)) {
+                        *lv_b = make_lv(rb, b2);
+                        stats->threaded++;
+                        changed = true;
+                }
+        }
+        return changed;
+}
+
+/****************************propagate_constants*******************************
+ *
+ * Deletes instructions that do not change their destination, rewrites
+ * constant results as LV and forwards stored values to later loads
+ * Inputs:
+ *         struct Program *p:    An analyzed program
+ *         struct Stats *stats:  Counters to update
+ * Return: true if anything changed
+ * Expects:
+ *         none
+ * Notes:
+ *         Each rewrite leaves every register and memory word unchanged, so
+ *         all of them can be applied in the same round
+ *****************************************************************************/
+static bool propagate_constants(struct Program *p, struct Stats *stats)
+{
+        bool changed = false;
+
+        for (uint32_t l = 0; l < p->n; l++) {
+                if (p->in[l] == NULL) {
+                        continue;
+                }
+                uint32_t end = block_end(p, l);
+                struct State s = *p->in[l];
+
+                /* Last store in the block: m[sa][sb] := sc, or none */
+                bool have_store = false;
+                unsigned sa = 0, sb = 0, sc = 0;
+
+                for (uint32_t pc = l; pc < end; pc++) {
+                        if (p->deleted[pc]) {
+                                continue;
+                        }
+                        uint32_t w = p->words[pc];
+                        unsigned op = op_of(w);
+                        int d = dest_of(w);
+
+                        if (d >= 0 && op != MAP && op != IN) {
+                                struct Value v = result_of(w, &s);
+                                if (v.kind == SET && v.n == 1 &&
+                                    val_equal(v, s.r[d])) {
+                                        p->deleted[pc] = true;
+                                        stats->redundant++;
+                                        changed = true;
+                                        continue;
+                                }
+                                if (v.kind == SET && v.n == 1 &&
+                                    op != LV && v.vals[0] <= LV_MAX) {
+                                        p->words[pc] = make_lv(d, v.vals[0]);
+                                        stats->folded++;
+                                        changed = true;
+                                }
+                        }
+
+                        if (op == SLOAD && have_store &&
+                            rb_of(w) == sa && rc_of(w) == sb) {
+                                if (ra_of(w) == sc) {
+                                        p->deleted[pc] = true;
+                                        stats->forwarded++;
+                                        changed = true;
+                                        continue;
+                                }
+                                for (unsigned z = 0; z < 8; z++) {
+                                        if (val_is(s.r[z], 0)) {
+                                                p->words[pc] = make3(ADD,
+                                                        ra_of(w), sc, z);
+                                                w = p->words[pc];
+                                                stats->forwarded++;
+                                                changed = true;
+                                                break;
+                                        }
+                                }
+                        }
+
+                        if (op == SSTORE) {
+                                have_store = true;
+                                sa = ra_of(w);
+                                sb = rb_of(w);
+                                sc = rc_of(w);
+                        }
+                        else if (op == MAP || op == UNMAP) {
+                                have_store = false;
+                        }
+                        d = dest_of(p->words[pc]);
+                        if (have_store && d >= 0 &&
+                            (d == (int) sa || d == (int) sb ||
+                             d == (int) sc)) {
+                                have_store = false;
+                        }
+                        step(p, pc, &s);
+                }
+        }
+        return changed;
+}
+
+/******************************eliminate_dead**********************************
+ *
+ * Deletes pure instructions whose destination is never read
+ * Inputs:
+ *         struct Program *p:    An analyzed program with current liveness
+ *         struct Stats *stats:  Counters to update
+ * Return: true if anything changed
+ * Expects:
+ *         none
+ * Notes:
+ *         Loads and divisions are deleted too: if they would have failed the
+ *         program's behavior was undefined anyway
+ *****************************************************************************/
+static bool eliminate_dead(struct Program *p, struct Stats *stats)
+{
+        bool changed = false;
+        uint8_t *live = malloc(p->n);
+        assert(live);
+
+        for (uint32_t l = 0; l < p->n; l++) {
+                if (p->in[l] == NULL) {
+                        continue;
+                }
+                uint32_t end = block_end(p, l);
+                live_after_each(p, l, end, live);
+                for (uint32_t pc = l; pc < end; pc++) {
+                        uint32_t w = p->words[pc];
+                        if (p->deleted[pc] || !is_pure(w)) {
+                                continue;
+                        }
+                        if ((live[pc - l] & (1 << dest_of(w))) == 0) {
+                                p->deleted[pc] = true;
+                                stats->dead++;
+                                changed = true;
+                        }
+                }
+        }
+        free(live);
+        return changed;
+}
+
+/**********************************compact*************************************
+ *
+ * Moves the surviving instructions of every block up to its leader
+ * Inputs:
+ *         struct Program *p:    An analyzed program with current liveness
+ *         struct Stats *stats:  Counters to update
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         Freed slots after a terminator are never executed and are zeroed.
+ *         A block that falls through fills its freed slots with no-ops
+ *         (word 0 is CMOV r0 r0 r0), or, when at least three slots are free
+ *         and a known-zero register and a dead register are available,
+ *         jumps straight to the next leader.
+ *****************************************************************************/
+static void compact(struct Program *p, struct Stats *stats)
+{
+        for (uint32_t l = 0; l < p->n; l++) {
+                if (p->in[l] == NULL) {
+                        continue;
+                }
+                uint32_t end = block_end(p, l);
+                struct State s = state_before(p, l, end);
+                uint32_t out = l;
+                uint32_t last = 0;
+
+                for (uint32_t pc = l; pc < end; pc++) {
+                        if (!p->deleted[pc]) {
+                                last = p->words[pc];
+                                p->words[out++] = last;
+                        }
+                }
+                uint32_t free_slots = end - out;
+                bool falls = out == l || (op_of(last) != LOADP &&
+                                          op_of(last) != HALT);
+
+                if (falls && free_slots >= 3 && end < p->n &&
+                    p->in[end] != NULL && end <= LV_MAX) {
+                        int zero = -1, temp = -1;
+                        for (int r = 0; r < 8; r++) {
+                                if (zero < 0 && val_is(s.r[r], 0)) {
+                                        zero = r;
+                                }
+                        }
+                        for (int r = 7; r >= 0; r--) {
+                                if (temp < 0 && r != zero &&
+                                    (p->live_in[end] & (1 << r)) == 0) {
+                                        temp = r;
+                                }
+                        }
+                        if (zero >= 0 && temp >= 0) {
+                                p->words[out++] = make_lv(temp, end);
+                                p->words[out++] = make3(LOADP, 0, zero,
+                                                        temp);
+                                stats->jumps_added++;
+                        }
+                }
+                for (uint32_t pc = out; pc < end; pc++) {
+                        p->words[pc] = 0;
+                }
+                memset(&p->deleted[l], 0, (end - l) * sizeof(bool));
+        }
+}
+
+/*********************************read_image***********************************
+ *
+ * Reads the big-endian words of a .um file
+ *
+ *****************************************************************************/
+static uint32_t *read_image(const char *path, uint32_t *n)
+{
+        FILE *fp = fopen(path, "rb");
+        if (fp == NULL) {
+                fprintf(stderr, "umopt: cannot open %s\n", path);
+                exit(1);
+        }
+        fseek(fp, 0L, SEEK_END);
+        long bytes = ftell(fp);
+        fseek(fp, 0L, SEEK_SET);
+
+        *n = bytes / 4;
+        uint32_t *words = malloc((*n + 1) * sizeof(uint32_t));
+        assert(words);
+        for (uint32_t i = 0; i < *n; i++) {
+                uint32_t w = 0;
+                for (int b = 0; b < 4; b++) {
+                        w = (w << 8) | (uint32_t) getc(fp);
+                }
+                words[i] = w;
+        }
+        fclose(fp);
+        return words;
+}
+
+/********************************write_image***********************************
+ *
+ * Writes words to a .um file in big-endian order
+ *
+ *****************************************************************************/
+static void write_image(const char *path, uint32_t *words, uint32_t n)
+{
+        FILE *fp = fopen(path, "wb");
+        if (fp == NULL) {
+                fprintf(stderr, "umopt: cannot open %s\n", path);
+                exit(1);
+        }
+        for (uint32_t i = 0; i < n; i++) {
+                putc(words[i] >> 24, fp);
+                putc(words[i] >> 16, fp);
+                putc(words[i] >> 8, fp);
+                putc(words[i], fp);
+        }
+        fclose(fp);
+}
+
+static void usage(void)
+{
+        fprintf(stderr, "Usage: umopt [-trust-data] in.um out.um\n");
+        exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+        struct Program p;
+        memset(&p, 0, sizeof(p));
+        int i = 1;
+
+        if (i < argc && strcmp(argv[i], "-trust-data") == 0) {
+                p.trust_data = true;
+                i++;
+        }
+        if (argc - i != 2) {
+                usage();
+        }
+
+        p.words = read_image(argv[i], &p.n);
+        if (p.n == 0) {
+                fprintf(stderr, "umopt: %s is empty\n", argv[i]);
+                return 1;
+        }
+        p.deleted = calloc(p.n, sizeof(bool));
+        p.in = calloc(p.n, sizeof(struct State *));
+        p.reached = calloc(p.n, sizeof(bool));
+        p.taken = calloc(p.n, sizeof(bool));
+        p.data = calloc(p.n, sizeof(bool));
+        p.live_in = calloc(p.n, 1);
+        assert(p.deleted && p.in && p.reached && p.taken && p.data &&
+               p.live_in);
+
+        if (!analyze(&p)) {
+                fprintf(stderr, "umopt: cannot prove %s safe to rewrite: "
+                        "%s (pc %" PRIu32 ")\n", argv[i], p.error,
+                        p.error_pc);
+                return 1;
+        }
+
+        struct Stats stats;
+        memset(&stats, 0, sizeof(stats));
+        bool changed = true;
+        while (changed) {
+                compute_liveness(&p);
+                changed = thread_jumps(&p, &stats);
+                analyze(&p);
+                changed |= propagate_constants(&p, &stats);
+                analyze(&p);
+                compute_liveness(&p);
+                changed |= eliminate_dead(&p, &stats);
+                analyze(&p);
+        }
+        compute_liveness(&p);
+        compact(&p, &stats);
+
+        write_image(argv[i + 1], p.words, p.n);
+        fprintf(stderr, "umopt: %u redundant, %u folded, %u forwarded, "
+                "%u dead, %u jumps threaded, %u fall-through jumps added\n",
+                stats.redundant, stats.folded, stats.forwarded, stats.dead,
+                stats.threaded, stats.jumps_added);
+        return 0;
+}
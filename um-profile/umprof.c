@@ -0,0 +1,377 @@
+/******************************************************************************
+ *
+ *                                  umprof.c
+ *
+ *     Assignment: profile
+ *     Authors:    Marten Tropp and Matthew Carey
+ *     Date:       11/20/2023
+ *
+ *     The purpose of this file is to report where an assembly program
+ *     spends its time, by the names in its source. It reads the symbol map
+ *     written by asmcoding/umsyms and the um.prof written by um-profile when
+ *     the program halts, and prints two tables:
+ *
+ *         - by label: the instructions executed and cycles spent in the
+ *           code from each label up to the next;
+ *         - by procedure: for every address the program called, the calls,
+ *           the instructions and cycles from it up to the next called
+ *           address (self), and those between its calls and their returns,
+ *           including everything it called (inclusive).
+ *
+ *     Code before the first called address, such as the init section, is
+ *     reported as "(top level)", whose inclusive counts are the whole run.
+ *     Both tables are sorted by cycles, most first.
+ *
+ *     Usage: umprof program.sym [um.prof]
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+/* Longest label or source location kept */
+#define NAME_LENGTH 63
+
+/*********************************Symbol***************************************
+ *
+ * One line of the symbol map, and the counts charged to it.
+ * Stores:
+ *         uint32_t start, end:   Addresses it labels, end exclusive
+ *         char name[]:           The label
+ *         char source[]:         File and line it is defined on
+ *         uint64_t instructions: Instructions executed in it
+ *         uint64_t cycles:       Cycles spent in it
+ *
+ *****************************************************************************/
+struct Symbol {
+        uint32_t start;
+        uint32_t end;
+        char name[NAME_LENGTH + 1];
+        char source[NAME_LENGTH + 1];
+        uint64_t instructions;
+        uint64_t cycles;
+};
+
+/*********************************Sample***************************************
+ *
+ * One line of um.prof: the counts at one PC.
+ *
+ *****************************************************************************/
+struct Sample {
+        uint32_t pc;
+        uint64_t instructions;
+        uint64_t cycles;
+        uint64_t calls;
+        uint64_t inclusive_instructions;
+        uint64_t inclusive_cycles;
+};
+
+/******************************Procedure***************************************
+ *
+ * A called address and the counts charged to it.
+ * Stores:
+ *         uint32_t entry:        The address
+ *         char name[]:           Its label, with an offset if it has none
+ *         uint64_t calls:        Times it was called
+ *         uint64_t instructions, cycles:
+ *                                Executed from it up to the next procedure
+ *         uint64_t inclusive_instructions, inclusive_cycles:
+ *                                Executed between its calls and returns
+ *
+ *****************************************************************************/
+struct Procedure {
+        uint32_t entry;
+        char name[2 * NAME_LENGTH + 1];
+        uint64_t calls;
+        uint64_t instructions;
+        uint64_t cycles;
+        uint64_t inclusive_instructions;
+        uint64_t inclusive_cycles;
+};
+
+static void usage(void)
+{
+        fprintf(stderr, "Usage: umprof program.sym [um.prof]\n");
+        exit(1);
+}
+
+static FILE *open_or_die(const char *path)
+{
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) {
+                fprintf(stderr, "umprof: cannot open %s\n", path);
+                exit(1);
+        }
+        return fp;
+}
+
+/*******************************read_symbols***********************************
+ *
+ * Reads a symbol map
+ * Inputs:
+ *         const char *path: The map
+ *         size_t *n:        Set to the number of symbols
+ * Return: The symbols, in the order of the map (by start address)
+ * Expects:
+ *         none
+ * Notes:
+ *         Lines starting with # are skipped. Exits on a malformed line;
+ *         CRE if the symbols cannot be allocated.
+ *****************************************************************************/
+static struct Symbol *read_symbols(const char *path, size_t *n)
+{
+        FILE *fp = open_or_die(path);
+        struct Symbol *symbols = NULL;
+        size_t capacity = 0;
+        char line[512];
+        unsigned number = 0;
+
+        *n = 0;
+        while (fgets(line, sizeof(line), fp) != NULL) {
+                number++;
+                if (line[0] == '#' || line[0] == '\n') {
+                        continue;
+                }
+                if (*n == capacity) {
+                        capacity = capacity == 0 ? 64 : capacity * 2;
+                        symbols = realloc(symbols,
+                                          capacity * sizeof(struct Symbol));
+                        assert(symbols);
+                }
+                struct Symbol *s = &symbols[*n];
+                memset(s, 0, sizeof(*s));
+                if (sscanf(line, "%" SCNu32 " %" SCNu32 " %63s %63s",
+                           &s->start, &s->end, s->name, s->source) != 4 ||
+                    s->end < s->start ||
+                    (*n > 0 && s->start < symbols[*n - 1].start)) {
+                        fprintf(stderr, "umprof: %s:%u: not a symbol map "
+                                "line\n", path, number);
+                        exit(1);
+                }
+                (*n)++;
+        }
+        fclose(fp);
+        return symbols;
+}
+
+/*******************************read_profile***********************************
+ *
+ * Reads a profile written by um-profile
+ * Inputs:
+ *         const char *path: The profile
+ *         size_t *n:        Set to the number of samples
+ *         uint64_t *total:  Set to the instructions in the run
+ *         unsigned *loads:  Set to the times segment zero was replaced
+ * Return: The samples, by PC
+ * Expects:
+ *         none
+ * Notes:
+ *         Exits on a malformed line; CRE if the samples cannot be
+ *         allocated
+ *****************************************************************************/
+static struct Sample *read_profile(const char *path, size_t *n,
+                                   uint64_t *total, unsigned *loads)
+{
+        FILE *fp = open_or_die(path);
+        struct Sample *samples = NULL;
+        size_t capacity = 0;
+        char line[512];
+        unsigned number = 0;
+
+        *n = 0;
+        *total = 0;
+        *loads = 0;
+        while (fgets(line, sizeof(line), fp) != NULL) {
+                number++;
+                if (line[0] == '#') {
+                        sscanf(line, "# um profile: %" SCNu64
+                               " instructions, %u", total, loads);
+                        continue;
+                }
+                if (*n == capacity) {
+                        capacity = capacity == 0 ? 1024 : capacity * 2;
+                        samples = realloc(samples,
+                                          capacity * sizeof(struct Sample));
+                        assert(samples);
+                }
+                struct Sample *s = &samples[*n];
+                if (sscanf(line, "%" SCNu32 " %" SCNu64 " %" SCNu64 " %"
+                           SCNu64 " %" SCNu64 " %" SCNu64, &s->pc,
+                           &s->instructions, &s->cycles, &s->calls,
+                           &s->inclusive_instructions,
+                           &s->inclusive_cycles) != 6) {
+                        fprintf(stderr, "umprof: %s:%u: not a profile "
+                                "line\n", path, number);
+                        exit(1);
+                }
+                (*n)++;
+        }
+        fclose(fp);
+        return samples;
+}
+
+/********************************symbol_at*************************************
+ *
+ * Finds the symbol whose code holds an address
+ * Inputs:
+ *         struct Symbol *symbols: The symbol map, by start address
+ *         size_t n:               Number of symbols
+ *         uint32_t pc:            The address
+ * Return: The index of the last symbol starting at or before pc, or n if
+ *         pc is outside every symbol
+ * Expects:
+ *         none
+ * Notes:
+ *         Of several labels for one address, the last defined is used
+ *****************************************************************************/
+static size_t symbol_at(struct Symbol *symbols, size_t n, uint32_t pc)
+{
+        size_t low = 0, high = n;
+        while (low < high) {
+                size_t mid = low + (high - low) / 2;
+                if (symbols[mid].start <= pc) {
+                        low = mid + 1;
+                } else {
+                        high = mid;
+                }
+        }
+        if (low == 0 || pc >= symbols[low - 1].end) {
+                return n;
+        }
+        return low - 1;
+}
+
+static int by_cycles(const void *a, const void *b)
+{
+        uint64_t x = ((const struct Symbol *) a)->cycles;
+        uint64_t y = ((const struct Symbol *) b)->cycles;
+        return (x < y) - (x > y);
+}
+
+static int by_inclusive_cycles(const void *a, const void *b)
+{
+        uint64_t x = ((const struct Procedure *) a)->inclusive_cycles;
+        uint64_t y = ((const struct Procedure *) b)->inclusive_cycles;
+        return (x < y) - (x > y);
+}
+
+static double percent(uint64_t part, uint64_t whole)
+{
+        return whole == 0 ? 0.0 : 100.0 * part / whole;
+}
+
+int main(int argc, char *argv[])
+{
+        if (argc < 2 || argc > 3) {
+                usage();
+        }
+
+        size_t nsymbols, nsamples;
+        uint64_t total;
+        unsigned loads;
+        struct Symbol *symbols = read_symbols(argv[1], &nsymbols);
+        struct Sample *samples = read_profile(argc > 2 ? argv[2] : "um.prof",
+                                              &nsamples, &total, &loads);
+
+        /* Procedures are the called addresses, after the top level */
+        struct Procedure *procedures = calloc(nsamples + 1,
+                                              sizeof(struct Procedure));
+        assert(procedures);
+        size_t nprocedures = 1;
+        strcpy(procedures[0].name, "(top level)");
+        for (size_t i = 0; i < nsamples; i++) {
+                if (samples[i].calls == 0) {
+                        continue;
+                }
+                struct Procedure *p = &procedures[nprocedures++];
+                p->entry = samples[i].pc;
+                p->calls = samples[i].calls;
+                p->inclusive_instructions = samples[i].inclusive_instructions;
+                p->inclusive_cycles = samples[i].inclusive_cycles;
+                size_t s = symbol_at(symbols, nsymbols, p->entry);
+                if (s == nsymbols) {
+                        sprintf(p->name, "%" PRIu32, p->entry);
+                } else if (symbols[s].start == p->entry) {
+                        strcpy(p->name, symbols[s].name);
+                } else {
+                        sprintf(p->name, "%s+%" PRIu32, symbols[s].name,
+                                p->entry - symbols[s].start);
+                }
+        }
+
+        /* Charge every sample to its label and procedure */
+        struct Symbol unlabeled;
+        memset(&unlabeled, 0, sizeof(unlabeled));
+        strcpy(unlabeled.name, "(no label)");
+        strcpy(unlabeled.source, "-");
+        uint64_t cycles = 0;
+        size_t procedure = 0;
+        for (size_t i = 0; i < nsamples; i++) {
+                struct Sample *sample = &samples[i];
+                size_t s = symbol_at(symbols, nsymbols, sample->pc);
+                struct Symbol *symbol = s == nsymbols ? &unlabeled :
+                                                        &symbols[s];
+                symbol->instructions += sample->instructions;
+                symbol->cycles += sample->cycles;
+
+                while (procedure + 1 < nprocedures &&
+                       procedures[procedure + 1].entry <= sample->pc) {
+                        procedure++;
+                }
+                procedures[procedure].instructions += sample->instructions;
+                procedures[procedure].cycles += sample->cycles;
+                cycles += sample->cycles;
+        }
+        procedures[0].calls = 1;
+        procedures[0].inclusive_instructions = total;
+        procedures[0].inclusive_cycles = cycles;
+
+        printf("umprof: %" PRIu64 " instructions, %" PRIu64 " cycles\n",
+               total, cycles);
+        if (loads > 0) {
+                printf("umprof: segment zero was replaced %u times; counts "
+                       "of every program loaded are mixed\n", loads);
+        }
+
+        printf("\nby label (self):\n");
+        printf("  %-24s %-20s %14s %7s %14s %7s\n", "label", "source",
+               "instructions", "%", "cycles", "%");
+        qsort(symbols, nsymbols, sizeof(struct Symbol), by_cycles);
+        for (size_t i = 0; i <= nsymbols; i++) {
+                struct Symbol *s = i == nsymbols ? &unlabeled : &symbols[i];
+                if (s->instructions == 0) {
+                        continue;
+                }
+                printf("  %-24s %-20s %14" PRIu64 " %6.2f%% %14" PRIu64
+                       " %6.2f%%\n", s->name, s->source, s->instructions,
+                       percent(s->instructions, total), s->cycles,
+                       percent(s->cycles, cycles));
+        }
+
+        printf("\nby procedure:\n");
+        printf("  %-24s %10s %14s %14s %14s %7s %14s %7s\n", "procedure",
+               "calls", "self instr", "self cycles", "incl instr", "%",
+               "incl cycles", "%");
+        qsort(procedures, nprocedures, sizeof(struct Procedure),
+              by_inclusive_cycles);
+        for (size_t i = 0; i < nprocedures; i++) {
+                struct Procedure *p = &procedures[i];
+                printf("  %-24s %10" PRIu64 " %14" PRIu64 " %14" PRIu64
+                       " %14" PRIu64 " %6.2f%% %14" PRIu64 " %6.2f%%\n",
+                       p->name, p->calls, p->instructions, p->cycles,
+                       p->inclusive_instructions,
+                       percent(p->inclusive_instructions, total),
+                       p->inclusive_cycles,
+                       percent(p->inclusive_cycles, cycles));
+        }
+
+        free(symbols);
+        free(samples);
+        free(procedures);
+        return 0;
+}
@@ -0,0 +1,856 @@
+/******************************************************************************
+ *
+ *                                 umserver.c
+ *
+ *     Assignment: um
+ *     Authors:    Marten Tropp and Matthew Carey
+ *     Date:       11/20/2023
+ *
+ *     The purpose of this file is to serve one UM program to many users at
+ *     once from a single process. Every connection to a Unix domain socket
+ *     gets its own UM loaded with the program; bytes from the connection are
+ *     its input and its output goes back down the connection.
+ *
+ *     One thread runs an epoll loop over the listening socket and every
+ *     connection. A small pool of worker threads runs machines in slices of
+ *     SLICE instructions. A machine that executes IN with no input waiting
+ *     is suspended: it costs nothing until its connection has more bytes,
+ *     at which point it is queued for a worker again. Only the epoll thread
+ *     frees sessions, so no event can name a session that is gone.
+ *
+ *     When a session closes a line with its instruction count and the
+ *     latency of its interactions is printed to stderr. An interaction runs
+ *     from the first input that finds the machine idle until the machine is
+ *     waiting for input again. On SIGINT or SIGTERM the server prints the
+ *     same figures over all sessions and its aggregate throughput, and
+ *     exits.
+ *
+ *     Usage: umserver [-threads N] program.um socket-path
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "um.h"
+
+/* Instructions a machine runs before yielding its worker */
+#define SLICE (1u << 20)
+
+#define DEFAULT_THREADS 4
+#define MAX_EVENTS 64
+
+/* Who owns a session: nobody (BLOCKED), the run queue, a worker, or the
+   epoll thread, which is about to free it (DONE) */
+enum state { BLOCKED, QUEUED, RUNNING, DONE };
+
+struct buffer {
+        unsigned char *bytes;
+        size_t pos;
+        size_t len;
+        size_t cap;
+};
+
+struct samples {
+        double *values;
+        size_t n;
+        size_t cap;
+};
+
+/**********************************session*************************************
+ *
+ * One connection and the machine attached to it.
+ * Stores:
+ *         int fd:                 The connection
+ *         unsigned id:            Number of the session, for reports
+ *         struct um_T um:         The machine
+ *         pthread_mutex_t lock:   Guards everything below it
+ *         enum state state:       Who owns the session
+ *         uint32_t events:        Events the fd is registered for
+ *         bool hangup:            The connection failed or was closed
+ *         bool in_eof:            The client will send no more input
+ *         bool draining:          Retired, but its last output is still
+ *                                 being sent
+ *         struct buffer in:       Input not yet read by the machine
+ *         struct buffer pending:  Output not yet taken by the socket
+ *         double waiting_since:   When the current interaction began, or 0
+ *         double opened:          When the connection was accepted
+ *         uint64_t instructions:  Instructions executed so far
+ *         struct samples latency: Length of each interaction in seconds
+ *         struct buffer out:      Output of the running slice, owned by the
+ *                                 worker running it
+ *         struct session *next:   Link in the run queue or done list
+ *
+ *****************************************************************************/
+struct session {
+        int fd;
+        unsigned id;
+        struct um_T um;
+
+        pthread_mutex_t lock;
+        enum state state;
+        uint32_t events;
+        bool hangup;
+        bool in_eof;
+        bool draining;
+        struct buffer in;
+        struct buffer pending;
+        double waiting_since;
+        double opened;
+        uint64_t instructions;
+        struct samples latency;
+
+        struct buffer out;
+        struct session *next;
+};
+
+/**********************************server**************************************
+ *
+ * State shared by the epoll thread and the workers.
+ *         uint32_t *image, length:  The program every session starts with
+ *         int epfd, listen_fd:      The epoll instance and listening socket
+ *         int wake_fd:              eventfd that wakes the epoll thread when
+ *                                   a worker finishes a session
+ *         pthread_mutex_t lock:     Guards everything below it
+ *         pthread_cond_t ready:     Signalled when the run queue grows
+ *         head, tail:               The run queue
+ *         done:                     Sessions for the epoll thread to free
+ *         bool stopping:            Workers should exit
+ *         uint64_t instructions:    Executed by every session so far
+ *         unsigned sessions:        Sessions closed so far
+ *         struct samples latency:   Interactions of every closed session
+ *
+ *****************************************************************************/
+static struct {
+        uint32_t *image;
+        uint32_t length;
+        int epfd;
+        int listen_fd;
+        int wake_fd;
+        double started;
+
+        pthread_mutex_t lock;
+        pthread_cond_t ready;
+        struct session *head;
+        struct session *tail;
+        struct session *done;
+        bool stopping;
+        uint64_t instructions;
+        unsigned sessions;
+        struct samples latency;
+} server;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void *worker(void *unused);
+static void accept_sessions(void);
+static void read_input(struct session *s);
+static void write_pending(struct session *s);
+static void update_events(struct session *s);
+static void retire(struct session *s);
+static void close_session(struct session *s);
+
+/**********************************now*****************************************
+ *
+ * Returns monotonic time in seconds
+ *
+ *****************************************************************************/
+static double now(void)
+{
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/*******************************buffer_append**********************************
+ *
+ * Appends bytes to a buffer, dropping the bytes already consumed first
+ * Inputs:
+ *         struct buffer *b: The buffer
+ *         const void *bytes: The bytes to append
+ *         size_t n:          How many
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         CRE if memory cannot be allocated
+ *****************************************************************************/
+static void buffer_append(struct buffer *b, const void *bytes, size_t n)
+{
+        if (b->pos > 0) {
+                memmove(b->bytes, b->bytes + b->pos, b->len - b->pos);
+                b->len -= b->pos;
+                b->pos = 0;
+        }
+        if (b->len + n > b->cap) {
+                b->cap = (b->len + n) * 2;
+                b->bytes = realloc(b->bytes, b->cap);
+                assert(b->bytes);
+        }
+        memcpy(b->bytes + b->len, bytes, n);
+        b->len += n;
+}
+
+static void samples_add(struct samples *s, double value)
+{
+        if (s->n == s->cap) {
+                s->cap = s->cap == 0 ? 64 : s->cap * 2;
+                s->values = realloc(s->values, s->cap * sizeof(double));
+                assert(s->values);
+        }
+        s->values[s->n++] = value;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+        double x = *(const double *) a, y = *(const double *) b;
+        return (x > y) - (x < y);
+}
+
+/*******************************print_latency**********************************
+ *
+ * Prints the median, 99th percentile and maximum of some latencies in ms
+ * Inputs:
+ *         struct samples *s: The latencies, sorted in place
+ * Return: none
+ * Expects:
+ *         none
+ * Notes:
+ *         none
+ *****************************************************************************/
+static void print_latency(struct samples *s)
+{
+        if (s->n == 0) {
+                fprintf(stderr, "no interactions");
+                return;
+        }
+        qsort(s->values, s->n, sizeof(double), compare_doubles);
+        fprintf(stderr, "%zu interactions, latency p50 %.3fms p99 %.3fms "
+                "max %.3fms", s->n, s->values[(s->n - 1) / 2] * 1e3,
+                s->values[(size_t) ((s->n - 1) * 0.99)] * 1e3,
+                s->values[s->n - 1] * 1e3);
+}
+
+/****************************um_session_input**********************************
+ *
+ * Gives the machine the next byte of its connection's input
+ * Inputs:
+ *         struct um_T *um: The machine executing IN
+ *         uint32_t *word:  Where the byte is stored
+ * Return: false if no byte has arrived yet
+ * Expects:
+ *         um->session to be its session
+ * Notes:
+ *         Stores ~0 once the client has shut down its side and every byte
+ *         has been read
+ *****************************************************************************/
+static bool um_session_input(struct um_T *um, uint32_t *word)
+{
+        struct session *s = um->session;
+        bool ready = true;
+
+        pthread_mutex_lock(&s->lock);
+        if (s->in.pos < s->in.len) {
+                *word = s->in.bytes[s->in.pos++];
+        }
+        else if (s->in_eof || s->hangup) {
+                *word = ~(uint32_t)0;
+        }
+        else {
+                ready = false;
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        return ready;
+}
+
+/****************************um_session_output*********************************
+ *
+ * Buffers a byte of output until the end of the slice
+ *
+ *****************************************************************************/
+static void um_session_output(struct um_T *um, uint32_t c)
+{
+        struct session *s = um->session;
+        unsigned char byte = c;
+        buffer_append(&s->out, &byte, 1);
+}
+
+/********************************set_events************************************
+ *
+ * Changes the events a session's fd is registered for
+ * Inputs:
+ *         struct session *s: The session, locked by the caller
+ *         uint32_t events:   The new events, or 0 for none
+ * Return: none
+ * Expects:
+ *         s->lock to be held
+ * Notes:
+ *         epoll_ctl is safe to call from any thread. With no events the fd
+ *         is removed from epoll, since EPOLLHUP and EPOLLERR are reported
+ *         whatever the fd is registered for and would wake epoll_wait over
+ *         and over; it is added again if it needs events later
+ *****************************************************************************/
+static void set_events(struct session *s, uint32_t events)
+{
+        if (events == s->events) {
+                return;
+        }
+        struct epoll_event ev;
+        ev.events = events;
+        ev.data.ptr = s;
+        int op = events == 0 ? EPOLL_CTL_DEL
+               : s->events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+        epoll_ctl(server.epfd, op, s->fd, &ev);
+        s->events = events;
+}
+
+/*******************************update_events**********************************
+ *
+ * Registers a session's fd for the events it still needs
+ * Inputs:
+ *         struct session *s: The session, locked by the caller
+ * Return: none
+ * Expects:
+ *         s->lock to be held
+ * Notes:
+ *         EPOLLIN until the client shuts down its side or the session is
+ *         retired, EPOLLOUT while output is pending; nothing once the
+ *         connection has failed
+ *****************************************************************************/
+static void update_events(struct session *s)
+{
+        uint32_t events = 0;
+        if (!s->in_eof && !s->hangup && !s->draining) {
+                events |= EPOLLIN;
+        }
+        if (s->pending.pos < s->pending.len && !s->hangup) {
+                events |= EPOLLOUT;
+        }
+        set_events(s, events);
+}
+
+/*********************************enqueue**************************************
+ *
+ * Adds a session to the tail of the run queue and wakes a worker
+ *
+ *****************************************************************************/
+static void enqueue(struct session *s)
+{
+        pthread_mutex_lock(&server.lock);
+        s->next = NULL;
+        if (server.tail == NULL) {
+                server.head = s;
+        }
+        else {
+                server.tail->next = s;
+        }
+        server.tail = s;
+        pthread_cond_signal(&server.ready);
+        pthread_mutex_unlock(&server.lock);
+}
+
+/**********************************retire**************************************
+ *
+ * Hands a finished session to the epoll thread to be freed
+ *
+ *****************************************************************************/
+static void retire(struct session *s)
+{
+        pthread_mutex_lock(&server.lock);
+        s->next = server.done;
+        server.done = s;
+        pthread_mutex_unlock(&server.lock);
+
+        uint64_t one = 1;
+        ssize_t n = write(server.wake_fd, &one, sizeof(one));
+        (void) n;
+}
+
+/*******************************write_pending**********************************
+ *
+ * Sends as much pending output as the socket will take without blocking
+ * Inputs:
+ *         struct session *s: The session, locked by the caller
+ * Return: none
+ * Expects:
+ *         s->lock to be held
+ * Notes:
+ *         Registers for EPOLLOUT while output remains; a failed send marks
+ *         the session hung up
+ *****************************************************************************/
+static void write_pending(struct session *s)
+{
+        while (s->pending.pos < s->pending.len) {
+                ssize_t n = send(s->fd, s->pending.bytes + s->pending.pos,
+                                 s->pending.len - s->pending.pos,
+                                 MSG_NOSIGNAL);
+                if (n < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                                s->hangup = true;
+                        }
+                        break;
+                }
+                s->pending.pos += n;
+        }
+
+        update_events(s);
+}
+
+/**********************************worker**************************************
+ *
+ * Runs queued machines one slice at a time until the server stops
+ * Inputs:
+ *         void *unused: Unused
+ * Return: NULL
+ * Expects:
+ *         none
+ * Notes:
+ *         After each slice the session goes back on the queue if it can make
+ *         progress, is suspended if it is waiting for input that has not
+ *         arrived, and is retired if it halted or its client went away
+ *****************************************************************************/
+static void *worker(void *unused)
+{
+        (void) unused;
+
+        for (;;) {
+                pthread_mutex_lock(&server.lock);
+                while (server.head == NULL && !server.stopping) {
+                        pthread_cond_wait(&server.ready, &server.lock);
+                }
+                if (server.stopping) {
+                        pthread_mutex_unlock(&server.lock);
+                        return NULL;
+                }
+                struct session *s = server.head;
+                server.head = s->next;
+                if (server.head == NULL) {
+                        server.tail = NULL;
+                }
+                pthread_mutex_unlock(&server.lock);
+
+                pthread_mutex_lock(&s->lock);
+                bool gone = s->hangup;
+                s->state = gone ? DONE : RUNNING;
+                pthread_mutex_unlock(&s->lock);
+                if (gone) {
+                        retire(s);
+                        continue;
+                }
+
+                uint64_t executed = um_run_slice(&s->um, SLICE);
+
+                pthread_mutex_lock(&server.lock);
+                server.instructions += executed;
+                pthread_mutex_unlock(&server.lock);
+
+                pthread_mutex_lock(&s->lock);
+                s->instructions += executed;
+                if (s->out.len > 0) {
+                        buffer_append(&s->pending, s->out.bytes, s->out.len);
+                        s->out.len = 0;
+                        write_pending(s);
+                }
+
+                bool idle = s->um.halt || (s->um.blocked &&
+                                           s->in.pos == s->in.len &&
+                                           !s->in_eof);
+                if (idle && s->waiting_since != 0) {
+                        samples_add(&s->latency, now() - s->waiting_since);
+                        s->waiting_since = 0;
+                }
+
+                if (s->um.halt || s->hangup) {
+                        s->state = DONE;
+                }
+                else if (idle) {
+                        s->state = BLOCKED;
+                }
+                else {
+                        s->state = QUEUED;
+                }
+                enum state state = s->state;
+                pthread_mutex_unlock(&s->lock);
+
+                if (state == DONE) {
+                        retire(s);
+                }
+                else if (state == QUEUED) {
+                        enqueue(s);
+                }
+        }
+}
+
+/*****************************accept_sessions**********************************
+ *
+ * Accepts every waiting connection and starts a machine for each
+ * Inputs:
+ *         none
+ * Return: none
+ * Expects:
+ *         The listening socket to be non-blocking
+ * Notes:
+ *         A new machine is queued at once, so a program that prints a
+ *         banner before reading input does so immediately
+ *****************************************************************************/
+static void accept_sessions(void)
+{
+        static unsigned next_id = 0;
+
+        for (;;) {
+                int fd = accept(server.listen_fd, NULL, NULL);
+                if (fd < 0) {
+                        return;
+                }
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+                struct session *s = calloc(1, sizeof(*s));
+                assert(s);
+                s->fd = fd;
+                s->id = next_id++;
+                s->opened = now();
+                pthread_mutex_init(&s->lock, NULL);
+
+                s->um = um_new(server.length);
+                s->um.session = s;
+                memcpy(Segment_words(&s->um.segments, 0), server.image,
+                       server.length * sizeof(uint32_t));
+
+                s->state = QUEUED;
+                s->events = EPOLLIN;
+                struct epoll_event ev;
+                ev.events = EPOLLIN;
+                ev.data.ptr = s;
+                epoll_ctl(server.epfd, EPOLL_CTL_ADD, fd, &ev);
+                enqueue(s);
+        }
+}
+
+/*********************************read_input***********************************
+ *
+ * Moves everything the client has sent into the session's input
+ * Inputs:
+ *         struct session *s: A session whose fd is readable or hung up
+ * Return: none
+ * Expects:
+ *         Called only from the epoll thread
+ * Notes:
+ *         A suspended machine is queued again. Once the client shuts down
+ *         its side, or the connection fails, the fd stops being watched for
+ *         input, and leaves epoll unless output is waiting.
+ *****************************************************************************/
+static void read_input(struct session *s)
+{
+        unsigned char bytes[4096];
+        bool eof = false, failed = false;
+
+        pthread_mutex_lock(&s->lock);
+        for (;;) {
+                ssize_t n = recv(s->fd, bytes, sizeof(bytes), 0);
+                if (n > 0) {
+                        buffer_append(&s->in, bytes, n);
+                        continue;
+                }
+                if (n == 0) {
+                        eof = true;
+                }
+                else if (errno == EINTR) {
+                        continue;
+                }
+                else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        failed = true;
+                }
+                break;
+        }
+
+        if (s->waiting_since == 0 && s->in.pos < s->in.len) {
+                s->waiting_since = now();
+        }
+        if (eof) {
+                s->in_eof = true;
+        }
+        if (failed) {
+                s->hangup = true;
+        }
+        update_events(s);
+
+        enum state state = s->state;
+        if (state == BLOCKED && s->hangup) {
+                s->state = DONE;
+        }
+        else if (state == BLOCKED) {
+                s->state = QUEUED;
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        if (state == BLOCKED) {
+                if (s->hangup) {
+                        retire(s);
+                }
+                else {
+                        enqueue(s);
+                }
+        }
+}
+
+/*******************************close_session**********************************
+ *
+ * Reports on a retired session and frees it, once its output is sent
+ * Inputs:
+ *         struct session *s: A session in state DONE
+ * Return: none
+ * Expects:
+ *         Called only from the epoll thread, after the current batch of
+ *         events has been handled, or for a draining session from its own
+ *         event
+ * Notes:
+ *         If output is still pending the session is left draining, watched
+ *         only for EPOLLOUT, so the last thing a program prints before
+ *         halting is not lost and a client that stops reading holds up no
+ *         one else. It is freed when the output is all sent or the client
+ *         goes away.
+ *****************************************************************************/
+static void close_session(struct session *s)
+{
+        pthread_mutex_lock(&s->lock);
+        s->draining = true;
+        write_pending(s);
+        bool sent = s->hangup || s->pending.pos == s->pending.len;
+        if (sent) {
+                set_events(s, 0);
+        }
+        pthread_mutex_unlock(&s->lock);
+        if (!sent) {
+                return;
+        }
+        close(s->fd);
+
+        if (!s->um.halt) {
+                Segment_free(&s->um.segments);
+        }
+
+        fprintf(stderr, "umserver: session %u: %" PRIu64 " instructions in "
+                "%.3fs, ", s->id, s->instructions, now() - s->opened);
+        print_latency(&s->latency);
+        fprintf(stderr, "\n");
+
+        pthread_mutex_lock(&server.lock);
+        server.sessions++;
+        for (size_t i = 0; i < s->latency.n; i++) {
+                samples_add(&server.latency, s->latency.values[i]);
+        }
+        pthread_mutex_unlock(&server.lock);
+
+        pthread_mutex_destroy(&s->lock);
+        free(s->in.bytes);
+        free(s->out.bytes);
+        free(s->pending.bytes);
+        free(s->latency.values);
+        free(s);
+}
+
+/*********************************load_image***********************************
+ *
+ * Reads the big-endian words of a .um file into memory
+ *
+ *****************************************************************************/
+static void load_image(const char *path)
+{
+        FILE *fp = fopen(path, "rb");
+        if (fp == NULL) {
+                fprintf(stderr, "Error opening file.\n");
+                exit(1);
+        }
+        fseek(fp, 0L, SEEK_END);
+        server.length = ftell(fp) / 4;
+        fseek(fp, 0L, SEEK_SET);
+
+        server.image = malloc((server.length + 1) * sizeof(uint32_t));
+        assert(server.image);
+        for (uint32_t i = 0; i < server.length; i++) {
+                uint32_t word = 0;
+                for (int b = 0; b < 4; b++) {
+                        word = (word << 8) | (uint32_t) getc(fp);
+                }
+                server.image[i] = word;
+        }
+        fclose(fp);
+}
+
+/*******************************open_listener**********************************
+ *
+ * Creates the non-blocking listening socket at a path
+ *
+ *****************************************************************************/
+static int open_listener(const char *path)
+{
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(path) >= sizeof(addr.sun_path)) {
+                fprintf(stderr, "umserver: socket path too long\n");
+                exit(1);
+        }
+        strcpy(addr.sun_path, path);
+        unlink(path);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+            listen(fd, 128) < 0) {
+                perror("umserver");
+                exit(1);
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        return fd;
+}
+
+static void request_stop(int sig)
+{
+        (void) sig;
+        stop_requested = 1;
+}
+
+static void usage(void)
+{
+        fprintf(stderr, "Usage: ./umserver [-threads N] [file].um "
+                "socket-path\n");
+        exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+        int threads = DEFAULT_THREADS;
+        int i = 1;
+
+        if (i + 1 < argc && strcmp(argv[i], "-threads") == 0) {
+                threads = atoi(argv[i + 1]);
+                i += 2;
+        }
+        if (argc - i != 2 || threads < 1) {
+                usage();
+        }
+
+        load_image(argv[i]);
+        server.listen_fd = open_listener(argv[i + 1]);
+        server.epfd = epoll_create1(0);
+        server.wake_fd = eventfd(0, EFD_NONBLOCK);
+        pthread_mutex_init(&server.lock, NULL);
+        pthread_cond_init(&server.ready, NULL);
+        server.started = now();
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &server.listen_fd;
+        epoll_ctl(server.epfd, EPOLL_CTL_ADD, server.listen_fd, &ev);
+        ev.data.ptr = &server.wake_fd;
+        epoll_ctl(server.epfd, EPOLL_CTL_ADD, server.wake_fd, &ev);
+
+        /* Workers never see SIGINT/SIGTERM, so epoll_wait is interrupted */
+        sigset_t stops, old;
+        sigemptyset(&stops);
+        sigaddset(&stops, SIGINT);
+        sigaddset(&stops, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &stops, &old);
+        pthread_t *pool = malloc(threads * sizeof(pthread_t));
+        assert(pool);
+        for (int t = 0; t < threads; t++) {
+                pthread_create(&pool[t], NULL, worker, NULL);
+        }
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = request_stop;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+        signal(SIGPIPE, SIG_IGN);
+
+        struct epoll_event events[MAX_EVENTS];
+        while (!stop_requested) {
+                int n = epoll_wait(server.epfd, events, MAX_EVENTS, -1);
+                for (int e = 0; e < n; e++) {
+                        void *tag = events[e].data.ptr;
+                        if (tag == &server.listen_fd) {
+                                accept_sessions();
+                                continue;
+                        }
+                        if (tag == &server.wake_fd) {
+                                uint64_t count;
+                                ssize_t r = read(server.wake_fd, &count,
+                                                 sizeof(count));
+                                (void) r;
+                                continue;
+                        }
+                        struct session *s = tag;
+                        if (s->draining) {
+                                /* nobody is left to read the output */
+                                pthread_mutex_lock(&s->lock);
+                                if (events[e].events & (EPOLLHUP | 
+                                                        EPOLLERR)) {
+                                        s->hangup = true;
+                                }
+                                pthread_mutex_unlock(&s->lock);
+                                close_session(s);
+                                continue;
+                        }
+                        /* after a hangup the send fails and says so */
+                        if (events[e].events & (EPOLLOUT | EPOLLHUP |
+                                                EPOLLERR)) {
+                                pthread_mutex_lock(&s->lock);
+                                write_pending(s);
+                                pthread_mutex_unlock(&s->lock);
+                        }
+                        if (events[e].events & (EPOLLIN | EPOLLHUP |
+                                                EPOLLERR)) {
+                                read_input(s);
+                        }
+                }
+
+                pthread_mutex_lock(&server.lock);
+                struct session *done = server.done;
+                server.done = NULL;
+                pthread_mutex_unlock(&server.lock);
+                while (done != NULL) {
+                        struct session *next = done->next;
+                        close_session(done);
+                        done = next;
+                }
+        }
+
+        pthread_mutex_lock(&server.lock);
+        server.stopping = true;
+        pthread_cond_broadcast(&server.ready);
+        pthread_mutex_unlock(&server.lock);
+        for (int t = 0; t < threads; t++) {
+                pthread_join(pool[t], NULL);
+        }
+
+        double elapsed = now() - server.started;
+        fprintf(stderr, "umserver: %u sessions closed, %" PRIu64
+                " instructions in %.3fs (%.1f million/s), ", server.sessions,
+                server.instructions, elapsed,
+                server.instructions / elapsed / 1e6);
+        print_latency(&server.latency);
+        fprintf(stderr, "\n");
+
+        unlink(argv[i + 1]);
+        free(pool);
+        free(server.image);
+        return EXIT_SUCCESS;
+}